@@ -31,6 +31,7 @@ public:
     bool stackMatch(const SOffset from, const SOffset to);
     
     void resetStack();
+    void reset(const Size maxData);
     void addSegment(const Segment &seg);
 
 private:
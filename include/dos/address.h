@@ -4,9 +4,12 @@
 #include <string>
 #include <cassert>
 #include <regex>
+#include <vector>
 
 #include "dos/types.h"
 
+class FormatBuffer;
+
 static constexpr Size MEM_TOTAL = 1_MB;
 static constexpr Size SEGMENT_SIZE = 64_kB;
 static constexpr int SEGMENT_MASK = 0xf0000;
@@ -19,6 +22,8 @@ static constexpr Offset OFFSET_MASK = 0xffff;
 static constexpr Offset OFFSET_NORMAL_MASK = 0xf;
 static constexpr int OFFSET_STRLEN = 6; // 6 hex digits for linear offsets up to 0x100000
 static constexpr int WORD_STRLEN = 4;   // 4 hex digits for segment values up to 0xffff
+static constexpr Size ADDRESS_STRLEN = 2 * WORD_STRLEN + OFFSET_STRLEN + 3; // "ssss:oooo/llllll" with terminator
+static constexpr Size BLOCK_HEX_STRLEN = 2 * WORD_STRLEN + 2; // "oooo-oooo" with terminator
 static constexpr Word ADDR_INVALID = 0xffff;
 static constexpr Offset OFFSET_MAX = 0xffff;
 
@@ -64,6 +69,7 @@ struct Address {
 
     void set(const Offset linear);
     std::string toString(const bool brief = false) const;
+    void render(FormatBuffer &out, const bool brief = false) const;
     inline Offset toLinear() const { return SEG_TO_OFFSET(segment) + offset; }
     bool isNull() const { return segment == 0 && offset == 0; }
     bool isValid() const { return segment != ADDR_INVALID || offset != ADDR_INVALID; }
@@ -93,6 +99,7 @@ struct Block {
 
     std::string toString(const bool linear = false, const bool showSize = true, const bool includeLinear = false) const;
     std::string toHex() const;
+    void renderHex(FormatBuffer &out) const;
     Size size() const { return (isValid() ? (end - begin) + 1 : 0); }
     bool isValid() const { return begin.isValid() && end.isValid() && begin <= end; }
     bool inSegment(const Word seg) const { return begin.inSegment(seg) && end.inSegment(seg); }
@@ -112,6 +119,32 @@ struct Block {
 std::ostream& operator<<(std::ostream &os, const Block &arg);
 inline std::string operator+(const std::string &str, const Block &arg) { return str + arg.toString(); }
 
+// Open-addressing hash set of addresses packed into 32 bits. Addresses aliasing the same linear location are stored once,
+// as the first one inserted.
+class AddressSet {
+    static constexpr DWord EMPTY = 0xffffffff;
+    std::vector<DWord> slots_;
+    Size size_, shift_;
+
+public:
+    AddressSet() : size_(0), shift_(32) {}
+    bool insert(const Address &addr);
+    bool contains(const Address &addr) const;
+    Size size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // empty the set, keeping the table allocated
+    void clear();
+    // contents sorted by linear address
+    std::vector<Address> addresses() const;
+
+private:
+    static DWord pack(const Address &addr) { return (static_cast<DWord>(addr.segment) << 16) | addr.offset; }
+    static Address unpack(const DWord packed) { return { static_cast<Word>(packed >> 16), static_cast<Word>(packed & 0xffff) }; }
+    Size slot(const Offset linear) const { return static_cast<DWord>(linear * 0x9e3779b1u) >> shift_; }
+    Size find(const Offset linear) const;
+    void grow();
+};
+
 struct Segment {
     std::string name;
     enum Type {
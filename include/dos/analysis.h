@@ -14,7 +14,10 @@
 #include "dos/routine.h"
 #include "dos/scanq.h"
 #include "dos/codemap.h"
+#include "dos/callgraph.h"
+#include "dos/xref.h"
 #include "dos/signature.h"
+#include "dos/executable.h"
 
 // Declare helper functions for instruction application and comparison
 
@@ -27,8 +30,6 @@ enum class ComparisonResult {
     CMP_VARIANT     // instructions are variants of each other
 };
 
-class Executable;
-
 // TODO: 
 // - implement calculation of memory offsets based on register values from instruction operand type enum, allow for unknown values, see jump @ 0xab3 in hello.exe
 
@@ -72,10 +73,12 @@ public:
         Size refSkip, tgtSkip, ctxCount, dataCtxCount;
         Size routineSizeThresh; // minimum routine size (in instructions) threshold
         Size routineDistanceThresh; // maximum edit distance threshold (as ratio of routine size)
+        Size threads; // worker threads for decoding ahead of code exploration, 1 disables
         Address stopAddr;
         std::string mapPath, tgtMapPath;
+        std::string cachePath; // exploration results are reused from and saved to this file if not empty
         Options() : strict(true), ignoreDiff(false), noCall(false), variant(false), checkAsm(false), noStats(false), extData(false), refSkip(0), tgtSkip(0), ctxCount(10), dataCtxCount(160),
-            routineSizeThresh(15), routineDistanceThresh(10) {}
+            routineSizeThresh(15), routineDistanceThresh(10), threads(1) {}
     };
 private:
     ComparisonResult matchType;
@@ -92,20 +95,39 @@ private:
     OffsetMap offMap;
     Size comparedSize, routineSumSize, reachableSize, unreachableSize, excludedSize, excludedCount, excludedReachableSize, missedSize, ignoredSize;
     ScanQueue scanQueue, tgtQueue;
-    Routine routine;
+    static const Routine UNKNOWN_ROUTINE; // placeholder for the current routine when comparing without a map
+    const Routine *routine; // the reference routine being compared, owned by the reference map or UNKNOWN_ROUTINE
     std::set<std::string> routineNames, excludedNames, missedNames;
     Size refSkipCount, tgtSkipCount;
     Address refSkipOrigin, tgtSkipOrigin;
-    std::set<Variable> vars;
+    std::set<Variable> vars; // named variables seeded from a map
+    AddressSet dataRefs; // unnamed data references found by exploration, converted to variables only when building a map
+    std::vector<CallSite> callSites;
+    std::vector<EntryState> entryStates;
+    std::vector<Xref> xrefs;
+    // instructions of the target routines' main blocks, decoded by findDuplicates on first use and shared by all signatures
+    InstructionArena tgtArena;
+    std::vector<InstructionArena::Span> tgtSpans;
+    bool runDone;
 
 public:
-    Analyzer(const Options &options, const Size maxData = 0) : options(options), offMap(maxData), comparedSize(0) {}
+    Analyzer(const Options &options, const Size maxData = 0) : options(options), offMap(maxData), comparedSize(0), routine(&UNKNOWN_ROUTINE), runDone(false) {}
+    // discard the state of the previous run, containers are cleared but keep their capacity for the next one
+    void reset();
     CodeMap exploreCode(Executable &exe);
+    CodeMap exploreCode(Executable &exe, const CodeMap &prevMap, const Executable &prevExe);
     bool compareCode(const Executable &ref, Executable &tgt, const CodeMap &refMap);
     bool compareData(const Executable &ref, const Executable &tgt, const CodeMap &refMap, const CodeMap &tgtMap, const std::string &segment);
     bool findDuplicates(const SignatureLibrary signatures, Executable &tgt, CodeMap &tgtMap);
     void findDataRefs(const Executable &exe, const CodeMap &map);
     void seedQueue(const CodeMap &map, Executable &exe);
+    // call sites and routine entry registers recorded by exploreCode() resolved against the routines of its resulting map
+    CallGraph callGraph(const CodeMap &map) const { return CallGraph{map, callSites, entryStates}; }
+    // reuse call sites and entry registers of a previous exploration for incremental exploration
+    void seedCalls(const CallGraph &graph);
+    // code and data references recorded by exploreCode(), indexed by their targets
+    XrefIndex xrefIndex() const { return XrefIndex{xrefs}; }
+    void seedXrefs(const XrefIndex &index);
 
 private:
     bool skipAllowed(const Instruction &refInstr, Instruction tgtInstr);
@@ -116,14 +138,19 @@ private:
     Address findTargetLocation(const Executable &ref, const Executable &tgt);
     bool comparisonLoop(const Executable &ref, Executable &tgt, const CodeMap &refMap);
     Branch getBranch(const Executable &exe, const Instruction &i, const CpuState &regs) const;
-    ComparisonResult variantMatch(const Executable &tgt, const Instruction &refInstr, Instruction tgtInstr);
+    ComparisonResult variantMatch(const Executable &tgt, const Instruction &refInstr, const Instruction &tgtInstr);
     ComparisonResult instructionsMatch(const Executable &ref, const Executable &tgt, const Instruction &refInstr, const Instruction &tgtInstr);
     void diffContext(const Executable &ref, const Executable &tgt) const;
     void skipContext(const Executable &ref, const Executable &tgt) const;
     void calculateStats(const CodeMap &routineMap);
     void comparisonSummary(const Executable &ref, const CodeMap &routineMap, const bool showMissed);
-    void processDataReference(const Executable &exe, const Instruction i, const CpuState &regs);
+    void beginRun(const bool seeding);
+    std::set<Variable> variables() const;
+    void processDataReference(const Executable &exe, const Address &csip, const Instruction i, const CpuState &regs);
     void claimNops(const Instruction &i, const Executable &exe);
+    void prescanCode(Executable &exe) const;
+    bool loadCache(Executable &exe, const std::vector<RoutineEntrypoint> &seeds, const CpuState &initRegs);
+    void saveCache(const Executable &exe, const std::vector<RoutineEntrypoint> &seeds) const;
 };
 
 #endif // ANALYSIS_H
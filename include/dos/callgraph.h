@@ -0,0 +1,81 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <vector>
+#include <span>
+#include <string>
+
+#include "dos/types.h"
+#include "dos/address.h"
+#include "dos/registers.h"
+
+class CodeMap;
+
+// a call instruction found during code exploration, the destination is invalid if it could not be determined
+struct CallSite {
+    Address site, dest;
+    bool near;
+    CallSite(const Address &site, const Address &dest, const bool near) : site(site), dest(dest), near(near) {}
+};
+
+// register values a routine was entered with when its exploration started at the entrypoint
+struct EntryState {
+    Address entrypoint;
+    CpuState regs;
+    EntryState(const Address &entrypoint, const CpuState &regs) : entrypoint(entrypoint), regs(regs) {}
+};
+
+// Calls between the routines of a code map in compressed sparse row form, with the edges of each routine stored contiguously
+// in both directions. Routines are identified by their entrypoints, so the graph stays valid when routines are renamed in the map.
+class CallGraph {
+public:
+    static constexpr Size NO_NODE = static_cast<Size>(-1);
+    struct Edge {
+        Size node; // the callee in a list of callees, the caller in a list of callers
+        Address site;
+        bool near;
+    };
+    // call site with a destination that could not be determined
+    struct Unresolved {
+        Size caller;
+        Address site;
+        bool near;
+    };
+
+private:
+    std::vector<Address> nodes_;
+    // edges of node n are at [index[n], index[n+1])
+    std::vector<Size> calleeIndex_, callerIndex_;
+    std::vector<Edge> callees_, callers_;
+    std::vector<Unresolved> unresolved_;
+    // sorted by entrypoint, only for the nodes whose entry registers are known
+    std::vector<EntryState> entryStates_;
+
+public:
+    CallGraph() : calleeIndex_(1, 0), callerIndex_(1, 0) {}
+    // the last of multiple entry states for the same routine is kept
+    CallGraph(const CodeMap &map, const std::vector<CallSite> &sites, const std::vector<EntryState> &states = {});
+    CallGraph(const std::string &path, const Word reloc = 0);
+
+    Size nodeCount() const { return nodes_.size(); }
+    Size edgeCount() const { return callees_.size(); }
+    bool empty() const { return nodes_.empty(); }
+    const Address& entrypoint(const Size node) const { return nodes_.at(node); }
+    Size findNode(const Address &entrypoint) const;
+    std::span<const Edge> callees(const Size node) const { return { callees_.data() + calleeIndex_.at(node), callees_.data() + calleeIndex_.at(node + 1) }; }
+    std::span<const Edge> callers(const Size node) const { return { callers_.data() + callerIndex_.at(node), callers_.data() + callerIndex_.at(node + 1) }; }
+    const std::vector<Unresolved>& unresolved() const { return unresolved_; }
+    // call sites of the known calls, callers and destinations which are unresolved calls
+    std::vector<CallSite> callSites() const;
+    // register values the routine was entered with, nullptr if not known
+    const CpuState* entryState(const Size node) const;
+    const std::vector<EntryState>& entryStates() const { return entryStates_; }
+    // all nodes ordered so that callees come before their callers, cycles are broken arbitrarily but deterministically
+    std::vector<Size> topologicalOrder() const;
+    void save(const std::string &path, const Word reloc = 0) const;
+
+private:
+    void build(std::vector<std::pair<Size, Edge>> &edges);
+};
+
+#endif // CALLGRAPH_H
@@ -1,15 +1,19 @@
 #ifndef CODEMAP_H
 #define CODEMAP_H
 
+#include <iosfwd>
 #include <string>
 #include <regex>
 #include <vector>
 #include <set>
+#include <span>
 
 #include "dos/types.h"
 #include "dos/address.h"
 #include "dos/routine.h"
 
+class MapImage;
+
 struct Variable {
     std::string name;
     Address addr;
@@ -21,6 +25,58 @@ struct Variable {
     bool operator<(const Variable &other) const { return addr < other.addr; }
 };
 
+// Routines owning the addresses of a map, as a sorted array of disjoint linear ranges for binary searching by address.
+// Where blocks of different routines overlap, the routine which comes first in the map owns the overlap.
+class RoutineIndex {
+    std::vector<Offset> begins_, ends_; // ends are one past the last offset
+    std::vector<Size> routines_;
+
+public:
+    static constexpr Size NONE = static_cast<Size>(-1);
+    RoutineIndex() {}
+    // the reachable blocks of routines are always indexed, the extents and unreachable blocks optionally
+    RoutineIndex(const std::vector<Routine> &routines, const bool extents, const bool unreachable);
+    Size size() const { return begins_.size(); }
+    // index of the routine owning an address, or the first routine owning any part of a block
+    Size find(const Offset linear) const;
+    Size find(const Block &b) const;
+};
+
+// Open-addressing hash table of positions in an array of items, keys are compared on the items themselves so none are copied.
+// Where several items have the same key, a lookup resolves to the first one.
+class PositionHash {
+    static constexpr DWord EMPTY = 0xffffffff;
+    struct Slot { DWord hash, pos; };
+    std::vector<Slot> slots_;
+    Size shift_ = 64;
+
+    Size slot(const Size hash) const { return (hash * 0x9e3779b97f4a7c15ull) >> shift_; }
+
+public:
+    static constexpr Size NONE = static_cast<Size>(-1);
+    // hash(pos) is the hash of an item key, equal(pos1, pos2) tells whether two items have the same key
+    template<typename Hash, typename Equal> void build(const Size count, Hash hash, Equal equal) {
+        // keep the load factor at most 1/2
+        Size capacity = 16;
+        shift_ = 60;
+        while (capacity < count * 2) { capacity <<= 1; shift_--; }
+        slots_.assign(capacity, Slot{0, EMPTY});
+        for (Size pos = 0; pos < count; ++pos) {
+            const Size h = hash(pos);
+            Size s = slot(h);
+            while (slots_[s].pos != EMPTY && !(slots_[s].hash == static_cast<DWord>(h) && equal(slots_[s].pos, pos))) s = (s + 1) & (capacity - 1);
+            if (slots_[s].pos == EMPTY) slots_[s] = Slot{static_cast<DWord>(h), static_cast<DWord>(pos)};
+        }
+    }
+    // match(pos) tells whether the item has the key being looked up
+    template<typename Match> Size find(const Size hash, Match match) const {
+        if (slots_.empty()) return NONE;
+        for (Size s = slot(hash); slots_[s].pos != EMPTY; s = (s + 1) & (slots_.size() - 1))
+            if (slots_[s].hash == static_cast<DWord>(hash) && match(slots_[s].pos)) return slots_[s].pos;
+        return NONE;
+    }
+};
+
 // A map of an executable, records which areas have been claimed by routines, and which have not, serializable to a file
 class CodeMap {
 public:
@@ -48,6 +104,10 @@ private:
     std::vector<Block> unclaimed;
     std::vector<Segment> segments;
     std::vector<Variable> vars;
+    // routine and variable lookups, rebuilt on first use after the routines or variables were modified
+    mutable RoutineIndex addrIndex, blockIndex;
+    mutable PositionHash routineNames, routineEntrypoints, varNames, varAddrs;
+    mutable bool indexed = false;
     // TODO: turn these into a context struct, pass around instead of members
     RoutineIdx curId, prevId, curBlockId, prevBlockId;
     bool ida;
@@ -65,15 +125,24 @@ public:
     Size routinesSize() const;
 
     // TODO: routine.id start at 1, this is zero based, so id != idx, confusing
-    Routine getRoutine(const Size idx) const { return routines.at(idx); }
+    const Routine& getRoutine(const Size idx) const { return routines.at(idx); }
+    std::span<const Routine> getRoutines() const { return routines; }
     Routine getRoutine(const Address &addr) const;
+    // routine owning an address or having a name, without copying it, nullptr if none
+    const Routine* findRoutine(const Address &addr) const;
+    const Routine* findRoutine(const std::string &name) const;
     Routine getRoutine(const std::string &name) const;
-    Routine& getMutableRoutine(const Size idx) { return routines.at(idx); }
+    Routine& getMutableRoutine(const Size idx) { indexed = false; return routines.at(idx); }
     Routine& getMutableRoutine(const std::string &name);
-    std::vector<Block> getUnclaimed() const { return unclaimed; }
-    Variable getVariable(const Size idx) const { return vars.at(idx); }
+    std::span<const Block> getUnclaimed() const { return unclaimed; }
+    const Variable& getVariable(const Size idx) const { return vars.at(idx); }
+    std::span<const Variable> getVariables() const { return vars; }
+    // variable at an address or having a name, without copying it, nullptr if none
+    const Variable* findVariable(const Address &addr) const;
+    const Variable* findVariable(const std::string &name) const;
     Variable getVariable(const std::string &name) const;
     Variable getVariable(const Address &addr) const;
+    const Routine* findEntrypoint(const Address &ep) const;
     Routine findByEntrypoint(const Address &ep) const;
     Block findCollision(const Block &b) const;
     bool empty() const { return routines.empty(); }
@@ -82,6 +151,8 @@ public:
     Routine colidesBlock(const Block &b) const;
     void order();
     void save(const std::string &path, const Word reloc = 0, const bool overwrite = false) const;
+    // save in the binary format, which is loaded by the same constructor as the text map
+    void saveBinary(const std::string &path, const Word reloc = 0, const bool overwrite = false) const;
     Summary getSummary(const bool verbose = true, const bool hide = false, const bool format = false) const;
     const auto& getSegments() const { return segments; }
     Size segmentCount(const Segment::Type type) const;
@@ -95,11 +166,13 @@ private:
     void closeBlock(Block &b, const Address &next, const ScanQueue &sq, const bool unclaimedOnly);
     Block moveBlock(const Block &b, const Word segment) const;
     void sort();
+    void buildIndex() const;
     void loadFromMapFile(const std::string &path, const Word reloc);
     void loadFromLinkFile(const std::string &path, const Word reloc);    
     void loadFromIdaFile(const std::string &path, const Word reloc);
-    std::string routineString(const Routine &r, const Word reloc) const;
-    std::string varString(const Variable &v, const Word reloc) const;
+    void loadFromImage(const std::string &path, const Word reloc);
+    void writeRoutine(std::ostream &str, const Routine &r, const Word reloc) const;
+    void writeVariable(std::ostream &str, const Variable &v, const Word reloc) const;
     void blocksFromQueue(const ScanQueue &sq, const bool unclaimedOnly);
 };
 
@@ -2,25 +2,64 @@
 #define EXECUTABLE_H
 
 #include <vector>
+#include <span>
 #include <set>
+#include <unordered_map>
 
 #include "dos/types.h"
 #include "dos/address.h"
 #include "dos/memory.h"
 #include "dos/routine.h"
 #include "dos/mz.h"
+#include "dos/instruction.h"
+
+// Instructions of decoded blocks stored as a structure of arrays. Blocks are appended one after another and the storage
+// is kept across clear(), so decoding a whole executable block by block does not allocate once the arrays have grown.
+class InstructionArena {
+    friend class Executable;
+    std::vector<Offset> offsets_;
+    std::vector<Byte> lengths_;
+    std::vector<QWord> keys_;
+    std::vector<Signature> signatures_;
+
+public:
+    // location of the instructions of a single block within the arena
+    struct Span {
+        Size begin, count;
+        Span() : begin(0), count(0) {}
+        Span(const Size begin, const Size count) : begin(begin), count(count) {}
+        bool empty() const { return count == 0; }
+    };
+
+    Size size() const { return offsets_.size(); }
+    void clear();
+    void reserve(const Size count);
+    // linear offsets of the instructions
+    std::span<const Offset> offsets(const Span &s) const { return { offsets_.data() + s.begin, s.count }; }
+    std::span<const Byte> lengths(const Span &s) const { return { lengths_.data() + s.begin, s.count }; }
+    std::span<const QWord> keys(const Span &s) const { return { keys_.data() + s.begin, s.count }; }
+    std::span<const Signature> signatures(const Span &s) const { return { signatures_.data() + s.begin, s.count }; }
+
+private:
+    void push(const Offset offset, const Instruction &i);
+};
 
 class Executable {
     friend class AnalysisTest;
-    // TODO: just keep the load module data, not the entire memory space
-    Memory code;
+    // load module data followed by a zeroed guard zone of MEM_GUARD bytes
+    std::vector<Byte> code;
     Word loadSegment;
+    // linear address of the first byte of the load module
+    Offset codeBase;
     // actually the load module size
     Size codeSize;
     Address ep, stack;
     Block codeExtents;
     std::vector<Segment> segments;
     std::string origPath;
+    // decoded instructions keyed by linear offset, filled lazily as the analysis passes request them
+    mutable std::unordered_map<Offset, Instruction> instrCache;
+    mutable Size instrCacheHits, instrCacheMisses;
 
 public:
     explicit Executable(const MzImage &mz);
@@ -37,15 +76,26 @@ public:
     Segment getSegment(const Word addr) const;
     bool storeSegment(const Segment &seg);
     void clearSegments() { segments.clear(); }
-    const Memory& getCode() const { return code; }
-    const Byte* codePointer(const Address &addr) const { return code.pointer(addr); }
+    const Byte* codePointer(const Address &addr) const;
+    Byte readByte(const Address &addr) const { return *codePointer(addr); }
+    Word readWord(const Address &addr) const;
     const std::vector<Segment>& getSegments() const { return segments; }
     Word getLoadSegment() const { return loadSegment; }
     Address find(const ByteString &pattern, Block where = {}) const;
     std::vector<Signature> getSignatures(const Block &range) const;
+    InstructionArena::Span decodeBlock(const Block &range, InstructionArena &arena) const;
+    Size instructionCount(const Block &range) const;
+    Instruction getInstruction(const Address &addr) const;
+    // decode an instruction bypassing the cache, safe to call from multiple threads
+    Instruction decodeInstruction(const Address &addr) const;
+    void cacheInstructions(const std::vector<Instruction> &instrs);
+    Size instructionCacheHits() const { return instrCacheHits; }
+    Size instructionCacheMisses() const { return instrCacheMisses; }
+    std::string instructionCacheInfo() const;
 
 private:
     void init();
+    const Instruction& cachedInstruction(const Address &addr) const;
 };
 
 #endif // EXECUTABLE_H
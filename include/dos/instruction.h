@@ -186,40 +186,40 @@ OPERAND_TYPE
 #undef X
 };
 
-inline bool operandIsReg(const OperandType type) {
+constexpr bool operandIsReg(const OperandType type) {
     return type >= OPR_REG_AX && type <= OPR_REG_SS;
 }
 
-inline bool operandIsMem(const OperandType type) {
+constexpr bool operandIsMem(const OperandType type) {
     return type >= OPR_MEM_BX_SI && type <= OPR_MEM_BX_OFF16;
 }
 
-inline bool operandIsMemWithOffset(const OperandType type) {
+constexpr bool operandIsMemWithOffset(const OperandType type) {
     return type >= OPR_MEM_OFF8 && type <= OPR_MEM_BX_OFF16;
 }
 
-inline bool operandIsMemNoOffset(const OperandType type) {
+constexpr bool operandIsMemNoOffset(const OperandType type) {
     return type >= OPR_MEM_BX_SI && type <= OPR_MEM_BX;
 }
 
-inline bool operandIsMemImmediate(const OperandType ot) {
+constexpr bool operandIsMemImmediate(const OperandType ot) {
     return ot == OPR_MEM_OFF8 || ot == OPR_MEM_OFF16;
 }
 
-inline bool operandIsMemWithByteOffset(const OperandType type) {
+constexpr bool operandIsMemWithByteOffset(const OperandType type) {
     return type >= OPR_MEM_OFF8 && type <= OPR_MEM_BX_OFF8;
 }
 
-inline bool operandIsMemWithWordOffset(const OperandType type) {
+constexpr bool operandIsMemWithWordOffset(const OperandType type) {
     return type >= OPR_MEM_OFF16 && type <= OPR_MEM_BX_OFF16;
 }
 
-inline bool operandIsImmediate(const OperandType ot) {
+constexpr bool operandIsImmediate(const OperandType ot) {
     return ot >= OPR_IMM0 && ot <= OPR_IMM32;
 }
 
 // not an implicit immediate, i.e. not OPR_IMM0 or OPR_IMM1
-inline bool operandIsExplicitImmediate(const OperandType ot) {
+constexpr bool operandIsExplicitImmediate(const OperandType ot) {
     return ot >= OPR_IMM8 && ot <= OPR_IMM32;
 }
 
@@ -266,6 +266,15 @@ INSTRUCTION_MATCH
 #undef X
 };
 
+// longest encoding consumed by the decoder: prefix, opcode, modrm, 16bit displacement and 16bit immediate
+static constexpr Size INSTRUCTION_MAX_LENGTH = 7;
+
+// length of the instruction encoded at the location, or 0 if it is not a valid instruction
+Size instructionLength(const Byte *data);
+
+// buffer size sufficient for the longest rendered instruction, e.g. "repnz cmp word es:[bx+si-0x1234], 0x1234"
+static constexpr Size INSTRUCTION_STRLEN = 64;
+
 class Instruction {
 public:
     Address addr;
@@ -285,18 +294,24 @@ public:
         } immval; // optional immediate offset or literal value
 
         std::string toString() const;
+        void render(FormatBuffer &out) const;
         InstructionMatch match(const Operand &other) const;
         Register regId() const;
         Word wordValue() const;
         DWord dwordValue() const;
+        DWord canonicalValue() const;
         Address farAddr() const;
         ByteString immediateValue() const;
     } op1, op2;
     const Byte* data;
+    // packed canonical form computed on load, two instructions match up to operand values if their keys are equal,
+    // the value word holds the canonical operand values: op1 in the low, op2 in the high doubleword
+    QWord key, value;
 
     Instruction();
     Instruction(const Address &addr, const Byte *data);
     std::string toString(const bool extended = false) const;
+    void render(FormatBuffer &out, const bool extended = false) const;
     ByteString pattern() const;
     Signature signature() const;
     InstructionMatch match(const Instruction &other) const;
@@ -318,13 +333,14 @@ public:
     bool isNearJump() const { return iclass == INS_JMP || iclass == INS_JMP_IF || isLoop(); }
     bool isNearBranch() const { return isNearJump() || iclass == INS_CALL; }
     bool isReturn() const { return iclass == INS_RET || iclass == INS_RETF || iclass == INS_IRET; }
-    bool isInt(const Byte n) { 
+    bool isInt(const Byte n) const { 
         return (iclass == INS_INT && op1.immval.u8 == n) || (iclass == INS_INT3 && n == 3) || (iclass == INS_INTO && n == 4); 
     }
 
 private:
     OperandType getModrmOperand(const Byte modrm, const ModrmOperand op);
     Size loadImmediate(Operand &op, const Byte *data);
+    void canonicalize();
     const Operand* memOperand() const;
 };
 
@@ -0,0 +1,76 @@
+#ifndef MAPIMAGE_H
+#define MAPIMAGE_H
+
+#include <string>
+#include <string_view>
+
+#include "dos/types.h"
+#include "dos/address.h"
+#include "dos/routine.h"
+#include "dos/util.h"
+
+class CodeMap;
+struct Variable;
+
+// Binary form of a code map, memory-mapped and read in place without deserialising. All records are fixed-width and names
+// point into an interned string pool. Addresses are stored relative to the load segment like in the text map, and relocated on access.
+class MapImage {
+public:
+    struct BlockRec { Word beginSeg, beginOff, endSeg, endOff; };
+    struct SegmentRec { DWord name; Word address, type; };
+    // the reachable blocks of a routine are followed by its unreachable blocks in the block table
+    struct RoutineRec { DWord name, idx; BlockRec extents; DWord blocks; Word reachable, unreachable; DWord comments; Word commentCount, flags; };
+    struct VariableRec { DWord name; Word segment, offset, flags, pad; };
+    enum RoutineFlags : Word {
+        ROUTINE_NEAR = 1 << 0, ROUTINE_IGNORE = 1 << 1, ROUTINE_COMPLETE = 1 << 2, ROUTINE_UNCLAIMED = 1 << 3,
+        ROUTINE_EXTERNAL = 1 << 4, ROUTINE_DETACHED = 1 << 5, ROUTINE_ASSEMBLY = 1 << 6, ROUTINE_DUPLICATE = 1 << 7
+    };
+    enum VariableFlags : Word { VAR_EXTERNAL = 1 << 0, VAR_BSS = 1 << 1 };
+    enum MapFlags : Word { MAP_IDA = 1 << 0 };
+
+private:
+    struct Table { DWord count, offset; };
+    struct Header {
+        DWord magic;
+        Word version, flags;
+        DWord mapSize;
+        Table segments, routines, blocks, variables, unclaimed, comments;
+        DWord poolSize, pool;
+    };
+    MappedFile file;
+    const char *base;
+    const Header *header;
+    Word reloc;
+
+    template<typename T> const T* table(const Table &t) const { return reinterpret_cast<const T*>(base + t.offset); }
+    Block block(const BlockRec &b) const;
+
+public:
+    // whether the file starts with the binary map signature
+    static bool isImage(const std::string &path);
+    static void save(const CodeMap &map, const std::string &path, const Word reloc = 0);
+    MapImage(const std::string &path, const Word reloc = 0);
+
+    Size mapSize() const { return header->mapSize; }
+    bool ida() const { return header->flags & MAP_IDA; }
+    Size segmentCount() const { return header->segments.count; }
+    Size routineCount() const { return header->routines.count; }
+    Size variableCount() const { return header->variables.count; }
+    Size unclaimedCount() const { return header->unclaimed.count; }
+    std::string_view string(const DWord offset) const { return base + header->pool + offset; }
+
+    const SegmentRec& segmentRec(const Size idx) const { return table<SegmentRec>(header->segments)[idx]; }
+    const RoutineRec& routineRec(const Size idx) const { return table<RoutineRec>(header->routines)[idx]; }
+    const VariableRec& variableRec(const Size idx) const { return table<VariableRec>(header->variables)[idx]; }
+    std::string_view routineName(const Size idx) const { return string(routineRec(idx).name); }
+    Block routineExtents(const Size idx) const { return block(routineRec(idx).extents); }
+    std::string_view variableName(const Size idx) const { return string(variableRec(idx).name); }
+    Address variableAddress(const Size idx) const;
+    Block unclaimed(const Size idx) const { return block(table<BlockRec>(header->unclaimed)[idx]); }
+    // the records converted into the in-memory types
+    Segment segment(const Size idx) const;
+    Routine routine(const Size idx) const;
+    Variable variable(const Size idx) const;
+};
+
+#endif // MAPIMAGE_H
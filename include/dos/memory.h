@@ -29,13 +29,18 @@
 0x100000 - 0x10FFEF: (64KiB - 16)
 --- extended memory available from protected mode only
 */
+// Amount of zeroed bytes past the end of a code buffer, longer than the longest instruction encoding.
+// The instruction decoder does not check bounds while consuming bytes, it can safely run off the end of the data into this area
+// and the caller detects a truncated instruction by comparing its end with the end of the data.
+static constexpr Size MEM_GUARD = 16;
+
 class Memory {
 private:
     static constexpr Offset INIT_BREAK = 0x500; // beginning of free conventional memory block
     static constexpr Offset MEM_END = 0xa0000; // end of usable memory, start of UMA
 
 private:
-    std::array<Byte, MEM_TOTAL> data_;
+    std::array<Byte, MEM_TOTAL + MEM_GUARD> data_;
     Offset break_;
 
 public:
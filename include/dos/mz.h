@@ -2,11 +2,13 @@
 #define MZ_H
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <ostream>
 #include "dos/types.h"
 #include "dos/address.h"
+#include "dos/util.h"
 
 static constexpr Size MAX_COMFILE_SIZE = 0xff00;
 static constexpr Size MZ_HEADER_SIZE = 14 * sizeof(Word);
@@ -47,11 +49,17 @@ private:
 
     const std::string path_;
     Size filesize_, loadModuleSize_;
+    // The file contents are mapped read-only and private, only what gets accessed is read from disk. Patching the relocations 
+    // copies just the pages which contain them, the rest stays shared with the page cache.
+    std::unique_ptr<MappedFile> file_;
+    // loadModuleData_ only holds code supplied directly instead of from a file
     std::vector<Byte> loadModuleData_, ovlinfo_;
     std::vector<Relocation> relocs_;
     Offset loadModuleOffset_;
+    const Byte *loadModule_;
     Address entrypoint_;
     Word loadSegment_;
+    bool loaded_;
 
 public:
     MzImage(const std::string &path);
@@ -64,7 +72,7 @@ public:
     Size headerLength() const { return header_.header_paragraphs * PARAGRAPH_SIZE; }
     Size loadModuleSize() const { return loadModuleSize_; }
     Offset loadModuleOffset() const { return loadModuleOffset_; }
-    const Byte* loadModuleData() const { return loadModuleData_.data(); }
+    const Byte* loadModuleData() const { return loadModule_; }
     Word loadSegment() const { return loadSegment_; }
     Size minAlloc() const { return header_.min_extra_paragraphs * PARAGRAPH_SIZE; }
     Size maxAlloc() const { return header_.max_extra_paragraphs * PARAGRAPH_SIZE; }
@@ -73,6 +81,9 @@ public:
     Address stackPointer() const { return Address(header_.ss, header_.sp); }
     void load(const Word loadSegment);
     void writeLoadModule(const std::string &path) const;
+
+private:
+    Word relocationValue(const Relocation &reloc) const;
 };
 
 #endif // MZ_H
\ No newline at end of file
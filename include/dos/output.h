@@ -2,6 +2,7 @@
 #define OUTPUT_H
 
 #include <string>
+#include <string_view>
 
 enum LogModule {
     LOG_SYSTEM,
@@ -31,7 +32,7 @@ enum Color {
     OUT_BRIGHTRED,
 };
 
-void output(const std::string &msg, const LogModule mod, const LogPriority pri = LOG_INFO, const Color color = OUT_DEFAULT, const bool suppressNewline = false);
+void output(std::string_view msg, const LogModule mod, const LogPriority pri = LOG_INFO, const Color color = OUT_DEFAULT, const bool suppressNewline = false);
 LogPriority getOutputLevel();
 void setOutputLevel(const LogPriority minPriority);
 void setModuleVisibility(const LogModule mod, const bool visible);
@@ -2,7 +2,9 @@
 #define REGISTERS_H
 
 #include <string>
-#include <list>
+#include <array>
+#include <istream>
+#include <ostream>
 #include "dos/types.h"
 #include "dos/address.h"
 
@@ -68,12 +70,16 @@ private:
 
 // TODO: implement CPU logic, execute arithmetic instructions and update register state in a more complete way than what is done now
 class CpuState {
+public:
+    // values pushed past the capacity push the oldest ones out of the stack
+    static constexpr Size STACK_CAPACITY = 16;
+
 private:
-    static constexpr Word WORD_KNOWN = 0xffff;
-    static constexpr Word BYTE_KNOWN = 0xff;
     Registers regs_;
-    Registers known_;
-    std::list<Word> stack_;
+    // one bit for each byte of the word registers, set if the value of the byte is known
+    DWord known_;
+    std::array<Word, STACK_CAPACITY> stack_;
+    Byte stackSize_;
 
 public:
     CpuState();
@@ -84,11 +90,16 @@ public:
     void setUnknown(const Register r);
     std::string regString(const Register r) const;
     std::string toString() const;
-    void push(const Word val) { stack_.push_front(val); }
-    Word pop() { Word ret = stack_.front(); stack_.pop_front(); return ret; }
-    bool stackEmpty() const { return stack_.empty(); }
-    void clearStack() { stack_.clear(); }
-    void reset() { regs_.reset(); known_.reset(); clearStack(); }
+    void push(const Word val);
+    Word pop() { return stack_[--stackSize_]; }
+    bool stackEmpty() const { return stackSize_ == 0; }
+    void clearStack() { stackSize_ = 0; }
+    void reset() { regs_.reset(); known_ = 0; clearStack(); }
+    // states are equal if they have the same registers known with the same values and the same stack contents
+    bool operator==(const CpuState &other) const;
+    Size hash() const;
+    void save(std::ostream &str) const;
+    void load(std::istream &str);
 
 private:
     void setState(const Register r, const Word value, const bool known);
@@ -1,21 +1,29 @@
 #ifndef SCANQ_H
 #define SCANQ_H
 
-#include <list>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
 
 #include "dos/address.h"
 #include "dos/routine.h"
 #include "dos/registers.h"
 
+// immutable register state snapshot, shared between destinations which were saved with the same state
+using CpuStateRef = std::shared_ptr<const CpuState>;
+
 // A destination (jump or call location) inside an analyzed executable
 struct Destination {
     Address address;
     RoutineIdx routineIdx;
     bool isCall;
-    CpuState regs;
+    CpuStateRef regs;
 
     Destination() : routineIdx(NULL_ROUTINE), isCall(false) {}
-    Destination(const Address address, const RoutineIdx idx, const bool call, const CpuState &regs) : address(address), routineIdx(idx), isCall(call), regs(regs) {}
+    Destination(const Address address, const RoutineIdx idx, const bool call, const CpuState &regs) : Destination(address, idx, call, std::make_shared<const CpuState>(regs)) {}
+    Destination(const Address address, const RoutineIdx idx, const bool call, const CpuStateRef &regs) : address(address), routineIdx(idx), isCall(call), regs(regs) {}
     bool match(const Destination &other) const { return address == other.address && isCall == other.isCall; }
     bool isNull() const { return address.isNull(); }
     std::string toString() const;
@@ -28,26 +36,73 @@ struct Branch {
     std::string toString() const;
 };
 
+// Ownership of the bytes of a memory area by routines, stored as runs of consecutive offsets with the same routine index, 
+// so the size depends on the number of blocks, not the size of the area. Offsets are relative to the beginning of the area.
+class VisitedMap {
+    Size size_;
+    // beginning offset of each run mapped to its routine index, consecutive runs always have different indexes
+    std::map<Offset, RoutineIdx> runs;
+    // bounds of the run found by the last lookup, consecutive lookups usually fall into the same run
+    mutable Offset cacheBegin, cacheEnd;
+    mutable RoutineIdx cacheIdx;
+
+public:
+    // a run of offsets with the same routine index, end is one past the last offset
+    struct Run {
+        Offset begin, end;
+        RoutineIdx idx;
+        Size size() const { return end - begin; }
+    };
+
+    explicit VisitedMap(const Size size = 0);
+    explicit VisitedMap(const std::vector<RoutineIdx> &values);
+    Size size() const { return size_; }
+    Size runCount() const { return runs.size(); }
+    void reset(const Size size);
+    RoutineIdx get(const Offset off) const { return find(off).idx; }
+    Run find(const Offset off) const;
+    void assign(const Offset off, const Size length, const RoutineIdx idx);
+    // first run with the routine index which ends after the offset, with an empty run at the end of the area if none
+    Run next(const Offset off, const RoutineIdx idx) const;
+    // highest routine index of any run
+    RoutineIdx maxIdx() const;
+    void save(std::ostream &str) const;
+    void load(std::istream &str);
+};
+
 // utility class for keeping track of the queue of potentially interesting Destinations, and which bytes in the executable have been visited already
 class ScanQueue {
     friend class AnalysisTest;
     // memory map for marking which locations belong to which routines, value of 0 is undiscovered
     // TODO: store addresses from loaded exe in map, otherwise they don't match after analysis done if exe loaded at segment other than 0
-    std::vector<RoutineIdx> visited;
+    VisitedMap visited;
     Address origin;
     Destination seed, curSearch;
-    std::list<Destination> queue;
+    std::deque<Destination> queue;
     std::vector<RoutineEntrypoint> entrypoints;
+    // number of queued destinations keyed by linear address and call flag
+    std::unordered_map<QWord, Size> queueIndex;
+    // positions within entrypoints keyed by linear address, name and routine index, the first occurrence wins.
+    // Entrypoints are only ever appended, the indexes catch up with them on lookup.
+    mutable std::unordered_map<Offset, Size> epAddrIndex;
+    mutable std::unordered_map<std::string, Size> epNameIndex;
+    mutable std::unordered_map<RoutineIdx, Size> epIdxIndex;
+    mutable Size epIndexed = 0;
+    // snapshots of the register states of saved destinations keyed by state hash, equal states are stored once
+    std::unordered_map<Size, std::vector<CpuStateRef>> statePool;
 
 public:
     ScanQueue(const Address &origin, const Size codeSize, const Destination &seed, const std::string name = {});
     ScanQueue() : origin(0, 0) {}
+    // reinitialize for another area, containers are cleared but keep their capacity
+    void reset(const Address &origin, const Size codeSize, const Destination &seed, const std::string name = {});
     // search point queue operations
     Size size() const { return queue.size(); }
     bool empty() const { return queue.empty(); }
     Address originAddress() const { return origin; }
     Destination nextPoint();
     bool hasPoint(const Address &dest, const bool call) const;
+    std::vector<Address> pendingPoints() const;
     bool saveCall(const Address &dest, const CpuState &regs, const bool near, const std::string name = {});
     bool saveJump(const Address &dest, const CpuState &regs);
     bool saveBranch(const Branch &branch, const CpuState &regs, const Block &codeExtents);
@@ -55,15 +110,31 @@ public:
     Size routineCount() const { return entrypoints.size(); }
     std::string statusString() const;
     RoutineIdx getRoutineIdx(Offset off) const;
+    // run of same-owner locations containing a linear offset, with linear bounds
+    VisitedMap::Run getRoutineRun(Offset off) const;
     void setRoutineIdx(Offset off, const Size length, RoutineIdx idx = NULL_ROUTINE);
+    RoutineIdx addRoutine(const Routine &r);
     void clearRoutineIdx(Offset off);
     RoutineIdx isEntrypoint(const Address &addr) const;
     RoutineEntrypoint getEntrypoint(const std::string &name) const;
     RoutineEntrypoint getEntrypoint(const RoutineIdx idx) const;
+    // set the name of the routine with an entrypoint at an address, false if there is none
+    bool nameEntrypoint(const Address &addr, const std::string &name);
     std::vector<Routine> getRoutines() const;
     std::vector<Block> getUnvisited() const;
+    const std::vector<RoutineEntrypoint>& getEntrypoints() const { return entrypoints; }
+    // binary snapshot of the visited map and the entrypoints, the pending search points are not included
+    void saveState(std::ostream &str) const;
+    void loadState(std::istream &str);
     void dumpVisited(const std::string &path) const;
     void dumpEntrypoints() const;
+
+private:
+    static QWord queueKey(const Address &addr, const bool call) { return (QWord(addr.toLinear()) << 1) | call; }
+    void pushFront(const Destination &dest);
+    void pushBack(const Destination &dest);
+    void indexEntrypoints() const;
+    CpuStateRef snapshot(const CpuState &regs);
 };
 
 #endif // SCANQ_H
\ No newline at end of file
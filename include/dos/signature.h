@@ -8,6 +8,8 @@
 #include <string>
 
 using SignatureString = std::vector<Signature>;
+// buffer size for a rendered signature value
+static constexpr Size SIGNATURE_STRLEN = 16;
 class CodeMap;
 class Executable;
 
@@ -11,6 +11,8 @@ using SByte  = int8_t;
 using Word   = uint16_t;
 using SWord  = int16_t;
 using DWord  = uint32_t;
+using SDWord = int32_t;
+using QWord  = uint64_t;
 using Size   = size_t;
 // for representing linear addresses from the memory base, required because DOS addresses don't fit in a 16-bit word
 using Offset = size_t;
@@ -4,6 +4,7 @@
 #include <istream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <iomanip>
 #include <vector>
 #include <regex>
@@ -50,6 +51,85 @@ std::string sizeStr(const Size s);
 std::string ratioStr(const Size p, const Size q);
 std::istream& safeGetline(std::istream& is, std::string& t);
 
+// Text builder over a caller-provided fixed-size buffer, for rendering frequently produced output without heap allocations.
+// Text that does not fit is dropped, the contents are always null-terminated.
+class FormatBuffer {
+    char *data;
+    Size capacity, length;
+
+public:
+    FormatBuffer(char *data, const Size capacity);
+    FormatBuffer& put(const char c);
+    FormatBuffer& put(const char *str);
+    FormatBuffer& put(std::string_view str);
+    // same output as hexVal() and signedHexVal()
+    FormatBuffer& hex(const DWord val, const bool prefix = true, const int pad = 0);
+    FormatBuffer& signedHex(const SDWord val, const int pad, const bool plus = true);
+    FormatBuffer& dec(const Size val);
+    // pad with the fill character up to the column
+    FormatBuffer& fill(const Size column, const char c = ' ');
+    void clear();
+    Size size() const { return length; }
+    bool full() const { return length + 1 >= capacity; }
+    const char* c_str() const { return data; }
+    std::string_view view() const { return {data, length}; }
+    std::string str() const { return std::string{data, length}; }
+};
+
+// Private memory mapping of a whole file, unmapped on destruction. It is read-only unless made writable for patching 
+// the contents in memory, which copies just the pages written to. Throws IoError if the file cannot be mapped.
+class MappedFile {
+    std::string path;
+    char *data;
+    Size size;
+
+public:
+    explicit MappedFile(const std::string &path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    std::string_view text() const { return {data, size}; }
+    const Byte* bytes() const { return reinterpret_cast<const Byte*>(data); }
+    Byte* mutableBytes() { return reinterpret_cast<Byte*>(data); }
+    Size fileSize() const { return size; }
+    void setWritable(const bool writable);
+};
+
+// Zero-copy cursor over text, for hand-written parsers of the map and listing formats.
+// Lines end like with safeGetline(), whitespace is the same as for istream extraction.
+class TextScanner {
+    std::string_view text;
+    Size pos;
+
+public:
+    explicit TextScanner(std::string_view text) : text(text), pos(0) {}
+    static bool isSpace(const char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    static bool isHex(const char c, const bool upperOnly = false);
+    // characters allowed in symbol names, optionally with '$'
+    static bool isName(const char c) { return c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static bool isNameOrDollar(const char c) { return c == '$' || isName(c); }
+
+    bool atEnd() const { return pos >= text.size(); }
+    std::string_view rest() const { return text.substr(pos); }
+    // next line without its terminator, false when the text is exhausted
+    bool line(std::string_view &out);
+    // next whitespace-separated token, empty at the end of the text
+    std::string_view token();
+    // skip whitespace, returning whether there was any
+    bool space();
+    // consume the literal if the text continues with it
+    bool literal(std::string_view str);
+    // consume a hex number of 1 to maxDigits digits, false if there are none
+    bool hex(Size &value, const Size maxDigits = SIZE_MAX, const bool upperOnly = false);
+    // consume a non-empty run of characters accepted by the predicate
+    template<typename Pred> bool span(Pred pred, std::string_view &out) {
+        const Size start = pos;
+        while (pos < text.size() && pred(text[pos])) pos++;
+        out = text.substr(start, pos - start);
+        return !out.empty();
+    }
+};
+
 struct FileStatus {
     bool exists;
     size_t size;
@@ -62,6 +142,13 @@ std::string replaceExtension(const std::string &path, const std::string &ext);
 bool deleteFile(const std::string &path);
 bool readBinaryFile(const std::string &path, Byte *buf, const Size size = 0);
 void writeBinaryFile(const std::string &path, const Byte *buf, const Size size);
+// little-endian integers and length-prefixed strings in binary streams, reads throw IoError when the stream runs out
+void writeBinaryValue(std::ostream &str, const QWord value, const Size size);
+QWord readBinaryValue(std::istream &str, const Size size);
+void writeBinaryString(std::ostream &str, const std::string &value);
+std::string readBinaryString(std::istream &str);
+// 64-bit FNV-1a, pass a previous result as the basis to continue hashing
+QWord hashBytes(const Byte *data, const Size size, QWord basis = 0xcbf29ce484222325ULL);
 std::string binString(const Word &value);
 std::string binString(const DWord &value);
 std::string bytesToHex(const std::vector<Byte> &bytes);
@@ -69,6 +156,7 @@ std::vector<SWord> hexaToNumeric(const std::string &hexa);
 std::string numericToHexa(const ByteString &pattern);
 std::vector<std::string> splitString(const std::string &str, char delim);
 void erasePattern(ByteString &str, const ByteString &pat);
+Size findPattern(const Byte *data, const Size size, const ByteString &pattern);
 bool regexMatch(const std::regex &re, const std::string &str);
 std::vector<std::string> extractRegex(const std::regex &re, const std::string &str);
 
@@ -0,0 +1,57 @@
+#ifndef XREF_H
+#define XREF_H
+
+#include <vector>
+#include <string>
+
+#include "dos/types.h"
+#include "dos/address.h"
+
+enum XrefKind : Byte {
+    XREF_READ,
+    XREF_WRITE,
+    XREF_CALL,
+    XREF_JUMP,
+};
+
+std::string xrefKindName(const XrefKind kind);
+
+// reference from an instruction at the source address to the target address
+struct Xref {
+    Address target, source;
+    XrefKind kind;
+    Xref(const Address &target, const Address &source, const XrefKind kind) : target(target), source(source), kind(kind) {}
+};
+
+// Cross-references sorted by target and then source address, stored in flat arrays for binary searching by target.
+class XrefIndex {
+    std::vector<Offset> linear_; // linear target addresses, the search key
+    std::vector<Address> targets_, sources_;
+    std::vector<XrefKind> kinds_;
+
+public:
+    // positions [begin, end) of references found by a lookup
+    struct Range {
+        Size begin, end;
+        Size size() const { return end - begin; }
+        bool empty() const { return begin == end; }
+    };
+
+    XrefIndex() {}
+    explicit XrefIndex(std::vector<Xref> refs);
+    XrefIndex(const std::string &path, const Word reloc = 0);
+
+    Size size() const { return linear_.size(); }
+    bool empty() const { return linear_.empty(); }
+    Xref at(const Size idx) const { return { targets_.at(idx), sources_.at(idx), kinds_.at(idx) }; }
+    const Address& target(const Size idx) const { return targets_[idx]; }
+    const Address& source(const Size idx) const { return sources_[idx]; }
+    XrefKind kind(const Size idx) const { return kinds_[idx]; }
+    // references to a single address, or to anything within a block
+    Range refsTo(const Address &target) const;
+    Range refsTo(const Block &area) const;
+    std::vector<Xref> refs() const;
+    void save(const std::string &path, const Word reloc = 0) const;
+};
+
+#endif // XREF_H
@@ -58,15 +58,21 @@ Address Address::operator+(const DWord arg) const {
 }
 
 std::string Address::toString(const bool brief) const {
-    ostringstream str;
-    if (isValid()) {
-        str << std::hex << std::setw(WORD_STRLEN) << std::setfill('0') << segment << ":" << std::setw(WORD_STRLEN) << std::setfill('0') << offset;
-        if (!brief) str << "/" << setw(OFFSET_STRLEN) << toLinear();
-    }
-    else str << "(invalid)";
+    char buf[ADDRESS_STRLEN];
+    FormatBuffer str{buf, sizeof(buf)};
+    render(str, brief);
     return str.str();
 }
 
+void Address::render(FormatBuffer &out, const bool brief) const {
+    if (!isValid()) {
+        out.put("(invalid)");
+        return;
+    }
+    out.hex(segment, false, WORD_STRLEN).put(':').hex(offset, false, WORD_STRLEN);
+    if (!brief) out.put('/').hex(static_cast<DWord>(toLinear()), false, OFFSET_STRLEN);
+}
+
 // move bulk of the offset to the segment part, limit offset to the modulus of a paragraph
 void Address::normalize() {
     segment += offset >> SEGMENT_SHIFT;
@@ -148,11 +154,16 @@ std::string Block::toString(const bool linear, const bool showSize, const bool i
 }
 
 std::string Block::toHex() const {
-    ostringstream str;
-    str << hexVal(begin.offset, false) << "-" << hexVal(end.offset, false);
+    char buf[BLOCK_HEX_STRLEN];
+    FormatBuffer str{buf, sizeof(buf)};
+    renderHex(str);
     return str.str();
 }
 
+void Block::renderHex(FormatBuffer &out) const {
+    out.hex(begin.offset, false, WORD_STRLEN).put('-').hex(end.offset, false, WORD_STRLEN);
+}
+
 // check if blocks overlap each other (by at least one byte)
 bool Block::intersects(const Block &other) const {
     if (!isValid() || !other.isValid()) return false;
@@ -286,3 +297,53 @@ std::string Segment::toString() const {
     str << hexVal(address, false);
     return str.str();
 }
+
+// position of the slot holding the linear address, or of the empty slot where it belongs
+Size AddressSet::find(const Offset linear) const {
+    const Size mask = slots_.size() - 1;
+    Size pos = slot(linear);
+    while (slots_[pos] != EMPTY && unpack(slots_[pos]).toLinear() != linear) pos = (pos + 1) & mask;
+    return pos;
+}
+
+void AddressSet::grow() {
+    vector<DWord> old = std::move(slots_);
+    const Size capacity = old.empty() ? 1024 : old.size() * 2;
+    slots_.assign(capacity, EMPTY);
+    shift_ = 32;
+    for (Size c = capacity; c > 1; c >>= 1) shift_--;
+    for (const DWord packed : old) {
+        if (packed != EMPTY) slots_[find(unpack(packed).toLinear())] = packed;
+    }
+}
+
+bool AddressSet::insert(const Address &addr) {
+    assert(pack(addr) != EMPTY);
+    // keep the load factor at most 1/2
+    if ((size_ + 1) * 2 > slots_.size()) grow();
+    const Size pos = find(addr.toLinear());
+    if (slots_[pos] != EMPTY) return false;
+    slots_[pos] = pack(addr);
+    size_++;
+    return true;
+}
+
+void AddressSet::clear() {
+    std::fill(slots_.begin(), slots_.end(), EMPTY);
+    size_ = 0;
+}
+
+bool AddressSet::contains(const Address &addr) const {
+    if (slots_.empty()) return false;
+    return slots_[find(addr.toLinear())] != EMPTY;
+}
+
+vector<Address> AddressSet::addresses() const {
+    vector<Address> ret;
+    ret.reserve(size_);
+    for (const DWord packed : slots_) {
+        if (packed != EMPTY) ret.push_back(unpack(packed));
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
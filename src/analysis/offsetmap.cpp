@@ -97,6 +97,14 @@ void OffsetMap::resetStack() {
     stackMap.clear();
 }
 
+void OffsetMap::reset(const Size maxData) {
+    this->maxData = maxData;
+    codeMap.clear();
+    dataMap.clear();
+    stackMap.clear();
+    segments.clear();
+}
+
 void OffsetMap::addSegment(const Segment &seg) {
     segments.push_back(seg);
 }
@@ -16,6 +16,11 @@
 #include <string>
 #include <cstring>
 #include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 using namespace std;
 
@@ -32,7 +37,7 @@ OUTPUT_CONF(LOG_ANALYSIS)
 // TODO: do not hardcode, place in text file
 // TODO: automatic reverse match generation
 // TODO: replace strings with Instruction-s/Signature-s, support more flexible matching?
-static const map<string, vector<vector<string>>> INSTR_VARIANT = {
+static const map<string, vector<vector<string>>, less<>> INSTR_VARIANT = {
     { "add sp, 0x2", {
             { "pop cx" },
             { "inc sp", "inc sp" },
@@ -83,20 +88,19 @@ static void applyMov(const Instruction &i, CpuState &regs, Executable &exe) {
         const Register segReg = prefixRegId(i.prefix);
         // ignore data located in the stack segment, it's not reliable even if within code extents
         if (segReg == REG_SS || !regs.isKnown(segReg)) return;
-        auto &code = exe.getCode();
         Address srcAddr(regs.getValue(segReg), i.op2.immval.u16);
         if (exe.contains(srcAddr)) {
             Byte byteVal;
             Word wordVal;
             switch(i.op2.size) {
             case OPRSZ_BYTE:
-                byteVal = code.readByte(srcAddr);
+                byteVal = exe.readByte(srcAddr);
                 searchMessage(i.addr, "source address for byte: " + srcAddr.toString() + ", value in memory: " + hexVal(byteVal));
                 regs.setValue(dest, byteVal); 
                 set = true;
                 break;
             case OPRSZ_WORD:
-                wordVal = code.readWord(srcAddr);
+                wordVal = exe.readWord(srcAddr);
                 searchMessage(i.addr, "source address for word: " + srcAddr.toString() + ", value in memory: " + hexVal(wordVal));
                 regs.setValue(dest, wordVal);
                 set = true;
@@ -168,59 +172,112 @@ static void applyPop(const Instruction &i, CpuState &regs, Executable &exe) {
     }
 }
 
-static string compareStatus(const Instruction &i1, const Instruction &i2, const bool align, InstructionMatch match = INS_MATCH_ERROR) {
-    static const int ALIGN = 50;
-    ostringstream status;
+// the context displays consist of verbose output only, no point in walking the instructions if it is not going to be shown
+static bool contextVisible() {
+    return getOutputLevel() <= LOG_VERBOSE && moduleVisible(LOG_ANALYSIS);
+}
+
+// long enough for two rendered instructions with their addresses, the alignment padding and the difference explanation
+static constexpr Size COMPARE_STATUS_STRLEN = 256;
+const Routine Analyzer::UNKNOWN_ROUTINE{"unknown", {}};
+
+static void compareStatus(FormatBuffer &status, const Instruction &i1, const Instruction &i2, const bool align, InstructionMatch match = INS_MATCH_ERROR) {
+    static const Size ALIGN = 50;
 
     if (match == INS_MATCH_ERROR) match = i1.match(i2);
 
     switch (match) {
-        case INS_MATCH_FULL:     status << "MATCH:    "; break;
-        case INS_MATCH_DIFF:     status << "DIFF_MAP: "; break;
-        case INS_MATCH_DIFFOP1:  status << "DIFF_OP1: "; break;
-        case INS_MATCH_DIFFOP2:  status << "DIFF_OP2: "; break;
-        case INS_MATCH_MISMATCH: status << "MISMATCH: "; break;
+        case INS_MATCH_FULL:     status.put("MATCH:    "); break;
+        case INS_MATCH_DIFF:     status.put("DIFF_MAP: "); break;
+        case INS_MATCH_DIFFOP1:  status.put("DIFF_OP1: "); break;
+        case INS_MATCH_DIFFOP2:  status.put("DIFF_OP2: "); break;
+        case INS_MATCH_MISMATCH: status.put("MISMATCH: "); break;
     }
 
-    string i1_str = i1.addr.toString() + ": " + i1.toString(true);
-    status << i1_str;
-
-    if (i1_str.length() < ALIGN) status << string(ALIGN - i1_str.length(), ' ');
+    const Size i1Start = status.size();
+    i1.addr.render(status);
+    status.put(": ");
+    i1.render(status, true);
+    status.fill(i1Start + ALIGN);
     
     switch (match) {
-        case INS_MATCH_FULL:     status << " == "; break;
-        case INS_MATCH_DIFF:     status << " ~~ "; break;
-        case INS_MATCH_DIFFOP1:  status << " ~= "; break;
-        case INS_MATCH_DIFFOP2:  status << " =~ "; break;
-        case INS_MATCH_MISMATCH: status << " != "; break;
+        case INS_MATCH_FULL:     status.put(" == "); break;
+        case INS_MATCH_DIFF:     status.put(" ~~ "); break;
+        case INS_MATCH_DIFFOP1:  status.put(" ~= "); break;
+        case INS_MATCH_DIFFOP2:  status.put(" =~ "); break;
+        case INS_MATCH_MISMATCH: status.put(" != "); break;
     }
 
-    status << i2.addr.toString() + ": " + i2.toString(true);
+    i2.addr.render(status);
+    status.put(": ");
+    i2.render(status, true);
     
     // Add natural language explanations for differences
     if (match == INS_MATCH_DIFFOP1) {
-        status << " // Immediate operand1: ref=" << hexVal(i1.op1.wordValue())
-               << " vs tgt=" << hexVal(i2.op1.wordValue());
+        status.put(" // Immediate operand1: ref=").hex(i1.op1.canonicalValue(), true, 4)
+              .put(" vs tgt=").hex(i2.op1.canonicalValue(), true, 4);
     } else if (match == INS_MATCH_DIFFOP2) {
-        status << " // Immediate operand2: ref=" << hexVal(i1.op2.wordValue())
-               << " vs tgt=" << hexVal(i2.op2.wordValue());
+        status.put(" // Immediate operand2: ref=").hex(i1.op2.canonicalValue(), true, 4)
+              .put(" vs tgt=").hex(i2.op2.canonicalValue(), true, 4);
     } else if (match == INS_MATCH_DIFF) {
-        status << " // Memory offset: ref=" << hexVal(i1.memOffset())
-               << " vs tgt=" << hexVal(i2.memOffset());
+        status.put(" // Memory offset: ref=").signedHex(i1.memOffset(), 0, false)
+              .put(" vs tgt=").signedHex(i2.memOffset(), 0, false);
     } else if (match == INS_MATCH_MISMATCH) {
-        status << " // Opcode: ref=" << hexVal(i1.opcode)
-               << " vs tgt=" << hexVal(i2.opcode);
+        status.put(" // Opcode: ref=").hex(i1.opcode, true, 2)
+              .put(" vs tgt=").hex(i2.opcode, true, 2);
     }
+}
 
-    return status.str();
+// the comparison status is shown for every compared instruction, only render it if it is going to be visible
+static void compareOutput(const LogPriority pri, const Instruction &i1, const Instruction &i2, const Color color = OUT_DEFAULT, 
+    const InstructionMatch match = INS_MATCH_ERROR, const char *suffix = nullptr) 
+{
+    if (pri < getOutputLevel() || !moduleVisible(LOG_ANALYSIS)) return;
+    char buf[COMPARE_STATUS_STRLEN];
+    FormatBuffer status{buf, sizeof(buf)};
+    compareStatus(status, i1, i2, true, match);
+    if (suffix) status.put(suffix);
+    output(status.view(), LOG_ANALYSIS, pri, color);
+}
+
+void Analyzer::reset() {
+    debug("Resetting analyzer state");
+    skipType = SKIP_NONE;
+    refCsip = tgtCsip = Address{};
+    compareBlock = targetBlock = Block{};
+    offMap.reset(0);
+    comparedSize = routineSumSize = reachableSize = unreachableSize = excludedSize = excludedCount = excludedReachableSize = missedSize = ignoredSize = 0;
+    scanQueue.reset(Address{0, 0}, 0, {});
+    tgtQueue.reset(Address{0, 0}, 0, {});
+    routine = &UNKNOWN_ROUTINE;
+    routineNames.clear();
+    excludedNames.clear();
+    missedNames.clear();
+    refSkipCount = tgtSkipCount = 0;
+    refSkipOrigin = tgtSkipOrigin = Address{};
+    vars.clear();
+    dataRefs.clear();
+    callSites.clear();
+    entryStates.clear();
+    xrefs.clear();
+    tgtArena.clear();
+    tgtSpans.clear();
+    runDone = false;
+}
+
+// The state of a finished run is kept for querying its results until the next run begins. Seeding is a part of the run it precedes.
+void Analyzer::beginRun(const bool seeding) {
+    if (runDone) reset();
+    runDone = !seeding;
 }
 
 // for executables whose layout is known in advance (but we still want to determine the routine boundaries), like when we built it ourselves
 // and have the linker map, seed the scan queue for code exploration with all known routine entrypoint locations
 void Analyzer::seedQueue(const CodeMap &map, Executable &exe) {
+    beginRun(true);
     debug("Seeding scan queue from code map");
     CpuState initRegs{exe.entrypoint(), exe.stackAddr()};
-    scanQueue = ScanQueue{exe.loadAddr(), exe.size(), {}};
+    scanQueue.reset(exe.loadAddr(), exe.size(), {});
     // seed segments
     exe.clearSegments();
     debug("Seeding with " + to_string(map.segmentCount()) + " segments");
@@ -232,8 +289,7 @@ void Analyzer::seedQueue(const CodeMap &map, Executable &exe) {
     exe.storeSegment(Segment{"", Segment::SEG_CODE, exe.entrypoint().segment});
     // seed routines
     debug("Seeding with " + to_string(map.routineCount()) + " entrypoints");
-    for (Size ri = 0; ri < map.routineCount(); ++ri) {
-        const Routine r = map.getRoutine(ri);
+    for (const Routine &r : map.getRoutines()) {
         debug("Attempting to seed routine: " + r.toString());
         scanQueue.saveCall(r.entrypoint(), initRegs, false, r.name);
     }
@@ -241,8 +297,7 @@ void Analyzer::seedQueue(const CodeMap &map, Executable &exe) {
     scanQueue.saveCall(exe.entrypoint(), initRegs, true, "start");
     // seed vars
     debug("Seeding with " + to_string(map.variableCount()) + " variables");
-    for (Size vi = 0; vi < map.variableCount(); ++vi) {
-        const Variable v = map.getVariable(vi);
+    for (const Variable &v : map.getVariables()) {
         debug("Seeding variable: " + v.toString());
         vars.insert(v);
     }
@@ -254,31 +309,318 @@ void Analyzer::claimNops(const Instruction &i, const Executable &exe) {
     Address 
         curAddr = i.addr,
         nextAddr{curAddr + static_cast<SByte>(i.length)};
+    // peek ahead without decoding, a nop is a single byte opcode
+    while (nextAddr > curAddr && exe.extents().contains(nextAddr) && *exe.codePointer(nextAddr) == OP_NOP) {
+        scanQueue.setRoutineIdx(nextAddr.toLinear(), 1);
+        curAddr = nextAddr;
+        nextAddr++;
+    }
+}
+
+// destination of a branch which is encoded in the instruction itself, invalid if it depends on register or memory values
+static Address immediateDestination(const Instruction &i) {
+    switch (i.iclass) {
+    case INS_JMP_IF:
+    case INS_LOOP:
+    case INS_LOOPNZ:
+    case INS_LOOPZ:
+        return i.destinationAddress();
+    case INS_JMP:
+        if (i.opcode == OP_JMP_Jb || i.opcode == OP_JMP_Jv) return i.destinationAddress();
+        break;
+    case INS_CALL:
+        if (i.op1.type == OPR_IMM16) return i.destinationAddress();
+        break;
+    case INS_JMP_FAR:
+    case INS_CALL_FAR:
+        if (i.op1.type == OPR_IMM32) return Address{DWORD_SEGMENT(i.op1.immval.u32), DWORD_OFFSET(i.op1.immval.u32)};
+        break;
+    default:
+        break;
+    }
+    return {};
+}
+
+// Decode the code reachable through statically known branches on multiple threads and put it into the instruction cache,
+// so that the exploration which follows finds most instructions already decoded. Only the cache is filled here, the exploration
+// itself stays sequential, which keeps the routine indexes and the claimed areas identical regardless of the thread count.
+// Decoding is a small part of the exploration cost, so this does not make it measurably faster on the executables at hand.
+// Every worker has its own deque of locations to decode, new branch destinations go to the back of its own deque,
+// and an idle worker steals from the front of the others. The first worker to claim an instruction offset decodes it.
+void Analyzer::prescanCode(Executable &exe) const {
+    struct Worker {
+        mutex lock;
+        std::deque<Address> work;
+        vector<Instruction> decoded;
+    };
+    const Size threadCount = options.threads;
+    const Offset codeBase = exe.loadAddr().toLinear();
+    const unique_ptr<atomic<Byte>[]> claimed{new atomic<Byte>[exe.size()]{}};
+    vector<Worker> workers(threadCount);
+    // locations queued and not yet fully decoded, the workers are done when it drops to zero
+    atomic<Size> pending{0};
+    const auto enqueue = [&](Worker &w, const Address &addr) {
+        pending++;
+        lock_guard<mutex> guard{w.lock};
+        w.work.push_back(addr);
+    };
+    const vector<Address> seeds = scanQueue.pendingPoints();
+    for (Size si = 0; si < seeds.size(); ++si) {
+        if (exe.contains(seeds[si])) enqueue(workers[si % threadCount], seeds[si]);
+    }
+
+    const auto takeWork = [&](const Size wi, Address &addr) {
+        for (Size n = 0; n < threadCount; ++n) {
+            Worker &w = workers[(wi + n) % threadCount];
+            lock_guard<mutex> guard{w.lock};
+            if (w.work.empty()) continue;
+            // own work is taken from the back, stolen work from the front
+            if (n == 0) { addr = w.work.back(); w.work.pop_back(); }
+            else { addr = w.work.front(); w.work.pop_front(); }
+            return true;
+        }
+        return false;
+    };
+
+    const auto scan = [&](const Size wi) {
+        Worker &self = workers[wi];
+        Address csip;
+        while (pending != 0) {
+            if (!takeWork(wi, csip)) {
+                this_thread::yield();
+                continue;
+            }
+            // decode linearly until the flow of execution is interrupted or reaches code decoded by someone else
+            try {
+                while (exe.contains(csip)) {
+                    Byte unclaimed = 0;
+                    if (!claimed[csip.toLinear() - codeBase].compare_exchange_strong(unclaimed, 1)) break;
+                    const Instruction i = exe.decodeInstruction(csip);
+                    self.decoded.push_back(i);
+                    if (i.isBranch()) {
+                        const Address dest = immediateDestination(i);
+                        if (dest.isValid() && exe.contains(dest)) enqueue(self, dest);
+                        if (i.isUnconditionalJump()) break;
+                    }
+                    else if (i.isReturn() || i.isInt(0x20)) break;
+                    csip += i.length;
+                }
+            }
+            // only ends this stretch, the exploration which follows reports the problem if it gets here
+            catch (Error &e) {}
+            pending--;
+        }
+    };
+
+    vector<thread> threads;
+    for (Size wi = 1; wi < threadCount; ++wi) threads.emplace_back(scan, wi);
+    scan(0);
+    for (auto &t : threads) t.join();
+    Size decodedCount = 0;
+    for (const Worker &w : workers) {
+        exe.cacheInstructions(w.decoded);
+        decodedCount += w.decoded.size();
+    }
+    verbose("Decoded " + to_string(decodedCount) + " instructions ahead of exploration using " + to_string(threadCount) + " threads");
+}
+
+static constexpr DWord CACHE_MAGIC = 0x43525a4d; // "MZRC"
+static constexpr Word CACHE_VERSION = 5;
+
+// identifies the load module contents, where it was loaded and the initial register values of the exploration
+static QWord explorationKey(const Executable &exe) {
+    const QWord key = hashBytes(exe.codePointer(exe.loadAddr()), exe.size());
+    const Word state[] = { exe.getLoadSegment(), exe.entrypoint().segment, exe.entrypoint().offset, exe.stackAddr().segment, exe.stackAddr().offset };
+    return hashBytes(reinterpret_cast<const Byte*>(state), sizeof(state), key);
+}
+
+// Restore the results of a previous exploration of the same executable. It is usable only if all the seeds it was started 
+// with are among the current ones with the same nearness, any seeds which it did not have are placed in the queue to be explored
+// on top of it. The names of the current seeds replace the restored ones, so renaming a seed does not need a new exploration.
+bool Analyzer::loadCache(Executable &exe, const vector<RoutineEntrypoint> &seeds, const CpuState &initRegs) {
+    const string &path = options.cachePath;
+    if (!checkFile(path).exists) {
+        debug("Exploration cache does not exist: " + path);
+        return false;
+    }
+    ifstream file{path, ios::binary};
     try {
-        while (nextAddr > curAddr && exe.extents().contains(nextAddr) && Instruction{nextAddr, exe.codePointer(nextAddr)}.iclass == INS_NOP) {
-            scanQueue.setRoutineIdx(nextAddr.toLinear(), 1);
-            curAddr = nextAddr;
-            nextAddr++;
+        if (readBinaryValue(file, sizeof(DWord)) != CACHE_MAGIC || readBinaryValue(file, sizeof(Word)) != CACHE_VERSION) {
+            warn("Ignoring exploration cache in unsupported format: " + path);
+            return false;
+        }
+        if (readBinaryValue(file, sizeof(QWord)) != explorationKey(exe)) {
+            verbose("Exploration cache was created for a different executable or load segment, ignoring: " + path);
+            return false;
+        }
+        map<Offset, bool> seedNear;
+        for (const auto &s : seeds) seedNear.emplace(s.addr.toLinear(), s.near);
+        set<Offset> cachedAddrs;
+        const Size seedCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < seedCount; ++i) {
+            const Word segment = readBinaryValue(file, sizeof(Word));
+            const Word offset = readBinaryValue(file, sizeof(Word));
+            const bool near = readBinaryValue(file, sizeof(Byte)) != 0;
+            const Address addr{segment, offset};
+            const auto found = seedNear.find(addr.toLinear());
+            if (found == seedNear.end()) {
+                verbose("Exploration cache was seeded with " + addr.toString() + " which is no longer a seed, ignoring: " + path);
+                return false;
+            }
+            if (found->second != near) {
+                verbose("Exploration cache was seeded with " + addr.toString() + " as a " + (near ? "near" : "far") + " routine, ignoring: " + path);
+                return false;
+            }
+            cachedAddrs.insert(addr.toLinear());
         }
+        // keep the seed of the current queue, the routine at its address is named after it
+        ScanQueue restored = scanQueue;
+        restored.loadState(file);
+        vector<Segment> segments;
+        const Size segCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < segCount; ++i) {
+            string name = readBinaryString(file);
+            const auto type = static_cast<Segment::Type>(readBinaryValue(file, sizeof(Byte)));
+            const Word address = readBinaryValue(file, sizeof(Word));
+            segments.emplace_back(name, type, address);
+        }
+        vector<CallSite> restoredCalls;
+        const Size callCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < callCount; ++i) {
+            const Word siteSeg = readBinaryValue(file, sizeof(Word));
+            const Word siteOff = readBinaryValue(file, sizeof(Word));
+            const Word destSeg = readBinaryValue(file, sizeof(Word));
+            const Word destOff = readBinaryValue(file, sizeof(Word));
+            const bool near = readBinaryValue(file, sizeof(Byte)) != 0;
+            restoredCalls.emplace_back(Address{siteSeg, siteOff}, Address{destSeg, destOff}, near);
+        }
+        vector<Xref> restoredXrefs;
+        const Size xrefCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < xrefCount; ++i) {
+            const Word targetSeg = readBinaryValue(file, sizeof(Word));
+            const Word targetOff = readBinaryValue(file, sizeof(Word));
+            const Word sourceSeg = readBinaryValue(file, sizeof(Word));
+            const Word sourceOff = readBinaryValue(file, sizeof(Word));
+            const auto kind = static_cast<XrefKind>(readBinaryValue(file, sizeof(Byte)));
+            restoredXrefs.emplace_back(Address{targetSeg, targetOff}, Address{sourceSeg, sourceOff}, kind);
+        }
+        vector<EntryState> restoredStates;
+        const Size stateCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < stateCount; ++i) {
+            const Word segment = readBinaryValue(file, sizeof(Word));
+            const Word offset = readBinaryValue(file, sizeof(Word));
+            CpuState regs;
+            regs.load(file);
+            restoredStates.emplace_back(Address{segment, offset}, regs);
+        }
+        vector<Variable> restoredVars;
+        const Size varCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < varCount; ++i) {
+            Variable v;
+            v.name = readBinaryString(file);
+            const Word segment = readBinaryValue(file, sizeof(Word));
+            const Word offset = readBinaryValue(file, sizeof(Word));
+            v.addr = Address{segment, offset};
+            v.external = readBinaryValue(file, sizeof(Byte)) != 0;
+            v.bss = readBinaryValue(file, sizeof(Byte)) != 0;
+            restoredVars.push_back(v);
+        }
+        // all read successfully, replace the current state
+        scanQueue = std::move(restored);
+        for (const auto &s : segments) exe.storeSegment(s);
+        for (const auto &v : restoredVars) {
+            if (v.name.empty()) dataRefs.insert(v.addr);
+            else vars.insert(v);
+        }
+        callSites = std::move(restoredCalls);
+        xrefs = std::move(restoredXrefs);
+        entryStates = std::move(restoredStates);
+        Size newSeeds = 0;
+        for (const auto &s : seeds) {
+            // a new seed may already be the entrypoint of an explored routine, which then only gets its name
+            if (!cachedAddrs.count(s.addr.toLinear()) && scanQueue.saveCall(s.addr, initRegs, s.near, s.name)) newSeeds++;
+            else scanQueue.nameEntrypoint(s.addr, s.name);
+        }
+        info("Restored exploration state from " + path + ": " + to_string(scanQueue.routineCount()) + " routines, " + to_string(newSeeds) + " new seeds to explore");
+        return true;
     }
-    catch (CpuError &e) {
-        // encountered invalid instruction while trying to peek ahead, silently ignore
-        return;
+    catch (Error &e) {
+        warn("Unable to load exploration cache " + path + ": " + e.why());
     }
+    return false;
+}
+
+void Analyzer::saveCache(const Executable &exe, const vector<RoutineEntrypoint> &seeds) const {
+    const string &path = options.cachePath;
+    ofstream file{path, ios::binary};
+    writeBinaryValue(file, CACHE_MAGIC, sizeof(DWord));
+    writeBinaryValue(file, CACHE_VERSION, sizeof(Word));
+    writeBinaryValue(file, explorationKey(exe), sizeof(QWord));
+    writeBinaryValue(file, seeds.size(), sizeof(DWord));
+    for (const auto &s : seeds) {
+        writeBinaryValue(file, s.addr.segment, sizeof(Word));
+        writeBinaryValue(file, s.addr.offset, sizeof(Word));
+        writeBinaryValue(file, s.near, sizeof(Byte));
+    }
+    scanQueue.saveState(file);
+    const auto &segments = exe.getSegments();
+    writeBinaryValue(file, segments.size(), sizeof(DWord));
+    for (const auto &s : segments) {
+        writeBinaryString(file, s.name);
+        writeBinaryValue(file, s.type, sizeof(Byte));
+        writeBinaryValue(file, s.address, sizeof(Word));
+    }
+    writeBinaryValue(file, callSites.size(), sizeof(DWord));
+    for (const auto &cs : callSites) {
+        writeBinaryValue(file, cs.site.segment, sizeof(Word));
+        writeBinaryValue(file, cs.site.offset, sizeof(Word));
+        writeBinaryValue(file, cs.dest.segment, sizeof(Word));
+        writeBinaryValue(file, cs.dest.offset, sizeof(Word));
+        writeBinaryValue(file, cs.near, sizeof(Byte));
+    }
+    writeBinaryValue(file, xrefs.size(), sizeof(DWord));
+    for (const auto &x : xrefs) {
+        writeBinaryValue(file, x.target.segment, sizeof(Word));
+        writeBinaryValue(file, x.target.offset, sizeof(Word));
+        writeBinaryValue(file, x.source.segment, sizeof(Word));
+        writeBinaryValue(file, x.source.offset, sizeof(Word));
+        writeBinaryValue(file, x.kind, sizeof(Byte));
+    }
+    writeBinaryValue(file, entryStates.size(), sizeof(DWord));
+    for (const auto &s : entryStates) {
+        writeBinaryValue(file, s.entrypoint.segment, sizeof(Word));
+        writeBinaryValue(file, s.entrypoint.offset, sizeof(Word));
+        s.regs.save(file);
+    }
+    const auto allVars = variables();
+    writeBinaryValue(file, allVars.size(), sizeof(DWord));
+    for (const auto &v : allVars) {
+        writeBinaryString(file, v.name);
+        writeBinaryValue(file, v.addr.segment, sizeof(Word));
+        writeBinaryValue(file, v.addr.offset, sizeof(Word));
+        writeBinaryValue(file, v.external, sizeof(Byte));
+        writeBinaryValue(file, v.bss, sizeof(Byte));
+    }
+    if (!file) warn("Unable to write exploration cache: " + path);
+    else verbose("Saved exploration state to " + path);
 }
 
 // explore the code without actually executing instructions, discover routine boundaries
 // TODO: identify routines through signatures generated from OMF libraries
 // TODO: trace usage of bp register (sub/add) to determine stack frame size of routines
 // TODO: store references to potential jump tables (e.g. jmp cs:[bx+0xc08]), if unclaimed after initial search, try treating entries as pointers and run second search before coalescing blocks?
-// TODO: this is single-shot, need to wipe object state before done so that same analyzer can be used again
 CodeMap Analyzer::exploreCode(Executable &exe) {
+    beginRun(false);
     CpuState initRegs{exe.entrypoint(), exe.stackAddr()};
     
     debug("initial register values:\n"s + initRegs.toString());
     // initialize queue for BFS search only if it's not been seeded already
-    if (scanQueue.empty()) scanQueue = ScanQueue{exe.loadAddr(), exe.size(), Destination(exe.entrypoint(), 1, true, initRegs)};
+    if (scanQueue.routineCount() == 0) scanQueue.reset(exe.loadAddr(), exe.size(), Destination(exe.entrypoint(), 1, true, initRegs));
     info("Analyzing code within extents: "s + exe.extents());
+    // the entrypoints present before the exploration are the seeds
+    const vector<RoutineEntrypoint> seeds = scanQueue.getEntrypoints();
+    const bool cached = !options.cachePath.empty() && loadCache(exe, seeds, initRegs);
+    if (options.threads > 1 && !scanQueue.empty()) prescanCode(exe);
     Size locations = 0;
  
     // iterate over entries in the search queue
@@ -289,7 +631,9 @@ CodeMap Analyzer::exploreCode(Executable &exe) {
         locations++;
         Address csip = search.address;
         searchMessage(csip, "--- Scanning at new location from routine " + ep.toString() + ", call: "s + to_string(search.isCall) + ", queue = " + to_string(scanQueue.size()));
-        CpuState regs = search.regs;
+        // the registers a routine starts with let an incremental exploration pick it up where the full one did
+        if (search.isCall && csip == ep.addr) entryStates.emplace_back(csip, *search.regs);
+        CpuState regs = *search.regs;
         regs.setValue(REG_CS, csip.segment);
         DUMP_REGS(regs);
         exe.storeSegment({"", Segment::SEG_CODE, csip.segment});
@@ -315,17 +659,19 @@ CodeMap Analyzer::exploreCode(Executable &exe) {
                     searchMessage(csip, "Location marked as entrypoint for routine "s + to_string(atEntrypoint) + " while scanning from " + to_string(search.routineIdx) + ", halting scan");
                     break;
                 }
-                Instruction i(csip, exe.codePointer(csip));
+                const Instruction i = exe.getInstruction(csip);
                 regs.setValue(REG_IP, csip.offset);
                 // mark memory map items corresponding to the current instruction as belonging to the current routine 
                 // (routine id is tracked by the queue, no need to provide)
                 scanQueue.setRoutineIdx(csip.toLinear(), i.length);
                 // if the instruction references memory, save the location as a potential data item
-                processDataReference(exe, i, regs);
+                processDataReference(exe, csip, i, regs);
                 // interpret the instruction
                 if (i.isBranch()) {
                     const Branch branch = getBranch(exe, i, regs);
                     debug("Encountered branch: " + branch.toString());
+                    if (branch.isCall) callSites.emplace_back(csip, branch.destination, branch.isNear);
+                    if (branch.destination.isValid()) xrefs.emplace_back(branch.destination, csip, branch.isCall ? XREF_CALL : XREF_JUMP);
                     // if the destination of the branch can be established, place it in the search queue
                     scanQueue.saveBranch(branch, regs, exe.extents());
                     // for a call or conditional branch, we can continue scanning (fall-through), but do it under a new search queue location 
@@ -406,16 +752,175 @@ CodeMap Analyzer::exploreCode(Executable &exe) {
         }
     } // next search location from search queue
     info("Done analyzing code, examined " + to_string(locations) + " locations");
+    if (!options.cachePath.empty() && (!cached || locations != 0)) saveCache(exe, seeds);
+    verbose(exe.instructionCacheInfo());
 #ifdef DEBUG
     scanQueue.dumpVisited("routines.visited");
 #endif
 
     // create routine map from contents of search queue
-    auto ret = CodeMap{scanQueue, exe.getSegments(), vars, exe.getLoadSegment(), exe.size()};
+    auto ret = CodeMap{scanQueue, exe.getSegments(), variables(), exe.getLoadSegment(), exe.size()};
     // TODO: stats like for compare
     return ret;
 }
 
+// seeded variables merged with the data references found during exploration, the seeds take precedence at the same address
+set<Variable> Analyzer::variables() const {
+    set<Variable> ret = vars;
+    for (const Address &a : dataRefs.addresses()) ret.insert({"", a});
+    return ret;
+}
+
+void Analyzer::seedCalls(const CallGraph &graph) {
+    beginRun(true);
+    const auto sites = graph.callSites();
+    callSites.insert(callSites.end(), sites.begin(), sites.end());
+    entryStates.insert(entryStates.end(), graph.entryStates().begin(), graph.entryStates().end());
+}
+
+void Analyzer::seedXrefs(const XrefIndex &index) {
+    beginRun(true);
+    const auto refs = index.refs();
+    xrefs.insert(xrefs.end(), refs.begin(), refs.end());
+}
+
+// ranges of the load module which differ between two executables, anything past the end of the shorter one counts as changed
+static vector<Block> changedBlocks(const Executable &prev, const Executable &cur) {
+    vector<Block> ret;
+    const Byte 
+        *prevData = prev.codePointer(prev.loadAddr()),
+        *curData = cur.codePointer(cur.loadAddr());
+    const Size commonSize = min(prev.size(), cur.size());
+    const Offset base = cur.loadAddr().toLinear();
+    Offset off = 0;
+    while (off < commonSize) {
+        // skip identical bytes quickly, then find where the difference ends
+        const Size same = std::mismatch(prevData + off, prevData + commonSize, curData + off).first - prevData - off;
+        off += same;
+        if (off >= commonSize) break;
+        const Offset begin = off;
+        while (off < commonSize && prevData[off] != curData[off]) off++;
+        ret.emplace_back(Address{base + begin}, Address{base + off - 1});
+    }
+    if (prev.size() != cur.size()) ret.emplace_back(Address{base + commonSize}, Address{base + max(prev.size(), cur.size()) - 1});
+    return ret;
+}
+
+// Explore an executable which is a modified version of one which was mapped previously. Routines of the previous map
+// which do not overlap any changed area are taken over as they are, only the others are explored again together with
+// whatever new code they lead to, so the amount of work depends on the size of the changes rather than of the executable.
+// With the call graph of the previous exploration seeded, routines only called from code explored again are explored again 
+// as well, and the routines explored again start with the registers they were entered with in the previous exploration.
+CodeMap Analyzer::exploreCode(Executable &exe, const CodeMap &prevMap, const Executable &prevExe) {
+    beginRun(true);
+    if (prevExe.loadAddr() != exe.loadAddr()) 
+        throw ArgError("Previous executable loaded at " + prevExe.loadAddr().toString() + " instead of " + exe.loadAddr().toString());
+    const vector<Block> changed = changedBlocks(prevExe, exe);
+    Size changedSize = 0;
+    for (const Block &b : changed) changedSize += b.size();
+    info("Found " + to_string(changed.size()) + " changed areas of total size " + sizeStr(changedSize) + " compared to " + prevExe.path());
+    const CpuState initRegs{exe.entrypoint(), exe.stackAddr()};
+    scanQueue.reset(exe.loadAddr(), exe.size(), {});
+    exe.clearSegments();
+    for (const Segment &seg : prevMap.getSegments()) exe.storeSegment(seg);
+    // the changed areas are disjoint and ordered by address
+    const auto isChanged = [&](const Block &block) {
+        const auto it = std::lower_bound(changed.begin(), changed.end(), block.begin, [](const Block &c, const Address &a) { return c.end < a; });
+        return it != changed.end() && it->intersects(block);
+    };
+    const auto routines = prevMap.getRoutines();
+    vector<bool> invalid(routines.size(), false);
+    for (Size ri = 0; ri < routines.size(); ++ri) {
+        const Routine &r = routines[ri];
+        bool hit = isChanged(r.extents) || !exe.contains(r.extents.end);
+        for (const Block &b : r.reachable) hit = hit || isChanged(b);
+        for (const Block &b : r.unreachable) hit = hit || isChanged(b);
+        if (hit) debug("Routine " + r.name + " overlaps changed code, exploring again");
+        invalid[ri] = hit;
+    }
+    // A routine whose calls all come from routines explored again is only reached if those still call it, so it is left for them 
+    // to find again, with the registers at the call. Whatever it alone calls is then in the same situation.
+    const CallGraph prevGraph{prevMap, callSites, entryStates};
+    vector<Size> nodeRoutine(prevGraph.nodeCount(), 0);
+    for (Size ri = 0; ri < routines.size(); ++ri) nodeRoutine[prevGraph.findNode(routines[ri].entrypoint())] = ri;
+    const auto calledFromInvalid = [&](const Size node) {
+        const auto callers = prevGraph.callers(node);
+        return !callers.empty() && std::all_of(callers.begin(), callers.end(), [&](const CallGraph::Edge &e) { return invalid[nodeRoutine[e.node]]; });
+    };
+    vector<bool> fromCalls(routines.size(), false);
+    vector<Size> pending;
+    for (Size ri = 0; ri < routines.size(); ++ri) if (invalid[ri]) pending.push_back(ri);
+    while (!pending.empty()) {
+        const Size ri = pending.back();
+        pending.pop_back();
+        for (const CallGraph::Edge &e : prevGraph.callees(prevGraph.findNode(routines[ri].entrypoint()))) {
+            const Size ci = nodeRoutine[e.node];
+            if (fromCalls[ci] || !calledFromInvalid(e.node)) continue;
+            fromCalls[ci] = true;
+            if (invalid[ci]) continue;
+            debug("Routine " + routines[ci].name + " only called from code explored again, exploring again if still called");
+            invalid[ci] = true;
+            pending.push_back(ci);
+        }
+    }
+    Size keptCount = 0;
+    for (Size ri = 0; ri < routines.size(); ++ri) {
+        if (invalid[ri]) continue;
+        scanQueue.addRoutine(routines[ri]);
+        keptCount++;
+    }
+    for (Size ri = 0; ri < routines.size(); ++ri) {
+        if (!invalid[ri] || fromCalls[ri]) continue;
+        const Routine &r = routines[ri];
+        const CpuState *regs = prevGraph.entryState(prevGraph.findNode(r.entrypoint()));
+        scanQueue.saveCall(r.entrypoint(), regs ? *regs : initRegs, r.near, r.name);
+    }
+    // the entrypoint could have moved
+    scanQueue.saveCall(exe.entrypoint(), initRegs, true, "start");
+    // calls and references from code explored again are found again if still present
+    vector<Block> explored;
+    for (Size ri = 0; ri < routines.size(); ++ri) {
+        if (!invalid[ri]) continue;
+        explored.insert(explored.end(), routines[ri].reachable.begin(), routines[ri].reachable.end());
+        explored.insert(explored.end(), routines[ri].unreachable.begin(), routines[ri].unreachable.end());
+    }
+    std::sort(explored.begin(), explored.end(), [](const Block &a, const Block &b) { return a.begin < b.begin; });
+    const auto isExplored = [&](const Address &addr) {
+        auto it = std::upper_bound(explored.begin(), explored.end(), addr, [](const Address &a, const Block &b) { return a < b.begin; });
+        if (it != explored.begin() && std::prev(it)->contains(addr)) return true;
+        return isChanged(Block{addr});
+    };
+    std::erase_if(callSites, [&](const CallSite &cs) { return isExplored(cs.site); });
+    // with the references of the previous exploration seeded, variables referenced only from code explored again are found 
+    // again if still referenced, the ones without any data references were not found by exploration and are kept
+    const auto dataTargets = [&] {
+        set<Address> ret;
+        for (const Xref &x : xrefs) if (x.kind == XREF_READ || x.kind == XREF_WRITE) ret.insert(x.target);
+        return ret;
+    };
+    const set<Address> prevTargets = dataTargets();
+    std::erase_if(xrefs, [&](const Xref &x) { return isExplored(x.source); });
+    const set<Address> keptTargets = dataTargets();
+    for (Size vi = 0; vi < prevMap.variableCount(); ++vi) {
+        const Variable v = prevMap.getVariable(vi);
+        if (isChanged(Block{v.addr}) || (prevTargets.count(v.addr) && !keptTargets.count(v.addr))) continue;
+        vars.insert(v);
+    }
+    info("Kept " + to_string(keptCount) + " routines of the previous map, exploring " + to_string(scanQueue.size()) + " locations");
+    CodeMap map = exploreCode(exe);
+    // routines found again keep their names, the automatic names of new ones must not collide with the names taken over
+    set<string> prevNames;
+    for (const Routine &r : routines) prevNames.insert(r.name);
+    Size autoIdx = map.routineCount();
+    for (Size ri = 0; ri < map.routineCount(); ++ri) {
+        Routine &r = map.getMutableRoutine(ri);
+        const Routine *prev = prevMap.findEntrypoint(r.entrypoint());
+        if (prev != nullptr) r.name = prev->name;
+        else while (prevNames.count(r.name)) r.name = "routine_" + to_string(++autoIdx);
+    }
+    return map;
+}
+
 void Analyzer::checkMissedRoutines(const CodeMap &refMap) {
     // update set of missed routines
     calculateStats(refMap);
@@ -427,10 +932,10 @@ void Analyzer::checkMissedRoutines(const CodeMap &refMap) {
     verbose("Adding " + to_string(missedCount) + " missed routines to queue");
     // go over missed routines, manually insert entrypoints into comparison location queue
     for (const auto &rn : missedNames) {
-        const Routine mr = refMap.getRoutine(rn);
-        if (!mr.isValid()) throw LogicError("Unable to find missed routine " + rn + " in routine map");
-        debug("Inserting routine " + mr.name + " into queue, entrypoint: " + mr.entrypoint().toString());
-        scanQueue.saveCall(mr.entrypoint(), {}, mr.near);
+        const Routine *mr = refMap.findRoutine(rn);
+        if (!mr) throw LogicError("Unable to find missed routine " + rn + " in routine map");
+        debug("Inserting routine " + mr->name + " into queue, entrypoint: " + mr->entrypoint().toString());
+        scanQueue.saveCall(mr->entrypoint(), {}, mr->near);
     }
 }
 
@@ -453,7 +958,7 @@ Address Analyzer::findTargetLocation(const Executable &ref, const Executable &tg
     debug("Trying to find equivalent target location of reference address " + refCsip.toString() + " across " + to_string(unvisited.size()) + " unvisited target blocks");
     while (true) {
         // get next instruction, extract its pattern
-        Instruction curInstr{seqEnd, ref.codePointer(seqEnd)};
+        const Instruction curInstr = ref.getInstruction(seqEnd);
         if (!compareBlock.contains(seqEnd + static_cast<Offset>(curInstr.length - 1))) {
             error("Instruction at " + seqEnd.toString() + " exceeds bounds of current reference routine block: " + compareBlock.toString());
             break;
@@ -499,18 +1004,19 @@ Address Analyzer::findTargetLocation(const Executable &ref, const Executable &tg
 
 // TODO: implement register value tracing like in exploreCode
 bool Analyzer::compareCode(const Executable &ref, Executable &tgt, const CodeMap &refMap) {
+    beginRun(false);
     verbose("Comparing code between reference (entrypoint "s + ref.entrypoint().toString() + ") and target (entrypoint " + tgt.entrypoint().toString() + ") executables");
     debug("Routine map of reference binary has " + to_string(refMap.routineCount()) + " entries");
     // find name of reference entrypoint routine for seeding queues
-    const Routine epr = refMap.getRoutine(ref.entrypoint());
+    const Routine *epr = refMap.findRoutine(ref.entrypoint());
     string eprName;
-    if (epr.isValid()) {
-        eprName = epr.name;
+    if (epr) {
+        eprName = epr->name;
         debug("Found entrypoint routine: " + eprName);
     }
-    offMap = OffsetMap{refMap.segmentCount(Segment::SEG_DATA)};
-    scanQueue = ScanQueue{ref.loadAddr(), ref.size(), Destination(ref.entrypoint(), VISITED_ID, true, {}), eprName};
-    tgtQueue = ScanQueue{tgt.loadAddr(), tgt.size(), Destination(tgt.entrypoint(), VISITED_ID, true, {}), eprName};
+    offMap.reset(refMap.segmentCount(Segment::SEG_DATA));
+    scanQueue.reset(ref.loadAddr(), ref.size(), Destination(ref.entrypoint(), VISITED_ID, true, CpuState{}), eprName);
+    tgtQueue.reset(tgt.loadAddr(), tgt.size(), Destination(tgt.entrypoint(), VISITED_ID, true, CpuState{}), eprName);
     // map of equivalent addresses in the compared binaries, seed with the two entrypoints
     offMap.codeMatch(ref.entrypoint(), {tgt.entrypoint(), ref.entrypoint(), "Entrypoint"});
     routineNames.clear();
@@ -535,28 +1041,29 @@ bool Analyzer::compareCode(const Executable &ref, Executable &tgt, const CodeMap
             debug("Location already compared, skipping");
             continue;
         }
-        routine = {"unknown", {}};
+        routine = &UNKNOWN_ROUTINE;
         tgtCsip = offMap.getCode(refCsip);
         Size routineCount = 0;
         if (!refMap.empty()) { // comparing with a map
             // determine the reference executable routine that we are currently in
-            routine = refMap.getRoutine(refCsip);
+            const Routine *found = refMap.findRoutine(refCsip);
             // make sure we are inside a reachable block of a known routine from reference binary
-            if (!routine.isValid()) {
+            if (!found) {
                 error("Could not find address "s + refCsip.toString() + " in routine map");
                 success = false;
                 break;
             }
-            routineNames.insert(routine.name);
-            compareBlock = routine.blockContaining(compare.address);
+            routine = found;
+            routineNames.insert(routine->name);
+            compareBlock = routine->blockContaining(compare.address);
             if (!compareBlock.isValid()) {
                 error("Comparison address "s + compare.address.toString() + " does not belong to any routine");
                 success = false;
                 break;
             }
-            if (routine.ignore || (routine.assembly && !options.checkAsm)) {
-                verbose("--- Skipping excluded routine " + routine.dump(false) + " @"s + refCsip.toString() + ", block " + compareBlock.toString(true) +  ", target @" + tgtCsip.toString());
-                excludedNames.insert(routine.name);
+            if (routine->ignore || (routine->assembly && !options.checkAsm)) {
+                verbose("--- Skipping excluded routine " + routine->dump(false) + " @"s + refCsip.toString() + ", block " + compareBlock.toString(true) +  ", target @" + tgtCsip.toString());
+                excludedNames.insert(routine->name);
                 continue;
             }
             // get corresponding address for comparison in target binary
@@ -569,12 +1076,12 @@ bool Analyzer::compareCode(const Executable &ref, Executable &tgt, const CodeMap
                     break;
                 }
                 // add routine entrypoint to target queue, otherwise it will not get marked as visited when comparing
-                if (refCsip == routine.entrypoint()) {
-                    tgtQueue.saveCall(tgtCsip, {}, routine.near, routine.name);
+                if (refCsip == routine->entrypoint()) {
+                    tgtQueue.saveCall(tgtCsip, {}, routine->near, routine->name);
                 }
             }
             tgt.storeSegment({"", Segment::SEG_CODE, tgtCsip.segment});
-            verbose("--- Now @"s + refCsip.toString() + ", routine " + routine.dump(false) + ", block " + compareBlock.toString(true) +  ", target @" + tgtCsip.toString());
+            verbose("--- Now @"s + refCsip.toString() + ", routine " + routine->dump(false) + ", block " + compareBlock.toString(true) +  ", target @" + tgtCsip.toString());
         }
         // TODO: consider dropping this "feature"
         else { // comparing without a map
@@ -620,6 +1127,8 @@ bool Analyzer::compareCode(const Executable &ref, Executable &tgt, const CodeMap
         
         verbose(output_color(OUT_YELLOW) + oss.str() + output_color(OUT_DEFAULT));
     }
+    verbose(ref.instructionCacheInfo());
+    verbose(tgt.instructionCacheInfo());
     return success;
 }
 
@@ -687,17 +1196,21 @@ bool Analyzer::compareData(const Executable &ref, const Executable &tgt, const C
         Address refMismatch = refAddr + i, tgtMismatch = tgtAddr + i;
         verbose("Mismatch at location " + output_color(OUT_RED) + refMismatch.toString() + " / " + tgtMismatch.toString() + output_color(OUT_DEFAULT) +  ", " + ratioStr(i, compareSize) + " into the segment");
         // find the variables around the mismatch location if possible
-        Variable before, after;
-        for (Size vi = 0; vi < refMap.variableCount(); ++vi) {
-            Variable v = refMap.getVariable(vi);
-            v.addr.rebase(refLoadSeg);
+        const Variable *beforeVar = nullptr, *afterVar = nullptr;
+        for (const Variable &v : refMap.getVariables()) {
+            Address addr = v.addr;
+            addr.rebase(refLoadSeg);
             //debug("Var " + v.toString() + " vs mismatch " + refMismatch.toString());
-            if (v.addr.segment != refMismatch.segment) continue;
-            if (!before.addr.isValid()) before = v;
-            else if (v.addr < refMismatch) before = v;
-            else if (v.addr == refMismatch) { before = after = v; break; }
-            else { after = v; break; }
+            if (addr.segment != refMismatch.segment) continue;
+            if (!beforeVar) beforeVar = &v;
+            else if (addr < refMismatch) beforeVar = &v;
+            else if (addr == refMismatch) { beforeVar = afterVar = &v; break; }
+            else { afterVar = &v; break; }
         }
+        // only the variables found are copied for display
+        Variable before, after;
+        if (beforeVar) { before = *beforeVar; before.addr.rebase(refLoadSeg); }
+        if (afterVar) { after = *afterVar; after.addr.rebase(refLoadSeg); }
         // show variable info if available
         if (before.addr.isValid() && after.addr.isValid()) {
             if (before.addr == after.addr) verbose("Mismatch on variable " + output_color(OUT_BLUE) + before.toString() + output_color(OUT_DEFAULT));
@@ -760,7 +1273,7 @@ bool Analyzer::compareInstructions(const Executable &ref, const Executable &tgt,
             refSkipCount = tgtSkipCount = 0;
             refSkipOrigin = tgtSkipOrigin = Address();
         }
-        verbose(compareStatus(refInstr, tgtInstr, true));
+        compareOutput(LOG_VERBOSE, refInstr, tgtInstr);
         break;
     case ComparisonResult::CMP_MISMATCH:
         // attempt to skip a mismatch, if permitted by the options
@@ -769,17 +1282,20 @@ bool Analyzer::compareInstructions(const Executable &ref, const Executable &tgt,
             if (refSkipCount || tgtSkipCount) {
                 skipContext(ref, tgt);
             }
-            verbose(output_color(OUT_RED) + compareStatus(refInstr, tgtInstr, true) + output_color(OUT_DEFAULT));
-            error("Instruction mismatch in routine " + routine.name + " at " + compareStatus(refInstr, tgtInstr, false));
+            compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_RED);
+            char buf[COMPARE_STATUS_STRLEN];
+            FormatBuffer status{buf, sizeof(buf)};
+            compareStatus(status, refInstr, tgtInstr, false);
+            error("Instruction mismatch in routine " + routine->name + " at " + status.str());
             diffContext(ref, tgt);
             return false;
         }
         break;
     case ComparisonResult::CMP_DIFFVAL:
-        verbose(output_color(OUT_YELLOW) + compareStatus(refInstr, tgtInstr, true) + output_color(OUT_DEFAULT));
+        compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_YELLOW);
         break;
     case ComparisonResult::CMP_DIFFTGT:
-        verbose(output_color(OUT_BRIGHTRED) + compareStatus(refInstr, tgtInstr, true) + output_color(OUT_DEFAULT));
+        compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_BRIGHTRED);
         break;
     }
     return true;
@@ -789,7 +1305,7 @@ void Analyzer::advanceComparison(const Instruction &refInstr, Instruction tgtIns
     switch (matchType) {
     case ComparisonResult::CMP_MISMATCH:
         // if the instructions did not match and we still got here, that means we are in difference skipping mode,
-        debug(compareStatus(refInstr, tgtInstr, false, INS_MATCH_MISMATCH));
+        compareOutput(LOG_DEBUG, refInstr, tgtInstr, OUT_DEFAULT, INS_MATCH_MISMATCH);
         switch (skipType) {
         case SKIP_REF:
             comparedSize += refInstr.length;
@@ -831,7 +1347,7 @@ bool Analyzer::checkComparisonStop() {
         verbose("Reached end of routine block @ "s + compareBlock.end.toString());
         // if the current routine still contains reachable blocks after the current location, add the start of the next one to the back of the queue,
         // so it gets picked up immediately on the next iteration of the outer loop
-        const Block rb = routine.nextReachable(refCsip);
+        const Block rb = routine->nextReachable(refCsip);
         if (rb.isValid()) {
             verbose("Routine still contains reachable blocks, next @ " + rb.toString());
             scanQueue.saveJump(rb.begin, {});
@@ -846,7 +1362,7 @@ bool Analyzer::checkComparisonStop() {
             }
         }
         else {
-            verbose("Completed comparison of routine " + routine.name + ", no more reachable blocks");
+            verbose("Completed comparison of routine " + routine->name + ", no more reachable blocks");
         }
         return true;
     }
@@ -862,9 +1378,9 @@ bool Analyzer::checkComparisonStop() {
 // compare instructions between two executables over a contiguous block
 bool Analyzer::comparisonLoop(const Executable &ref, Executable &tgt, const CodeMap &refMap) {
     refSkipCount = tgtSkipCount = 0;
-    const RoutineEntrypoint tgtEp = tgtQueue.getEntrypoint(routine.name);
+    const RoutineEntrypoint tgtEp = tgtQueue.getEntrypoint(routine->name);
     if (!tgtEp.addr.isValid()) {
-        warn("Unable to find target entrypoint for routine " + routine.name);
+        warn("Unable to find target entrypoint for routine " + routine->name);
         tgtQueue.dumpEntrypoints();
     }
     while (true) {
@@ -880,8 +1396,8 @@ bool Analyzer::comparisonLoop(const Executable &ref, Executable &tgt, const Code
 
         // decode instructions
         Instruction 
-            refInstr{refCsip, ref.codePointer(refCsip)}, 
-            tgtInstr{tgtCsip, tgt.codePointer(tgtCsip)};
+            refInstr = ref.getInstruction(refCsip), 
+            tgtInstr = tgt.getInstruction(tgtCsip);
         
         // mark this instruction as visited
         scanQueue.setRoutineIdx(refCsip.toLinear(), refInstr.length, VISITED_ID);
@@ -908,10 +1424,10 @@ bool Analyzer::comparisonLoop(const Executable &ref, Executable &tgt, const Code
                 // if the branch destination was accepted, save the address mapping of the branch destination between the reference and target
                 if (!offMap.codeMatch(refBranch.destination, newMapping)) return false;
             }
-            const Routine refRoutine = refMap.getRoutine(refBranch.destination);
-            if (refRoutine.isValid()) {
-                debug("Registering target call for routine " + refRoutine.name);
-                tgtQueue.saveCall(tgtBranch.destination, {}, tgtInstr.isNearBranch(), refRoutine.name);
+            const Routine *refRoutine = refMap.findRoutine(refBranch.destination);
+            if (refRoutine) {
+                debug("Registering target call for routine " + refRoutine->name);
+                tgtQueue.saveCall(tgtBranch.destination, {}, tgtInstr.isNearBranch(), refRoutine->name);
             }
         }
         // instruction is a jump, save the relationship between the reference and the target addresses into the offset map
@@ -1020,7 +1536,7 @@ Branch Analyzer::getBranch(const Executable &exe, const Instruction &i, const Cp
             // need to read call destination offset from memory
             Address memAddr{regs.getValue(REG_DS), i.op1.immval.u16};
             if (exe.contains(memAddr)) {
-                branch.destination = Address{i.addr.segment, exe.getCode().readWord(memAddr)};
+                branch.destination = Address{i.addr.segment, exe.readWord(memAddr)};
                 searchMessage(addr, "encountered near call through mem pointer to "s + branch.destination.toString());
             }
             else debug("mem pointer of call destination outside code extents: " + memAddr.toString());
@@ -1050,42 +1566,48 @@ Branch Analyzer::getBranch(const Executable &exe, const Instruction &i, const Cp
 }
 
 
-ComparisonResult Analyzer::variantMatch(const Executable &tgt, const Instruction &refInstr, Instruction tgtInstr) {
-    bool match = false;
+ComparisonResult Analyzer::variantMatch(const Executable &tgt, const Instruction &refInstr, const Instruction &tgtInstr) {
     // check for a variant match if allowed by options
-    if (options.variant && INSTR_VARIANT.count(refInstr.toString())) {
-        // get vector of allowed variants (themselves vectors of strings)
-        const auto &variants = INSTR_VARIANT.at(refInstr.toString());
-        debug("Found "s + to_string(variants.size()) + " variants for instruction '" + refInstr.toString() + "'");
-        // compose string for showing the variant comparison instructions
-        string statusStr = compareStatus(refInstr, tgtInstr, true, INS_MATCH_DIFF);
-        string variantStr;
-        // iterate over the possible variants of this reference instruction
-        for (auto &v : variants) {
-            variantStr.clear();
-            match = true;
-            // temporary code pointer for the target binary while we scan its instructions ahead
-            Address tmpCsip = tgtCsip;
-            int idx = 0;
-            // iterate over instructions inside this variant
-            for (auto &istr: v) {
-                debug(tmpCsip.toString() + ": " + tgtInstr.toString() + " == " + istr + " ? (" + to_string(idx+1) + "/" + to_string(v.size()) + ")");
-                // stringwise compare the next instruction in the variant to the current instruction
-                if (tgtInstr.toString() != istr) { match = false; break; }
-                // if this is not the last instruction in the variant, read the next instruction from the target binary
-                tmpCsip += tgtInstr.length;
-                if (++idx < v.size()) {
-                    tgtInstr = Instruction{tmpCsip, tgt.codePointer(tmpCsip)};
-                    variantStr += "\n" + compareStatus(Instruction(), tgtInstr, true);
+    if (!options.variant) return ComparisonResult::CMP_MISMATCH;
+    char refBuf[INSTRUCTION_STRLEN], tgtBuf[INSTRUCTION_STRLEN];
+    FormatBuffer refStr{refBuf, sizeof(refBuf)}, tgtStr{tgtBuf, sizeof(tgtBuf)};
+    refInstr.render(refStr);
+    const auto it = INSTR_VARIANT.find(refStr.view());
+    if (it == INSTR_VARIANT.end()) return ComparisonResult::CMP_MISMATCH;
+    // get vector of allowed variants (themselves vectors of strings)
+    const auto &variants = it->second;
+    debug("Found "s + to_string(variants.size()) + " variants for instruction '" + refStr.str() + "'");
+    // iterate over the possible variants of this reference instruction
+    for (auto &v : variants) {
+        bool match = true;
+        // temporary code pointer for the target binary while we scan its instructions ahead
+        Address tmpCsip = tgtCsip;
+        Instruction varInstr = tgtInstr;
+        // iterate over instructions inside this variant
+        for (Size idx = 0; idx < v.size(); ++idx) {
+            tgtStr.clear();
+            varInstr.render(tgtStr);
+            debug(tmpCsip.toString() + ": " + tgtStr.str() + " == " + v[idx] + " ? (" + to_string(idx+1) + "/" + to_string(v.size()) + ")");
+            // stringwise compare the next instruction in the variant to the current instruction
+            if (tgtStr.view() != v[idx]) { match = false; break; }
+            // if this is not the last instruction in the variant, read the next instruction from the target binary
+            tmpCsip += varInstr.length;
+            if (idx + 1 < v.size()) varInstr = tgt.getInstruction(tmpCsip);
+        }
+        if (match) {
+            debug("Got variant match, advancing target binary to " + tmpCsip.toString());
+            // show the variant comparison, the additional target instructions consumed by the variant follow the original pair
+            compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_YELLOW, INS_MATCH_DIFF);
+            if (contextVisible()) {
+                for (Address extraCsip = tgtCsip + static_cast<Offset>(tgtInstr.length); extraCsip < tmpCsip;) {
+                    const Instruction extraInstr = tgt.getInstruction(extraCsip);
+                    compareOutput(LOG_VERBOSE, Instruction(), extraInstr, OUT_YELLOW);
+                    extraCsip += extraInstr.length;
                 }
             }
-            if (match) {
-                debug("Got variant match, advancing target binary to " + tmpCsip.toString());
-                verbose(output_color(OUT_YELLOW) + statusStr + variantStr + output_color(OUT_DEFAULT));
-                // in the case of a match, need to update the actual instruction pointer in the target binary to account for the instructions we skipped
-                tgtCsip = tmpCsip;
-                return ComparisonResult::CMP_VARIANT;
-            }
+            // in the case of a match, need to update the actual instruction pointer in the target binary to account for the instructions we skipped
+            tgtCsip = tmpCsip;
+            return ComparisonResult::CMP_VARIANT;
         }
     }
 
@@ -1104,8 +1626,8 @@ ComparisonResult Analyzer::instructionsMatch(const Executable &ref, const Execut
     if (insResult == INS_MATCH_MISMATCH) {
         // special case of jmp vs jmp short - allow only if variants enabled and in assembly routines, which are not well behaved
         if (refInstr.opcode != tgtInstr.opcode && refInstr.isUnconditionalJump() && tgtInstr.isUnconditionalJump()) {
-            if (options.variant || routine.assembly) {
-                verbose(output_color(OUT_BRIGHTRED) + compareStatus(refInstr, tgtInstr, true, INS_MATCH_DIFF) + output_color(OUT_DEFAULT));
+            if (options.variant || routine->assembly) {
+                compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_BRIGHTRED, INS_MATCH_DIFF);
                 tgtCsip += tgtInstr.length;
                 return ComparisonResult::CMP_VARIANT;
             }
@@ -1203,18 +1725,24 @@ ComparisonResult Analyzer::instructionsMatch(const Executable &ref, const Execut
 }
 
 void Analyzer::diffContext(const Executable &ref, const Executable &tgt) const {
+    if (!contextVisible()) return;
     const int CONTEXT_COUNT = options.ctxCount;
     Address a1 = refCsip; 
     Address a2 = tgtCsip;
-    verbose("--- Context information for up to " + to_string(CONTEXT_COUNT) + " additional instructions of routine " + output_color(OUT_RED) + routine.name + output_color(OUT_DEFAULT) 
+    verbose("--- Context information for up to " + to_string(CONTEXT_COUNT) + " additional instructions of routine " + output_color(OUT_RED) + routine->name + output_color(OUT_DEFAULT) 
         + " after mismatch location:");
+    // the mismatched instructions were already shown, just step over them
+    const Size l1 = instructionLength(ref.codePointer(a1)), l2 = instructionLength(tgt.codePointer(a2));
+    if (l1 == 0 || l2 == 0) return;
+    a1 += l1;
+    a2 += l2;
     Instruction i1, i2;
-    for (int i = 0; i <= CONTEXT_COUNT; ++i) {
+    for (int i = 0; i < CONTEXT_COUNT; ++i) {
         // make sure we are within code extents in both executables
         if (!ref.contains(a1) || !tgt.contains(a2)) break;
-        i1 = Instruction{a1, ref.codePointer(a1)},
-        i2 = Instruction{a2, tgt.codePointer(a2)};
-        if (i != 0) verbose(compareStatus(i1, i2, true));
+        i1 = ref.getInstruction(a1);
+        i2 = tgt.getInstruction(a2);
+        compareOutput(LOG_VERBOSE, i1, i2);
         a1 += i1.length;
         a2 += i2.length;
     }
@@ -1223,6 +1751,7 @@ void Analyzer::diffContext(const Executable &ref, const Executable &tgt) const {
 // display skipped instructions after a definite match or mismatch found, impossible to display as instructions are scanned because we don't know
 // how many will be skipped in advance
 void Analyzer::skipContext(const Executable &ref, const Executable &tgt) const {
+    if (!contextVisible()) return;
     Address 
         refAddr = refSkipOrigin,
         tgtAddr = tgtSkipOrigin; 
@@ -1232,16 +1761,16 @@ void Analyzer::skipContext(const Executable &ref, const Executable &tgt) const {
     while (refSkipped > 0 || tgtSkipped > 0) {
         Instruction refInstr, tgtInstr;
         if (refSkipped > 0) {
-            refInstr = {refAddr, ref.codePointer(refAddr)};
+            refInstr = ref.getInstruction(refAddr);
             refSkipped--;
             refAddr += refInstr.length;
         }
         if (tgtSkipped > 0) {
-            tgtInstr = {tgtAddr, tgt.codePointer(tgtAddr)};
+            tgtInstr = tgt.getInstruction(tgtAddr);
             tgtSkipped--;
             tgtAddr += tgtInstr.length;
         }
-        verbose(output_color(OUT_YELLOW) + compareStatus(refInstr, tgtInstr, true, INS_MATCH_DIFF) + " [skip]" + output_color(OUT_DEFAULT));
+        compareOutput(LOG_VERBOSE, refInstr, tgtInstr, OUT_YELLOW, INS_MATCH_DIFF, " [skip]");
     }
 }
 
@@ -1249,9 +1778,8 @@ void Analyzer::calculateStats(const CodeMap &routineMap) {
     if (routineMap.empty()) return;
     routineSumSize = reachableSize = unreachableSize = excludedSize = excludedCount = excludedReachableSize = missedSize = ignoredSize = 0;
     missedNames.clear();
-    for (Size i = 0; i < routineMap.routineCount(); i++) {
+    for (const Routine &r : routineMap.getRoutines()) {
         // gather static routine map stats
-        const Routine r = routineMap.getRoutine(i);
         routineSumSize += r.size();
         reachableSize += r.reachableSize();
         unreachableSize += r.unreachableSize();
@@ -1292,7 +1820,7 @@ void Analyzer::comparisonSummary(const Executable &ref, const CodeMap &routineMa
         << "routines_compared: " << visitedCount << endl
         << "instructions_matched: " << comparedSize << endl;
     if (!missedNames.empty()) {
-        const Routine r = routineMap.getRoutine(*missedNames.begin());
+        const Routine &r = *routineMap.findRoutine(*missedNames.begin());
         msg << "first_mismatch: {" << endl
             << "  \"routine\": \"" << r.name << "\"," << endl
             << "  \"ref_addr\": \"" << r.entrypoint().toString(true) << "\"," << endl
@@ -1316,9 +1844,9 @@ void Analyzer::comparisonSummary(const Executable &ref, const CodeMap &routineMa
             << " routines totaling " << sizeStr(missedSize) 
             << " bytes (" << output_color(OUT_RED) << ratioStr(missedSize, routineSumSize) << output_color(OUT_DEFAULT) << " of the covered area)";
         if (showMissed) for (const auto &n : missedNames) {
-            const Routine r = routineMap.getRoutine(n);
-            if (!r.isValid()) throw LogicError("Unable to find missed routine " + n + " in routine map");
-            msg << endl << r.dump(false);
+            const Routine *r = routineMap.findRoutine(n);
+            if (!r) throw LogicError("Unable to find missed routine " + n + " in routine map");
+            msg << endl << r->dump(false);
         }
     }
     msg << endl 
@@ -1329,7 +1857,7 @@ void Analyzer::comparisonSummary(const Executable &ref, const CodeMap &routineMa
     verbose(msg.str());
 }
 
-void Analyzer::processDataReference(const Executable &exe, const Instruction i, const CpuState &regs) {
+void Analyzer::processDataReference(const Executable &exe, const Address &csip, const Instruction i, const CpuState &regs) {
     const SOffset off = i.memOffset();
     // ignore NULL
     if (off == 0) return;
@@ -1350,7 +1878,26 @@ void Analyzer::processDataReference(const Executable &exe, const Instruction i,
     }
     const Word dsAddr = regs.getValue(segReg);
     Address dataAddr{dsAddr, offVal};
-    vars.insert({"", dataAddr});
+    dataRefs.insert(dataAddr);
+    // the memory operand is written to if it is the destination of an instruction which stores its result
+    XrefKind kind = XREF_READ;
+    switch (i.iclass) {
+    case INS_CMP:
+    case INS_TEST:
+    case INS_PUSH:
+    case INS_CALL:
+    case INS_CALL_FAR:
+    case INS_JMP:
+    case INS_JMP_FAR:
+    case INS_MUL:
+    case INS_IMUL:
+    case INS_DIV:
+    case INS_IDIV:
+        break;
+    default:
+        if (operandIsMem(i.op1.type)) kind = XREF_WRITE;
+    }
+    xrefs.emplace_back(dataAddr, csip, kind);
     debug("Storing data reference: " + dataAddr.toString() + ", " + regName(segReg) + " = " + hexVal(regs.getValue(segReg)));
 }
 
@@ -1371,6 +1918,7 @@ struct Duplicate {
 };
 
 bool Analyzer::findDuplicates(const SignatureLibrary signatures, Executable &tgt, CodeMap &tgtMap) {
+    beginRun(false);
     if (signatures.empty()) throw ArgError("Empty signature library provided for duplicate search");
     if (tgtMap.empty()) throw ArgError("Empty routine map provided for duplicate search");
     info("Searching for duplicates of " + to_string(signatures.signatureCount()) + " signatures among " + to_string(tgtMap.routineCount()) + " candidates, minimum instructions: " + to_string(options.routineSizeThresh) + ", maximum distance ratio: " + to_string(options.routineDistanceThresh) + "%");
@@ -1395,27 +1943,33 @@ bool Analyzer::findDuplicates(const SignatureLibrary signatures, Executable &tgt
         // seed lowest distance found
         duplicates[sigIdx] = Duplicate{MAX_DISTANCE};
         debug("Searching for duplicates of routine " + sig.routineName + ", got string of " + to_string(sigSize) + " instructions, thresh = " + to_string(distanceThresh));
+        if (tgtSpans.empty()) {
+            tgtSpans.resize(tgtMap.routineCount());
+            for (Size tgtIdx = 0; tgtIdx < tgtMap.routineCount(); ++tgtIdx) {
+                // TODO: try other reachable blocks?
+                const Block tgtBlock = tgtMap.getRoutine(tgtIdx).mainBlock();
+                if (!tgtBlock.isValid()) continue;
+                tgtSpans[tgtIdx] = tgt.decodeBlock(tgtBlock, tgtArena);
+                tgtTotalInstr += tgtSpans[tgtIdx].count;
+            }
+        }
         // iterate over signatures in library
         bool have_dup = false;
-        Size tgtTotalTemp = 0;
         for (Size tgtIdx = 0; tgtIdx < tgtMap.routineCount(); ++tgtIdx) {
-            Routine tgtRoutine = tgtMap.getRoutine(tgtIdx);
-            // TODO: try other reachable blocks?
+            const Routine &tgtRoutine = tgtMap.getRoutine(tgtIdx);
             const Block tgtBlock = tgtRoutine.mainBlock();
             if (!tgtBlock.isValid()) {
                 debug("Routine has no valid block: " + tgtRoutine.toString());
                 continue;
             }
-            // extract string of signatures for target routine
-            vector<Signature> tgtSigs = tgt.getSignatures(tgtBlock);
-            const auto tgtSigSize = tgtSigs.size();
-            if (tgtTotalInstr == 0) tgtTotalTemp += tgtSigSize;
+            const Size tgtSigSize = tgtSpans[tgtIdx].count;
             const Size sigDelta = sigSize > tgtSigSize ? sigSize - tgtSigSize : tgtSigSize - sigSize;
             // ignore candidate if we know in advance the distance will be too high based on instruction count alone
             if (sigDelta > distanceThresh) {
                 debug("\tIgnoring target routine " + tgtRoutine.name + " (" + to_string(tgtSigSize) + " instructions), instruction count difference exceeds distance threshold: " + to_string(sigDelta));
                 continue;
             }
+            const auto tgtSigs = tgtArena.signatures(tgtSpans[tgtIdx]);
             // calculate edit distance between reference and target signature strings
             const auto distance = edit_distance_dp_thr(sig.signature.data(), sigSize, tgtSigs.data(), tgtSigSize, distanceThresh);
             if (distance > distanceThresh) {
@@ -1433,12 +1987,11 @@ bool Analyzer::findDuplicates(const SignatureLibrary signatures, Executable &tgt
             }
             else debug("\tIgnoring target routine " + tgtRoutine.name + " (" + to_string(tgtSigSize) + " instructions), distance above previous value of " + to_string(d.distance));
         } // iterate over target routines
-        if (tgtTotalInstr == 0) tgtTotalInstr = tgtTotalTemp;
         // found an eligible duplicate after going through all target routines
         if (have_dup) {
             Duplicate &curDup = duplicates[sigIdx];
             debug("Processing duplicate: " + curDup.toString());
-            const Routine dupRoutine = tgtMap.getRoutine(curDup.dupIdx);
+            const Routine &dupRoutine = tgtMap.getRoutine(curDup.dupIdx);
             verbose("[" + to_string(sigIdx+1) + "/" + to_string(signatures.signatureCount()) + "] Found duplicate of routine " + sig.routineName + " (" + to_string(curDup.refSize) + " instructions): " 
                 + dupRoutine.toString() + " (" + to_string(curDup.tgtSize) + " instructions) with distance " + to_string(curDup.distance));
             // walk over all found duplicates looking for collisions
@@ -1505,6 +2058,7 @@ bool Analyzer::findDuplicates(const SignatureLibrary signatures, Executable &tgt
              "Unable to find " + to_string(tgtMap.routineCount() - dupCount) + " matching routines, " + output_color(OUT_RED) + to_string(100 - dupPercent) + "%" + output_color(OUT_DEFAULT));
     }
     else info("No duplicates found, ignored " + to_string(ignoreCount) + " routines", OUT_RED);
+    verbose(tgt.instructionCacheInfo());
 
     if (collision) {
         assert(uniqueDups < dupCount);
@@ -1522,8 +2076,9 @@ void Analyzer::findDataRefs(const Executable &exe, const CodeMap &map) {
         segCount = segments.size(),
         varCount = map.variableCount();
     Size refCount = 0;
-    Offset startOffset = 0, endOffset = 0, finalOffset = exe.loadAddr().toLinear() + codeSize;
-    const Byte *code = exe.codePointer(Address{0});
+    const Offset codeBase = exe.loadAddr().toLinear();
+    Offset startOffset = 0, endOffset = 0, finalOffset = codeBase + codeSize;
+    const Byte *code = exe.codePointer(exe.loadAddr());
     struct VarRef {
         string segname;
         int count;
@@ -1554,12 +2109,11 @@ void Analyzer::findDataRefs(const Executable &exe, const CodeMap &map) {
         }
         debug("Now searching in segment " + seg.toString() + ", start at " + hexVal(startOffset) + ", end at " + hexVal(endOffset));
         for (Offset off = startOffset; off < endOffset - 1; ++off) {
-            if (off + 1 >= finalOffset) throw AnalysisError("Stepped out of executable load module bounds at " + hexVal(off));
-            const Word val = (code[off + 1] << 8) | code[off];
+            if (off < codeBase || off + 1 >= finalOffset) throw AnalysisError("Stepped out of executable load module bounds at " + hexVal(off));
+            const Word val = (code[off - codeBase + 1] << 8) | code[off - codeBase];
             if (val == 0) continue; // no point to find offset zero
             debug("Value at offset " + hexVal(off) + "/" + hexVal(off - startOffset) + ": " + hexVal(val));
-            for (Size vi = 0; vi < varCount; ++vi) {
-                const Variable v = map.getVariable(vi);
+            for (const Variable &v : map.getVariables()) {
                 if (v.addr.offset == val) {
                     verbose(seg.name + "/" + hexVal(off - startOffset) + ": potential reference to variable " + v.toString());
                     refCount++;
@@ -0,0 +1,241 @@
+#include "dos/callgraph.h"
+#include "dos/codemap.h"
+#include "dos/routine.h"
+#include "dos/util.h"
+#include "dos/error.h"
+#include "dos/output.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+OUTPUT_CONF(LOG_ANALYSIS)
+
+static constexpr DWord CALLGRAPH_MAGIC = 0x47435a4d; // "MZCG"
+static constexpr Word CALLGRAPH_VERSION = 2;
+
+CallGraph::CallGraph(const CodeMap &map, const vector<CallSite> &sites, const vector<EntryState> &states) : CallGraph() {
+    // the blocks of all routines sorted by address, for finding the routine of a call site
+    vector<pair<Block, Size>> blocks;
+    for (const Routine &r : map.getRoutines()) nodes_.push_back(r.entrypoint());
+    std::sort(nodes_.begin(), nodes_.end());
+    nodes_.erase(std::unique(nodes_.begin(), nodes_.end()), nodes_.end());
+    for (const Routine &r : map.getRoutines()) {
+        const Size node = findNode(r.entrypoint());
+        for (const Block &b : r.reachable) blocks.emplace_back(b, node);
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const auto &a, const auto &b) { return a.first.begin < b.first.begin; });
+    const auto routineOf = [&](const Address &addr) {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), addr, [](const Address &a, const auto &b) { return a < b.first.begin; });
+        if (it == blocks.begin()) return NO_NODE;
+        --it;
+        return it->first.contains(addr) ? it->second : NO_NODE;
+    };
+
+    vector<pair<Size, Edge>> edges;
+    for (const CallSite &cs : sites) {
+        const Size caller = routineOf(cs.site);
+        if (caller == NO_NODE) {
+            debug("Call site " + cs.site.toString() + " does not belong to any routine, ignoring");
+            continue;
+        }
+        if (!cs.dest.isValid()) {
+            unresolved_.push_back({caller, cs.site, cs.near});
+            continue;
+        }
+        const Size callee = findNode(cs.dest);
+        if (callee == NO_NODE) {
+            debug("Call destination " + cs.dest.toString() + " from " + cs.site.toString() + " is not a routine entrypoint, ignoring");
+            continue;
+        }
+        edges.push_back({caller, Edge{callee, cs.site, cs.near}});
+    }
+    std::sort(unresolved_.begin(), unresolved_.end(), [](const Unresolved &a, const Unresolved &b) { return a.site < b.site; });
+    unresolved_.erase(std::unique(unresolved_.begin(), unresolved_.end(), [](const Unresolved &a, const Unresolved &b) { return a.site == b.site; }), unresolved_.end());
+    build(edges);
+    for (const EntryState &s : states) {
+        if (findNode(s.entrypoint) != NO_NODE) entryStates_.push_back(s);
+    }
+    // keep the last state of every entrypoint
+    std::stable_sort(entryStates_.begin(), entryStates_.end(), [](const EntryState &a, const EntryState &b) { return a.entrypoint < b.entrypoint; });
+    entryStates_.erase(entryStates_.begin(), std::unique(entryStates_.rbegin(), entryStates_.rend(), [](const EntryState &a, const EntryState &b) { 
+        return a.entrypoint == b.entrypoint; 
+    }).base());
+}
+
+// Fill both directions of the graph from (caller, edge to callee) pairs, duplicates are dropped.
+void CallGraph::build(vector<pair<Size, Edge>> &edges) {
+    std::sort(edges.begin(), edges.end(), [](const auto &a, const auto &b) {
+        if (a.first != b.first) return a.first < b.first;
+        if (a.second.site != b.second.site) return a.second.site < b.second.site;
+        return a.second.node < b.second.node;
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](const auto &a, const auto &b) {
+        return a.first == b.first && a.second.site == b.second.site && a.second.node == b.second.node;
+    }), edges.end());
+    const Size count = nodes_.size();
+    calleeIndex_.assign(count + 1, 0);
+    callerIndex_.assign(count + 1, 0);
+    for (const auto &[caller, e] : edges) {
+        calleeIndex_[caller + 1]++;
+        callerIndex_[e.node + 1]++;
+    }
+    for (Size n = 0; n < count; ++n) {
+        calleeIndex_[n + 1] += calleeIndex_[n];
+        callerIndex_[n + 1] += callerIndex_[n];
+    }
+    callees_.resize(edges.size());
+    callers_.resize(edges.size());
+    vector<Size> calleePos(calleeIndex_.begin(), calleeIndex_.end() - 1), callerPos(callerIndex_.begin(), callerIndex_.end() - 1);
+    for (const auto &[caller, e] : edges) {
+        callees_[calleePos[caller]++] = e;
+        callers_[callerPos[e.node]++] = Edge{caller, e.site, e.near};
+    }
+    debug("Built call graph of " + to_string(count) + " routines, " + to_string(edges.size()) + " calls, " + to_string(unresolved_.size()) + " unresolved");
+}
+
+Size CallGraph::findNode(const Address &entrypoint) const {
+    auto it = std::lower_bound(nodes_.begin(), nodes_.end(), entrypoint);
+    if (it == nodes_.end() || *it != entrypoint) return NO_NODE;
+    return it - nodes_.begin();
+}
+
+vector<CallSite> CallGraph::callSites() const {
+    vector<CallSite> ret;
+    for (Size n = 0; n < nodeCount(); ++n) {
+        for (const Edge &e : callees(n)) ret.emplace_back(e.site, nodes_[e.node], e.near);
+    }
+    for (const Unresolved &u : unresolved_) ret.emplace_back(u.site, Address{}, u.near);
+    return ret;
+}
+
+const CpuState* CallGraph::entryState(const Size node) const {
+    const Address &ep = nodes_.at(node);
+    auto it = std::lower_bound(entryStates_.begin(), entryStates_.end(), ep, [](const EntryState &s, const Address &a) { return s.entrypoint < a; });
+    if (it == entryStates_.end() || it->entrypoint != ep) return nullptr;
+    return &it->regs;
+}
+
+vector<Size> CallGraph::topologicalOrder() const {
+    const Size count = nodeCount();
+    vector<Size> ret;
+    ret.reserve(count);
+    vector<Byte> state(count, 0); // 0 - not seen, 1 - on the stack, 2 - done
+    // iterative depth-first search emitting nodes after all their callees
+    vector<pair<Size, Size>> stack; // node, position in its callee list
+    for (Size root = 0; root < count; ++root) {
+        if (state[root]) continue;
+        stack.emplace_back(root, 0);
+        state[root] = 1;
+        while (!stack.empty()) {
+            auto &[node, pos] = stack.back();
+            const auto edges = callees(node);
+            if (pos < edges.size()) {
+                const Size next = edges[pos++].node;
+                if (state[next] == 0) {
+                    state[next] = 1;
+                    stack.emplace_back(next, 0);
+                }
+                continue;
+            }
+            state[node] = 2;
+            ret.push_back(node);
+            stack.pop_back();
+        }
+    }
+    return ret;
+}
+
+static void writeAddress(ostream &str, Address addr, const Word reloc) {
+    addr.rebase(reloc);
+    writeBinaryValue(str, addr.segment, sizeof(Word));
+    writeBinaryValue(str, addr.offset, sizeof(Word));
+}
+
+static Address readAddress(istream &str, const Word reloc) {
+    const Word segment = readBinaryValue(str, sizeof(Word));
+    const Word offset = readBinaryValue(str, sizeof(Word));
+    Address ret{segment, offset};
+    ret.relocate(reloc);
+    return ret;
+}
+
+void CallGraph::save(const string &path, const Word reloc) const {
+    debug("Saving call graph of " + to_string(nodeCount()) + " routines to " + path + ", reversing relocation by " + hexVal(reloc));
+    ofstream file{path, ios::binary};
+    writeBinaryValue(file, CALLGRAPH_MAGIC, sizeof(DWord));
+    writeBinaryValue(file, CALLGRAPH_VERSION, sizeof(Word));
+    writeBinaryValue(file, nodes_.size(), sizeof(DWord));
+    for (const Address &a : nodes_) writeAddress(file, a, reloc);
+    // only the callees are stored, the callers are rebuilt from them
+    for (Size n = 0; n < nodeCount(); ++n) {
+        const auto edges = callees(n);
+        writeBinaryValue(file, edges.size(), sizeof(DWord));
+        for (const Edge &e : edges) {
+            writeBinaryValue(file, e.node, sizeof(DWord));
+            writeAddress(file, e.site, reloc);
+            writeBinaryValue(file, e.near, sizeof(Byte));
+        }
+    }
+    writeBinaryValue(file, unresolved_.size(), sizeof(DWord));
+    for (const Unresolved &u : unresolved_) {
+        writeBinaryValue(file, u.caller, sizeof(DWord));
+        writeAddress(file, u.site, reloc);
+        writeBinaryValue(file, u.near, sizeof(Byte));
+    }
+    // register values hold segments as loaded, so they are only valid at the same load segment
+    writeBinaryValue(file, reloc, sizeof(Word));
+    writeBinaryValue(file, entryStates_.size(), sizeof(DWord));
+    for (const EntryState &s : entryStates_) {
+        writeBinaryValue(file, findNode(s.entrypoint), sizeof(DWord));
+        s.regs.save(file);
+    }
+    if (!file) throw IoError("Unable to write call graph: " + path);
+}
+
+CallGraph::CallGraph(const string &path, const Word reloc) : CallGraph() {
+    ifstream file{path, ios::binary};
+    if (!file) throw IoError("Unable to open call graph: " + path);
+    if (readBinaryValue(file, sizeof(DWord)) != CALLGRAPH_MAGIC || readBinaryValue(file, sizeof(Word)) != CALLGRAPH_VERSION)
+        throw IoError("Unsupported call graph format: " + path);
+    const Size count = readBinaryValue(file, sizeof(DWord));
+    for (Size n = 0; n < count; ++n) nodes_.push_back(readAddress(file, reloc));
+    if (!std::is_sorted(nodes_.begin(), nodes_.end())) throw IoError("Call graph nodes out of order: " + path);
+    vector<pair<Size, Edge>> edges;
+    for (Size n = 0; n < count; ++n) {
+        const Size edgeCount = readBinaryValue(file, sizeof(DWord));
+        for (Size i = 0; i < edgeCount; ++i) {
+            Edge e;
+            e.node = readBinaryValue(file, sizeof(DWord));
+            e.site = readAddress(file, reloc);
+            e.near = readBinaryValue(file, sizeof(Byte)) != 0;
+            if (e.node >= count) throw IoError("Invalid callee in call graph: " + path);
+            edges.emplace_back(n, e);
+        }
+    }
+    const Size unresolvedCount = readBinaryValue(file, sizeof(DWord));
+    for (Size i = 0; i < unresolvedCount; ++i) {
+        Unresolved u;
+        u.caller = readBinaryValue(file, sizeof(DWord));
+        u.site = readAddress(file, reloc);
+        u.near = readBinaryValue(file, sizeof(Byte)) != 0;
+        if (u.caller >= count) throw IoError("Invalid caller in call graph: " + path);
+        unresolved_.push_back(u);
+    }
+    build(edges);
+    const Word stateReloc = readBinaryValue(file, sizeof(Word));
+    const Size stateCount = readBinaryValue(file, sizeof(DWord));
+    for (Size i = 0; i < stateCount; ++i) {
+        const Size node = readBinaryValue(file, sizeof(DWord));
+        if (node >= count || (!entryStates_.empty() && nodes_[node] <= entryStates_.back().entrypoint)) 
+            throw IoError("Invalid entry state in call graph: " + path);
+        CpuState regs;
+        regs.load(file);
+        entryStates_.emplace_back(nodes_[node], regs);
+    }
+    if (stateReloc != reloc) {
+        debug("Call graph entry states saved at load segment " + hexVal(stateReloc) + " instead of " + hexVal(reloc) + ", ignoring");
+        entryStates_.clear();
+    }
+}
@@ -3,6 +3,7 @@
 #include "dos/util.h"
 #include "dos/output.h"
 #include "dos/scanq.h"
+#include "dos/mapimage.h"
 
 #include <fstream>
 
@@ -63,16 +64,38 @@ void CodeMap::blocksFromQueue(const ScanQueue &sq, const bool unclaimedOnly) {
         return;
     }
     
-    // Prevent potential infinite loops by checking for reasonable step size
-    const Offset maxIterations = MEM_TOTAL;
-    Offset iterationCount = 0;
-    
-    for (Offset mapOffset = startOffset; mapOffset < endOffset; ++mapOffset) {
-        // Safety check to prevent infinite loops
-        if (++iterationCount > maxIterations) {
-            error("Maximum iteration count exceeded, breaking loop to prevent infinite execution");
-            break;
-        }
+    // Nothing happens at an offset with the same routine index and segment as the previous one which is not an entrypoint,
+    // so the loop only visits the offsets where one of these changes. The segment lookup is piecewise constant between
+    // the segment boundaries, tabulate it.
+    vector<Offset> segBounds{0};
+    for (const auto &s : segments) {
+        const Offset segOff = SEG_TO_OFFSET(s.address);
+        segBounds.push_back(segOff);
+        if (segOff <= SIZE_MAX - (OFFSET_MAX + 1)) segBounds.push_back(segOff + OFFSET_MAX + 1);
+    }
+    std::sort(segBounds.begin(), segBounds.end());
+    segBounds.erase(std::unique(segBounds.begin(), segBounds.end()), segBounds.end());
+    vector<Segment> segAt;
+    for (const Offset bound : segBounds) segAt.push_back(findSegment(bound));
+    vector<Offset> epOffsets;
+    for (const auto &ep : sq.getEntrypoints()) epOffsets.push_back(ep.addr.toLinear());
+    std::sort(epOffsets.begin(), epOffsets.end());
+    // first offset past the current one where the routine index, segment or entrypoint status may change
+    const auto nextChange = [&](const Offset mapOffset) -> Offset {
+        const Offset off = mapOffset + 1;
+        if (off >= endOffset) return off;
+        const auto run = sq.getRoutineRun(off);
+        if (run.idx != prevId) return off;
+        const Size segIdx = std::upper_bound(segBounds.begin(), segBounds.end(), off) - segBounds.begin() - 1;
+        if (segAt[segIdx] != curSeg) return off;
+        Offset next = run.end;
+        if (segIdx + 1 < segBounds.size()) next = std::min(next, segBounds[segIdx + 1]);
+        const auto ep = std::lower_bound(epOffsets.begin(), epOffsets.end(), off);
+        if (ep != epOffsets.end()) next = std::min(next, *ep);
+        return std::min(next, endOffset);
+    };
+
+    for (Offset mapOffset = startOffset; mapOffset < endOffset; mapOffset = nextChange(mapOffset)) {
         curId = sq.getRoutineIdx(mapOffset);
         // find segment matching currently processed offset
         Segment newSeg = findSegment(mapOffset);
@@ -154,6 +177,11 @@ CodeMap::CodeMap(const ScanQueue &sq, const std::vector<Segment> &segs, const st
 CodeMap::CodeMap(const std::string &path, const Word loadSegment, const Type type) : CodeMap(loadSegment, 0) {
     const auto fstat = checkFile(path);
     if (!fstat.exists) throw ArgError("File does not exist: "s + path);
+    // binary maps keep the unclaimed blocks and are saved ordered, nothing to rebuild
+    if (type == MAP_MZRE && MapImage::isImage(path)) {
+        loadFromImage(path, loadSegment);
+        return;
+    }
     switch(type) {
     case MAP_IDALST: 
         loadFromIdaFile(path, loadSegment);
@@ -184,25 +212,84 @@ Size CodeMap::routinesSize() const {
     return ret;
 }
 
-Routine CodeMap::getRoutine(const Address &addr) const {
-    for (const Routine &r : routines) {
-        if (r.extents.contains(addr)) return r;
-        for (const Block &b : r.reachable) 
-            if (b.contains(addr)) return r;
+RoutineIndex::RoutineIndex(const vector<Routine> &routines, const bool extents, const bool unreachable) {
+    VisitedMap owners{MEM_TOTAL};
+    // paint from the last routine, the earlier ones overwrite it where they overlap
+    for (Size ri = routines.size(); ri-- > 0;) {
+        const Routine &r = routines[ri];
+        const RoutineIdx id = static_cast<RoutineIdx>(ri + 1);
+        const auto paint = [&](const Block &b) { if (b.isValid()) owners.assign(b.begin.toLinear(), b.size(), id); };
+        if (extents) paint(r.extents);
+        for (const Block &b : r.reachable) paint(b);
+        if (unreachable) for (const Block &b : r.unreachable) paint(b);
     }
-    
-    return {};
+    for (Offset off = 0; off < owners.size();) {
+        const auto run = owners.find(off);
+        if (run.idx != NULL_ROUTINE) {
+            begins_.push_back(run.begin);
+            ends_.push_back(run.end);
+            routines_.push_back(static_cast<Size>(run.idx - 1));
+        }
+        off = run.end;
+    }
+}
+
+Size RoutineIndex::find(const Offset linear) const {
+    auto it = std::upper_bound(begins_.begin(), begins_.end(), linear);
+    if (it == begins_.begin()) return NONE;
+    const Size pos = std::prev(it) - begins_.begin();
+    return linear < ends_[pos] ? routines_[pos] : NONE;
+}
+
+Size RoutineIndex::find(const Block &b) const {
+    if (!b.isValid()) return NONE;
+    const Offset first = b.begin.toLinear(), last = b.end.toLinear();
+    Size pos = std::upper_bound(begins_.begin(), begins_.end(), first) - begins_.begin();
+    if (pos > 0 && first < ends_[pos - 1]) pos--;
+    Size ret = NONE;
+    for (; pos < begins_.size() && begins_[pos] <= last; ++pos) ret = std::min(ret, routines_[pos]);
+    return ret;
+}
+
+static Size nameHash(const std::string &name) { return std::hash<std::string>{}(name); }
+
+void CodeMap::buildIndex() const {
+    addrIndex = RoutineIndex{routines, true, false};
+    blockIndex = RoutineIndex{routines, true, true};
+    routineNames.build(routines.size(), [&](Size i) { return nameHash(routines[i].name); }, [&](Size i, Size j) { return routines[i].name == routines[j].name; });
+    routineEntrypoints.build(routines.size(), [&](Size i) { return routines[i].entrypoint().toLinear(); },
+        [&](Size i, Size j) { return routines[i].entrypoint() == routines[j].entrypoint(); });
+    varNames.build(vars.size(), [&](Size i) { return nameHash(vars[i].name); }, [&](Size i, Size j) { return vars[i].name == vars[j].name; });
+    varAddrs.build(vars.size(), [&](Size i) { return vars[i].addr.toLinear(); }, [&](Size i, Size j) { return vars[i].addr == vars[j].addr; });
+    indexed = true;
+}
+
+const Routine* CodeMap::findRoutine(const Address &addr) const {
+    if (!indexed) buildIndex();
+    const Size idx = addrIndex.find(addr.toLinear());
+    return idx == RoutineIndex::NONE ? nullptr : &routines[idx];
+}
+
+Routine CodeMap::getRoutine(const Address &addr) const {
+    const Routine *r = findRoutine(addr);
+    return r ? *r : Routine{};
+}
+
+const Routine* CodeMap::findRoutine(const std::string &name) const {
+    if (!indexed) buildIndex();
+    const Size idx = routineNames.find(nameHash(name), [&](Size i) { return routines[i].name == name; });
+    return idx == PositionHash::NONE ? nullptr : &routines[idx];
 }
 
 Routine CodeMap::getRoutine(const std::string &name) const {
-    for (const Routine &r : routines)
-        if (r.name == name) return r;
-    return {};
+    const Routine *r = findRoutine(name);
+    return r ? *r : Routine{};
 }
 
 Routine& CodeMap::getMutableRoutine(const std::string &name) {
-    for (Routine &r : routines)
-        if (r.name == name) return r;
+    const Routine *found = findRoutine(name);
+    indexed = false;
+    if (found) return routines[found - routines.data()];
     
     // Safety check to prevent excessive memory growth
     if (routines.size() >= MAX_ROUTINES) {
@@ -212,35 +299,47 @@ Routine& CodeMap::getMutableRoutine(const std::string &name) {
     return routines.emplace_back(Routine(name, {}));
 }
 
+const Variable* CodeMap::findVariable(const std::string &name) const {
+    if (!indexed) buildIndex();
+    const Size idx = varNames.find(nameHash(name), [&](Size i) { return vars[i].name == name; });
+    return idx == PositionHash::NONE ? nullptr : &vars[idx];
+}
+
+const Variable* CodeMap::findVariable(const Address &addr) const {
+    if (!indexed) buildIndex();
+    const Size idx = varAddrs.find(addr.toLinear(), [&](Size i) { return vars[i].addr == addr; });
+    return idx == PositionHash::NONE ? nullptr : &vars[idx];
+}
+
 Variable CodeMap::getVariable(const std::string &name) const {
-    auto it = std::find_if(vars.begin(), vars.end(), [&](const Variable &v){
-        return v.name == name;
-    });
-    if (it != vars.end()) return *it;
-    return Variable{"", {}};
+    const Variable *v = findVariable(name);
+    return v ? *v : Variable{"", {}};
 }
 
 Variable CodeMap::getVariable(const Address &addr) const {
-    auto it = std::find_if(vars.begin(), vars.end(), [&](const Variable &v){
-        return v.addr == addr;
-    });
-    if (it != vars.end()) return *it;
-    return Variable{"", {}};
+    const Variable *v = findVariable(addr);
+    return v ? *v : Variable{"", {}};
+}
+
+const Routine* CodeMap::findEntrypoint(const Address &ep) const {
+    if (!indexed) buildIndex();
+    const Size idx = routineEntrypoints.find(ep.toLinear(), [&](Size i) { return routines[i].entrypoint() == ep; });
+    return idx == PositionHash::NONE ? nullptr : &routines[idx];
 }
 
 Routine CodeMap::findByEntrypoint(const Address &ep) const {
-    for (const Routine &r : routines)
-        if (r.entrypoint() == ep) return r;
-    
-    return {};
+    const Routine *r = findEntrypoint(ep);
+    return r ? *r : Routine{};
 }
 
-// given a block, go over all routines in the map and check if it does not colide (meaning cross over even partially) with any blocks claimed by those routines
+// given a block, check if it does not colide (meaning cross over even partially) with any blocks claimed by the routines of the map
 Block CodeMap::findCollision(const Block &b) const {
-    for (const Routine &r : routines) {
-        for (const Block &rb : r.reachable) if (rb.intersects(b)) return rb;
-        for (const Block &ub : r.unreachable) if (ub.intersects(b)) return ub;
-    }
+    if (!indexed) buildIndex();
+    const Size idx = blockIndex.find(b);
+    if (idx == RoutineIndex::NONE) return {};
+    const Routine &r = routines[idx];
+    for (const Block &rb : r.reachable) if (rb.intersects(b)) return rb;
+    for (const Block &ub : r.unreachable) if (ub.intersects(b)) return ub;
     return {};
 }
 
@@ -266,11 +365,9 @@ Size CodeMap::match(const CodeMap &other, const bool onlyEntry) const {
 
 // check if any of the extents or chunks of routines in the map colides (contains or intersects) with a block
 Routine CodeMap::colidesBlock(const Block &b) const {
-    const auto &found = find_if(routines.begin(), routines.end(), [&b](const Routine &r){
-        return r.colides(b);
-    });
-    if (found != routines.end()) return *found;
-    else return {};
+    if (!indexed) buildIndex();
+    const Size idx = blockIndex.find(b);
+    return idx == RoutineIndex::NONE ? Routine{} : routines[idx];
 }
 
 // utility function used when constructing from an instance of SearchQueue
@@ -352,6 +449,7 @@ Block CodeMap::moveBlock(const Block &b, const Word segment) const {
 
 void CodeMap::sort() {
     using std::sort;
+    indexed = false;
     // sort routines by entrypoint
     std::sort(routines.begin(), routines.end());
     // sort unclaimed blocks by block start
@@ -366,9 +464,8 @@ void CodeMap::sort() {
     std::sort(vars.begin(), vars.end());
 }
 
-// this is the string representation written to the mapfile, while Routine::toString() is the stdout representation for info/debugging
-std::string CodeMap::routineString(const Routine &r, const Word reloc) const {
-    ostringstream str;
+// this is the representation written to the mapfile, while Routine::toString() is the stdout representation for info/debugging
+void CodeMap::writeRoutine(std::ostream &str, const Routine &r, const Word reloc) const {
     Block rextent{r.extents};
     if (!rextent.isValid())
         throw AnalysisError("Invalid routine extents for routine " + r.name + ": " + rextent.toString());
@@ -379,10 +476,14 @@ std::string CodeMap::routineString(const Routine &r, const Word reloc) const {
     if (rseg.type == Segment::SEG_NONE) 
         throw AnalysisError("Unable to find segment for routine " + r.name + ", start addr " + r.extents.begin.toString() + ", relocated " + rextent.begin.toString());
     // output routine comments before the actual routine
-    for (const string &c : r.comments) str << "# " << c << endl;
-    str << r.name << ": " << rseg.name << " " << (r.near ? "NEAR " : "FAR ") << rextent.toHex();
+    for (const string &c : r.comments) str << "# " << c << '\n';
+    // the blocks are rendered one at a time, a routine line has no length limit
+    char buf[BLOCK_HEX_STRLEN + 2];
+    FormatBuffer block{buf, sizeof(buf)};
+    rextent.renderHex(block);
+    str << r.name << ": " << rseg.name << " " << (r.near ? "NEAR " : "FAR ") << block.view();
     if (r.unclaimed) {
-        str << " U" << rextent.toHex();
+        str << " U" << block.view();
     }
     else {
         const auto blocks = r.sortedBlocks();
@@ -393,8 +494,10 @@ std::string CodeMap::routineString(const Routine &r, const Word reloc) const {
                 throw AnalysisError("Block of routine " + r.name + " lies in different segment than routine extents: " + rblock.toString() + " vs " + rextent.toString());
             if (rblock.begin.segment != rblock.end.segment)
                 throw AnalysisError("Beginning and end of block of routine " + r.name + " lie in different segments: " + rblock.toString());
-            str << " " << (r.isReachable(b) ? "R" : "U");
-            str <<  rblock.toHex();
+            block.clear();
+            block.put(' ').put(r.isReachable(b) ? 'R' : 'U');
+            rblock.renderHex(block);
+            str << block.view();
         }
     }
     if (r.ignore) str << " ignore";
@@ -403,16 +506,16 @@ std::string CodeMap::routineString(const Routine &r, const Word reloc) const {
     if (r.detached) str << " detached";
     if (r.assembly) str << " assembly";
     if (r.duplicate) str << " duplicate";
-    return str.str();
 }
 
-std::string CodeMap::varString(const Variable &v, const Word reloc) const {
-    ostringstream str;
+void CodeMap::writeVariable(std::ostream &str, const Variable &v, const Word reloc) const {
     if (!v.addr.isValid()) throw ArgError("Invalid variable address for '" + v.name + "' while converting to string");
     const Segment vseg = findSegment(v.addr.segment);
     if (vseg.type == Segment::SEG_NONE) throw AnalysisError("Unable to find segment for variable " + v.name + " / " + v.addr.toString());
-    str << v.name << ": " << vseg.name << " VAR " << hexVal(v.addr.offset, false);
-    return str.str();
+    char buf[BLOCK_HEX_STRLEN];
+    FormatBuffer offset{buf, sizeof(buf)};
+    offset.hex(v.addr.offset, false, WORD_STRLEN);
+    str << v.name << ": " << vseg.name << " VAR " << offset.view();
 }
 
 void CodeMap::order() {
@@ -421,6 +524,7 @@ void CodeMap::order() {
     for (auto &r : routines) 
         r.recalculateExtents();
     sort();
+    buildIndex();
 }
 
 void CodeMap::save(const std::string &path, const Word reloc, const bool overwrite) const {
@@ -459,16 +563,25 @@ void CodeMap::save(const std::string &path, const Word reloc, const bool overwri
          << "# duplicate - routine is a duplicate of another" << endl
          << "#" << endl;
     for (const auto &r : routines) {
-        file << routineString(r, reloc) << endl;
+        writeRoutine(file, r, reloc);
+        file << '\n';
     }
     file << "#" << endl
          << "# Discovered variables, one per line, syntax is \"VariableName: Segment VAR OffsetWithinSegment\"" << endl
          << "#" << endl;
     for (const auto &v: vars) {
-        file << varString(v, reloc) << endl;
+        writeVariable(file, v, reloc);
+        file << '\n';
     }
 }
 
+void CodeMap::saveBinary(const std::string &path, const Word reloc, const bool overwrite) const {
+    if (empty()) return;
+    if (checkFile(path).exists && !overwrite) throw AnalysisError("Map file already exists: " + path);
+    info("Saving binary code map (routines = " + to_string(routineCount()) + ") to "s + path + ", reversing relocation by " + hexVal(reloc));
+    MapImage::save(*this, path, reloc);
+}
+
 // TODO: implement a print mode of all blocks (reachable, unreachable, unclaimed) printed linearly, not grouped under routines
 CodeMap::Summary CodeMap::getSummary(const bool verbose, const bool brief, const bool format) const {
     ostringstream str;
@@ -521,7 +634,8 @@ CodeMap::Summary CodeMap::getSummary(const bool verbose, const bool brief, const
                 str << endl;
             }
             else {
-                str << routineString(r, 0) << endl;
+                writeRoutine(str, r, 0);
+                str << '\n';
             }
         }
     }
@@ -530,7 +644,8 @@ CodeMap::Summary CodeMap::getSummary(const bool verbose, const bool brief, const
 
     if (vars.size()) str << "--- Map contains " << vars.size() << " variables" << endl;
     for (const auto &v : vars) {
-        str << varString(v, 0) << endl;
+        writeVariable(str, v, 0);
+        str << '\n';
     }
 
     // print statistics
@@ -574,6 +689,7 @@ void CodeMap::storeVariable(const Variable &v) {
         debug("Unable to save variable at address " + v.addr.toString() + ", no record of segment at " + hexVal(v.addr.segment));
         return;
     }
+    indexed = false;
     if (v.name.empty()) {
         const size_t idx = vars.size() + 1;
         vars.emplace_back(Variable{"var_" + to_string(idx), v.addr});
@@ -627,76 +743,111 @@ Segment CodeMap::findSegment(const Offset off, const bool past) const {
 
 enum BlockType { BLOCK_NONE, BLOCK_EXTENTS, BLOCK_REACHABLE, BLOCK_UNREACHABLE };
 
+// first routine owning any part of a block in a map of routine ids, NULL_ROUTINE if none
+static RoutineIdx firstOwner(const VisitedMap &owners, const Block &b) {
+    RoutineIdx ret = NULL_ROUTINE;
+    for (Offset off = b.begin.toLinear(); off <= b.end.toLinear();) {
+        const auto run = owners.find(off);
+        if (run.idx != NULL_ROUTINE && (ret == NULL_ROUTINE || run.idx < ret)) ret = run.idx;
+        off = run.end;
+    }
+    return ret;
+}
+
+// The records are copied into the routines and variables the rest of CodeMap works with, so this only saves parsing the text. 
+// Code which needs to read a large map in place without building a CodeMap uses MapImage directly.
+void CodeMap::loadFromImage(const std::string &path, const Word reloc) {
+    debug("Loading binary code map from "s + path + ", relocating to " + hexVal(reloc));
+    const MapImage image{path, reloc};
+    mapSize = image.mapSize();
+    ida = image.ida();
+    segments.reserve(image.segmentCount());
+    for (Size i = 0; i < image.segmentCount(); ++i) segments.push_back(image.segment(i));
+    routines.reserve(image.routineCount());
+    for (Size i = 0; i < image.routineCount(); ++i) routines.push_back(image.routine(i));
+    vars.reserve(image.variableCount());
+    for (Size i = 0; i < image.variableCount(); ++i) vars.push_back(image.variable(i));
+    unclaimed.reserve(image.unclaimedCount());
+    for (Size i = 0; i < image.unclaimedCount(); ++i) unclaimed.push_back(image.unclaimed(i));
+    debug("Done, found "s + to_string(routines.size()) + " routines, " + to_string(vars.size()) + " variables");
+}
+
+// parse a block of the form "begin-end" with up to 4 hex digits per offset, within a segment
+static bool parseRange(std::string_view str, const Word segment, Block &block) {
+    TextScanner sc{str};
+    Size begin, end;
+    if (!sc.hex(begin, 4) || !sc.literal("-") || !sc.hex(end, 4) || !sc.atEnd()) return false;
+    block = Block{Address{segment, static_cast<Word>(begin)}, Address{segment, static_cast<Word>(end)}};
+    return true;
+}
+
 void CodeMap::loadFromMapFile(const std::string &path, const Word reloc) {
-    static const regex 
-        RANGE_RE{"([0-9a-fA-F]{1,4})-([0-9a-fA-F]{1,4})"},
-        SIZE_RE{"Size\\s+([0-9a-fA-F]+)"};
     debug("Loading code map from "s + path + ", relocating to " + hexVal(reloc));
-    ifstream mapFile{path};
-    string line;
+    const MappedFile mapFile{path};
+    TextScanner file{mapFile.text()};
+    string_view line;
     Size lineno = 0;
-    smatch match;
-    while (safeGetline(mapFile, line)) {
+    // areas of the routines loaded so far, the map is not indexed until it is complete
+    VisitedMap claimed{MEM_TOTAL};
+    while (file.line(line)) {
         lineno++;
         // ignore comments and empty lines
         if (line.empty() || line[0] == '#') continue;
-        // try to interpret as code size
-        else if (regex_match(line, match, SIZE_RE)) {
-            mapSize = std::stoi(match.str(1), nullptr, 16);
+        TextScanner sc{line};
+        Size value;
+        string_view name, segname, type;
+        // try to interpret as code size: "Size hexval"
+        if (sc.literal("Size") && sc.space() && sc.hex(value) && sc.atEnd()) {
+            mapSize = value;
             debug("Parsed map size = " + sizeStr(mapSize));
             continue;
         }
-        // try to interpret as a segment
-        else if (!(match = Segment::stringMatch(line)).empty()) {
-            Segment s(match);
+        // try to interpret as a segment: "name CODE|DATA|STACK addr"
+        sc = TextScanner{line};
+        if (sc.span(TextScanner::isNameOrDollar, name) && sc.literal(" ") && sc.span(TextScanner::isName, type) && sc.literal(" ")
+            && sc.hex(value, 4) && sc.atEnd() && (type == "CODE" || type == "DATA" || type == "STACK")) {
+            const Segment::Type segType = type == "CODE" ? Segment::SEG_CODE : type == "DATA" ? Segment::SEG_DATA : Segment::SEG_STACK;
+            Segment s{string{name}, segType, static_cast<Word>(value)};
             s.address += reloc;
             debug("Parsed segment: " + s.toString());
             segments.push_back(s);
             continue;
         }
-        // try to interpret as a variable (MUST come before routine parsing)
-        else if (!(match = Variable::stringMatch(line)).empty()) {
-            const string varname = match.str(1), segname = match.str(2), offstr = match.str(3), attr = match.str(4);
+        // try to interpret as a variable (MUST come before routine parsing): "name: segment VAR offset [attributes]"
+        sc = TextScanner{line};
+        if (sc.span(TextScanner::isName, name) && sc.literal(": ") && sc.span(TextScanner::isName, segname) && sc.literal(" VAR ") && sc.hex(value, 4)) {
             Segment varseg;
-            if ((varseg = findSegment(segname)).type == Segment::SEG_NONE) throw ParseError("Line " + to_string(lineno) + ": unknown segment '" + segname + "'");
-            Address varaddr{varseg.address, static_cast<Word>(stoi(offstr, nullptr, 16))};
-            Variable var{varname, varaddr};
-            if (!attr.empty()) {
-                istringstream sstr{attr};
-                string attr_val;
-                while (sstr >> attr_val) {
-                    if (attr_val == "external") var.external = true;
-                    else if (attr_val == "bss") var.bss = true;
-                    else throw ParseError("Line " + to_string(lineno) + ": invalid variable attribute: '" + attr_val + "'");
-                }
+            if ((varseg = findSegment(string{segname})).type == Segment::SEG_NONE) throw ParseError("Line " + to_string(lineno) + ": unknown segment '" + string{segname} + "'");
+            Variable var{string{name}, Address{varseg.address, static_cast<Word>(value)}};
+            for (string_view attr = sc.token(); !attr.empty(); attr = sc.token()) {
+                if (attr == "external") var.external = true;
+                else if (attr == "bss") var.bss = true;
+                else throw ParseError("Line " + to_string(lineno) + ": invalid variable attribute: '" + string{attr} + "'");
             }
             vars.push_back(var);
             continue;
         }
         // otherwise try interpreting as a routine description
-        istringstream sstr{line};
+        sc = TextScanner{line};
         Routine r;
         Segment rseg;
-        smatch match;
         int tokenno = 0;
-        string token;
-        while (sstr >> token) {
+        for (string_view token = sc.token(); !token.empty(); token = sc.token()) {
             BlockType bt = BLOCK_NONE;
             tokenno++;
-            if (token.empty()) continue;
             switch (tokenno) {
             case 1: // routine name
-                if (token.back() != ':') throw ParseError("Line " + to_string(lineno) + ": invalid routine name token syntax '" + token + "'");
+                if (token.back() != ':') throw ParseError("Line " + to_string(lineno) + ": invalid routine name token syntax '" + string{token} + "'");
                 r.name = token.substr(0, token.size() - 1);
                 break;
             case 2: // segment name
-                if ((rseg = findSegment(token)).type == Segment::SEG_NONE) throw ParseError("Line " + to_string(lineno) + ": unknown segment '" + token + "'");
+                if ((rseg = findSegment(string{token})).type == Segment::SEG_NONE) throw ParseError("Line " + to_string(lineno) + ": unknown segment '" + string{token} + "'");
                 break;
             case 3: // near or far
                 if (token == "NEAR") r.near = true;
                 else if (token == "FAR") r.near = false;
                 // Allow VAR type for variables (handled above) but still validate routine types
-                else if (token != "VAR") throw ParseError("Line " + to_string(lineno) + ": invalid routine type '" + token + "'");
+                else if (token != "VAR") throw ParseError("Line " + to_string(lineno) + ": invalid routine type '" + string{token} + "'");
                 break;
             case 4: // extents
                 bt = BLOCK_EXTENTS;
@@ -704,48 +855,52 @@ void CodeMap::loadFromMapFile(const std::string &path, const Word reloc) {
             default: // reachable and unreachable blocks follow
                 if (token.front() == 'R') bt = BLOCK_REACHABLE;
                 else if (token.front() == 'U') bt = BLOCK_UNREACHABLE;
-                // TODO: prevent illegal annotation combinations (e.g. external detached) in mapfile                
+                // TODO: prevent illegal annotation combinations (e.g. external detached) in mapfile
                 else if (token == "ignore") r.ignore = true;
                 else if (token == "complete") r.complete = true;
                 else if (token == "external") { r.ignore = true; r.external = true; }
                 else if (token == "detached") { r.ignore = true; r.detached = true; }
                 else if (token == "assembly") { r.assembly = true; }
                 else if (token == "duplicate") { r.duplicate = true; }
-                else throw ParseError("Line " + to_string(lineno) + ": invalid token: '" + token + "'");
-                token = token.substr(1, token.size() - 1);
+                else throw ParseError("Line " + to_string(lineno) + ": invalid token: '" + string{token} + "'");
+                token.remove_prefix(1);
                 break;
             }
             // nothing else to do
-            if (bt == BLOCK_NONE) continue; 
+            if (bt == BLOCK_NONE) continue;
             // otherwise process a block
-            if (!regex_match(token, match, RANGE_RE)) throw ParseError("Line " + to_string(lineno) + ": invalid routine block '" + token + "'");
-            Block block{Address{rseg.address, static_cast<Word>(stoi(match.str(1), nullptr, 16))}, 
-                        Address{rseg.address, static_cast<Word>(stoi(match.str(2), nullptr, 16))}};
+            Block block;
+            if (!parseRange(token, rseg.address, block)) throw ParseError("Line " + to_string(lineno) + ": invalid routine block '" + string{token} + "'");
             // check block for collisions agains rest of routines already in the map as well as the currently built routine
-            Routine colideRoutine = colidesBlock(block);
-            if (!colideRoutine.isValid() && r.colides(block, false)) 
+            const RoutineIdx owner = firstOwner(claimed, block);
+            Routine colideRoutine = owner != NULL_ROUTINE ? routines[owner - 1] : Routine{};
+            if (!colideRoutine.isValid() && r.colides(block, false))
                 colideRoutine = r;
             if (colideRoutine.isValid())
                 throw ParseError("Line "s + to_string(lineno) + ": block " + block.toString() + " colides with routine " + colideRoutine.dump(false));
             // add block to routine
             switch(bt) {
-            case BLOCK_EXTENTS: 
-                r.extents = block; 
+            case BLOCK_EXTENTS:
+                r.extents = block;
                 break;
-            case BLOCK_REACHABLE: 
-                r.reachable.push_back(block); 
+            case BLOCK_REACHABLE:
+                r.reachable.push_back(block);
                 break;
-            case BLOCK_UNREACHABLE: 
+            case BLOCK_UNREACHABLE:
                 r.unreachable.push_back(block);
                 break;
             default:
-                throw ParseError("Line " + to_string(lineno) + ": unexpected routine block type with '" + token + "'");
+                throw ParseError("Line " + to_string(lineno) + ": unexpected routine block type with '" + string{token} + "'");
             }
         } // iterate over tokens in a routine definition
         if (r.extents.isValid()) {
             debug("routine: "s + r.dump());
             r.idx = routines.size() + 1;
             routines.push_back(r);
+            const auto claim = [&](const Block &b) { if (b.isValid()) claimed.assign(b.begin.toLinear(), b.size(), r.idx); };
+            claim(r.extents);
+            for (const Block &b : r.reachable) claim(b);
+            for (const Block &b : r.unreachable) claim(b);
         }
         else throw ParseError("Line " + to_string(lineno) + ": invalid routine extents " + r.extents.toString());
     } // iterate over mapfile lines
@@ -753,63 +908,68 @@ void CodeMap::loadFromMapFile(const std::string &path, const Word reloc) {
     if (mapSize == 0) throw ParseError("Invalid or undefined map size");
 }
 
+// whitespace-separated words making up the whole line, leading whitespace allowed
+static bool matchWords(std::string_view line, std::initializer_list<std::string_view> words) {
+    TextScanner sc{line};
+    sc.space();
+    bool first = true;
+    for (const auto &w : words) {
+        if (!first && !sc.space()) return false;
+        if (!sc.literal(w)) return false;
+        first = false;
+    }
+    return sc.atEnd();
+}
+
 // construct code map from Microsoft LINK mapfile
 void CodeMap::loadFromLinkFile(const std::string &path, const Word reloc) {
     debug("Loading code map from linker mapfile " + path + ", relocation factor " + hexVal(reloc));
-    ifstream fstr{path};
-    string line;
+    const MappedFile linkFile{path};
+    TextScanner file{linkFile.text()};
+    string_view line;
     Size lineno = 0;
+    // entrypoints of the routines registered from public definitions
+    AddressSet publics, dataPublics;
     enum {
         LINKMAP_NONE,
         LINKMAP_SEGMENTS,
         LINKMAP_PUBLICS
     } mode = LINKMAP_NONE;
-    static const string 
-        HEXVAL_RE_STR{"([0-9A-F]+)"},
-        NAME_RE_STR{"([_$0-9A-Za-z]+)"},
-        SEGMENTS_RE_STR{"\\s*Start\\s+Stop\\s+Length\\s+Name\\s+Class"},
-        PUBLICS_RE_STR{"\\s*Address\\s+Publics by Name"},
-        PUBLVAL_RE_STR{"\\s*Address\\s+Publics by Value"},
-        SEGDEF_RE_STR{"\\s*" + HEXVAL_RE_STR + "H\\s+" + HEXVAL_RE_STR + "H\\s+" + HEXVAL_RE_STR + "H\\s+" + NAME_RE_STR + "\\s+" + NAME_RE_STR},
-        PUBDEF_RE_STR{"\\s*" + HEXVAL_RE_STR + ":" + HEXVAL_RE_STR + "\\s+" + NAME_RE_STR};
-    static const regex SEGMENTS_RE{SEGMENTS_RE_STR}, PUBLICS_RE{PUBLICS_RE_STR}, PUBVAL_RE{PUBLVAL_RE_STR}, SEGDEF_RE{SEGDEF_RE_STR}, PUBDEF_RE{PUBDEF_RE_STR};
-    vector<string> tokens;
     Size totalSize = 0;
-    while (safeGetline(fstr, line)) {
+    while (file.line(line)) {
         lineno++;
+        TextScanner sc{line};
+        Size start, stop, length, segment, offset;
+        string_view name, type;
+        // segment and public definitions are indented
+        sc.space();
         // switch into segment parsing mode
-        if (mode != LINKMAP_SEGMENTS && std::regex_match(line, SEGMENTS_RE)) {
+        if (mode != LINKMAP_SEGMENTS && matchWords(line, {"Start", "Stop", "Length", "Name", "Class"})) {
             PARSE_DEBUG("Segment definitions starting on line " + to_string(lineno));
-            mode = LINKMAP_SEGMENTS; 
+            mode = LINKMAP_SEGMENTS;
             continue;
         }
         // switch into public parsing mode
-        else if (mode != LINKMAP_PUBLICS && std::regex_match(line, PUBLICS_RE)) {
+        else if (mode != LINKMAP_PUBLICS && matchWords(line, {"Address", "Publics by Name"})) {
             PARSE_DEBUG("Public definitions starting on line " + to_string(lineno));
-            mode = LINKMAP_PUBLICS; 
+            mode = LINKMAP_PUBLICS;
             continue;
         }
         // switch back to no mode, ignore public values
-        else if (std::regex_match(line, PUBVAL_RE)) {
+        else if (matchWords(line, {"Address", "Publics by Value"})) {
             PARSE_DEBUG("Public values starting on line " + to_string(lineno));
             mode = LINKMAP_NONE;
             continue;
         }
-        // parse segment definition
-        else if (mode == LINKMAP_SEGMENTS && (tokens = extractRegex(SEGDEF_RE, line)).size() == 5) {
-            const Offset 
-                start = std::stoi(tokens[0], nullptr, 16), 
-                stop = std::stoi(tokens[1], nullptr, 16);
+        // parse segment definition: " startH stopH lengthH name class"
+        else if (mode == LINKMAP_SEGMENTS && sc.hex(start, SIZE_MAX, true) && sc.literal("H") && sc.space()
+            && sc.hex(stop, SIZE_MAX, true) && sc.literal("H") && sc.space() && sc.hex(length, SIZE_MAX, true) && sc.literal("H") && sc.space()
+            && sc.span(TextScanner::isNameOrDollar, name) && sc.space() && sc.span(TextScanner::isNameOrDollar, type) && sc.atEnd()) {
             if (start > stop) throw ParseError("Start offset above end offset for linkmap segment at line " + to_string(lineno));
-            const Size 
-                length = std::stoi(tokens[2]),
-                size = stop - start;
-            const string
-                name = tokens[3],
-                type = tokens[4];
+            const Size size = stop - start;
             const Word segAddr = OFFSET_TO_SEG(start);
-            PARSE_DEBUG("Segment definition on line " + to_string(lineno) + ": start " + hexVal(start) + " (addr " + hexVal(segAddr) + ")" ", stop " + hexVal(stop) + " (size " + hexVal(size) 
-                + "), length " + hexVal(length) + " name '" + name + "', type '" + type + "'");
+            PARSE_DEBUG("Segment definition on line " + to_string(lineno) + ": start " + hexVal(start) + " (addr " + hexVal(segAddr) + ")" ", stop " + hexVal(stop) + " (size " + hexVal(size)
+                + "), length " + hexVal(length) + " name '" + string{name} + "', type '" + string{type} + "'");
             if (stop > totalSize) totalSize = stop;
             const Segment existSeg = findSegment(segAddr);
             if (existSeg.type != Segment::SEG_NONE) {
@@ -818,44 +978,40 @@ void CodeMap::loadFromLinkFile(const std::string &path, const Word reloc) {
             }
             Segment::Type segType = Segment::SEG_NONE;
             if (type == "CODE") segType = Segment::SEG_CODE;
-            else if ((type.size() >= 3 && type.substr(0, 3) == "DAT") || type == "BSS" || type == "CONST" || type == "MP" || type == "FAR_DATA" || type == "FAR_BSS") segType = Segment::SEG_DATA;
+            else if (type.substr(0, 3) == "DAT" || type == "BSS" || type == "CONST" || type == "MP" || type == "FAR_DATA" || type == "FAR_BSS") segType = Segment::SEG_DATA;
             else {
-                PARSE_DEBUG("Ignoring segment of type '" + type + "'");
+                PARSE_DEBUG("Ignoring segment of type '" + string{type} + "'");
                 continue;
             }
-            segments.emplace_back(Segment{name, segType, segAddr});
+            segments.emplace_back(Segment{string{name}, segType, segAddr});
         }
-        // parse public definition
-        else if (mode == LINKMAP_PUBLICS && (tokens = extractRegex(PUBDEF_RE, line)).size() == 3) {
-            const Address addr{
-                static_cast<Word>(std::stoi(tokens[0], nullptr, 16)), 
-                static_cast<Word>(std::stoi(tokens[1], nullptr, 16))};
-            const string name = tokens[2];
-            PARSE_DEBUG("Public definition on line " + to_string(lineno) + ", addr " + addr.toString() + ", name '" + name + "'");
+        // parse public definition: " segment:offset name"
+        else if (mode == LINKMAP_PUBLICS && sc.hex(segment, SIZE_MAX, true) && sc.literal(":") && sc.hex(offset, SIZE_MAX, true)
+            && sc.space() && sc.span(TextScanner::isNameOrDollar, name) && sc.atEnd()) {
+            const Address addr{static_cast<Word>(segment), static_cast<Word>(offset)};
+            PARSE_DEBUG("Public definition on line " + to_string(lineno) + ", addr " + addr.toString() + ", name '" + string{name} + "'");
             Segment pubSeg = findSegment(addr.segment);
             if (pubSeg.type == Segment::SEG_NONE) {
-                PARSE_DEBUG("Unable to find segment at addr " + hexVal(addr.segment) + " for public " + name + ", ignoring");
+                PARSE_DEBUG("Unable to find segment at addr " + hexVal(addr.segment) + " for public " + string{name} + ", ignoring");
                 continue;
             }
             else if (pubSeg.type == Segment::SEG_CODE) {
                 PARSE_DEBUG("\tPublic belongs to code segment, attempting to register routine");
-                const Routine existRoutine = getRoutine(addr);
-                if (existRoutine.isValid()) {
-                    PARSE_DEBUG("Routine already exists at " + addr.toString() + ": " + existRoutine.toString() + ", ignoring");
+                if (!publics.insert(addr)) {
+                    PARSE_DEBUG("Routine already exists at " + addr.toString() + ", ignoring");
                     continue;
                 }
-                Routine r{name, Block{addr}};
+                Routine r{string{name}, Block{addr}};
                 r.idx = routineCount() + 1;
                 routines.push_back(r);
             }
             else if (pubSeg.type == Segment::SEG_DATA) {
                 PARSE_DEBUG("\tPublic belongs to data segment, attempting to register variable");
-                Variable existVar = getVariable(addr);
-                if (existVar.addr.isValid()) {
-                    PARSE_DEBUG("Variable already exists at " + addr.toString() + ": " + existVar.toString() + ", ignoring");
+                if (!dataPublics.insert(addr)) {
+                    PARSE_DEBUG("Variable already exists at " + addr.toString() + ", ignoring");
                     continue;
                 }
-                vars.emplace_back(Variable{name, addr});
+                vars.emplace_back(Variable{string{name}, addr});
             }
             else {
                 PARSE_DEBUG("Ignoring public not in code or data segment");
@@ -868,77 +1024,83 @@ void CodeMap::loadFromLinkFile(const std::string &path, const Word reloc) {
     debug("Finished parsing linker map file, map size: " + hexVal(mapSize) + ", segments: " + to_string(segments.size()));
 }
 
+// value of the "Loaded length: XXXXh" comment in an IDA listing line
+static bool findLoadedLength(std::string_view line, Size &length) {
+    static constexpr std::string_view LOAD_LEN{"Loaded length: "};
+    for (Size pos = line.find(LOAD_LEN); pos != string_view::npos; pos = line.find(LOAD_LEN, pos + 1)) {
+        TextScanner sc{line.substr(pos + LOAD_LEN.size())};
+        if (sc.hex(length) && sc.literal("h")) return true;
+    }
+    return false;
+}
+
 // create code map from IDA listing (.lst) file
 // TODO: add collision checks
 void CodeMap::loadFromIdaFile(const std::string &path, const Word reloc) {
-    static const string 
-        NAME_RE_STR{"[_a-zA-Z0-9]+"},
-        OFFSET_RE_STR{"[0-9a-fA-F]{1,4}"},
-        ADDR_RE_STR{"(" + NAME_RE_STR + "):(" + OFFSET_RE_STR + ")"},
-        LOAD_LEN_STR{"Loaded length: ([0-9a-fA-F]+)h"};
-    const regex ADDR_RE{ADDR_RE_STR}, LOAD_LEN_RE{LOAD_LEN_STR};
     debug("Loading IDA code map from "s + path + ", relocation factor " + hexVal(reloc));
     ida = true;
-    ifstream fstr{path};
-    string line;
+    const MappedFile idaFile{path};
+    TextScanner file{idaFile.text()};
+    string_view line;
     Size lineno = 0;
     Offset globalPos = 0;
     Word prevOffset = 0;
     Segment curSegment;
     Routine curProc;
-    while (safeGetline(fstr, line)) {
+    while (file.line(line)) {
         lineno++;
-        istringstream sstr{line};
+        TextScanner sc{line};
         // first on the line is always the address of the form segName:offset
-        string addrStr;
+        const string_view addrStr = sc.token();
         // ignore empty lines
-        if (!(sstr >> addrStr)) continue;
+        if (addrStr.empty()) continue;
         // next (optionally) is a segment/proc/label/data name
-        string nameStr;
+        const string_view nameStr = sc.token();
         // ignore lines with nothing after the address
-        if (!(sstr >> nameStr) || nameStr.empty()) continue;
+        if (nameStr.empty()) continue;
         // ignore comments except for the special case with the loaded length
         if (nameStr[0] == ';') {
-            smatch loadLenMatch;
-            if (mapSize == 0 && regex_search(line, loadLenMatch, LOAD_LEN_RE)) {
-                mapSize = static_cast<Size>(stoi(loadLenMatch.str(1), nullptr, 16));
+            Size loadLen;
+            if (mapSize == 0 && findLoadedLength(line, loadLen)) {
+                mapSize = loadLen;
                 PARSE_DEBUG("Extracted loaded length: " + hexVal(mapSize) + " from line " + to_string(lineno));
             }
             continue;
         }
         // split the address components
-        const auto addrParts = extractRegex(ADDR_RE, addrStr);
-        if (addrParts.size() != 2) throw ParseError("Unable to separate address components on line " + to_string(lineno));
-        const string segName = addrParts.front(), offsetStr = addrParts.back();
-        const Word offsetVal = static_cast<Word>(stoi(offsetStr, nullptr, 16));
-        PARSE_DEBUG("Line " + to_string(lineno) + ": seg=" + segName + ", off=" + hexVal(offsetVal) + ", name='" + nameStr + "', pos=" + hexVal(globalPos));
-        Address curAddr{curSegment.address, offsetVal};
+        TextScanner addrSc{addrStr};
+        string_view segName;
+        Size offsetNum;
+        if (!addrSc.span(TextScanner::isName, segName) || !addrSc.literal(":") || !addrSc.hex(offsetNum, 4) || !addrSc.atEnd())
+            throw ParseError("Unable to separate address components on line " + to_string(lineno));
+        const Word offsetVal = static_cast<Word>(offsetNum);
+        PARSE_DEBUG("Line " + to_string(lineno) + ": seg=" + string{segName} + ", off=" + hexVal(offsetVal) + ", name='" + string{nameStr} + "', pos=" + hexVal(globalPos));
         // the next token is going to determine the type of the line, e.g. proc/segment/var
-        string typeStr;
         // ignore lines with no type discriminator, likely an asm directive or a standalone label
-        if (!(sstr >> typeStr) || typeStr.empty()) continue;
+        string typeStr{sc.token()};
+        if (typeStr.empty()) continue;
         // force lowercase
-        std::transform(typeStr.begin(), typeStr.end(), typeStr.begin(), [](unsigned char c){ 
-            return std::tolower(c); 
+        std::transform(typeStr.begin(), typeStr.end(), typeStr.begin(), [](unsigned char c){
+            return std::tolower(c);
         });
         PARSE_DEBUG("\ttype: '" + typeStr + "'");
         // segment start
         if (typeStr == "segment") {
             if (curSegment.type != Segment::SEG_NONE) throw ParseError("New segment opening while previous segment " + curSegment.name + " still open on line " + to_string(lineno));
-            string alignStr, visStr, clsStr;
-            if (!(sstr >> alignStr >> visStr >> clsStr)) throw ParseError("Invalid segment definition on line " + to_string(lineno));
-            PARSE_DEBUG("\tsegment align=" + alignStr + ", vis=" + visStr + ", cls=" + clsStr);
+            const string_view alignStr = sc.token(), visStr = sc.token(), clsStr = sc.token();
+            if (clsStr.empty()) throw ParseError("Invalid segment definition on line " + to_string(lineno));
+            PARSE_DEBUG("\tsegment align=" + string{alignStr} + ", vis=" + string{visStr} + ", cls=" + string{clsStr});
             Segment::Type segType;
             if (clsStr == "'CODE'") segType = Segment::SEG_CODE;
             else if (clsStr == "'DATA'") segType = Segment::SEG_DATA;
             else if (clsStr == "'STACK'") segType = Segment::SEG_STACK;
-            else throw ParseError("Unrecognized segment class " + clsStr + " on line " + to_string(lineno));
+            else throw ParseError("Unrecognized segment class " + string{clsStr} + " on line " + to_string(lineno));
             // XXX: figuring out the exact position where the new segment starts from the IDA listing alone is hard to impossible - would need to keep a running count of data sizes from db/dup/struc etc. strings, and instruction sizes from asm mnemonics, which are ambiguous due to multiple possible encodings of some instructions. So this is going to be just a rough guess by padding the segment boundary up to paragraph size and the user will probably need to tweak segment addresses manually
             if (globalPos != 0) globalPos += PARAGRAPH_SIZE - (globalPos % PARAGRAPH_SIZE);
             Address segAddr{globalPos};
             segAddr.normalize();
             segAddr.segment += reloc;
-            curSegment = Segment{nameStr, segType, segAddr.segment};
+            curSegment = Segment{string{nameStr}, segType, segAddr.segment};
             PARSE_DEBUG("\tinitialized new segment at address " + hexVal(curSegment.address) + ", globalPos=" + hexVal(globalPos));
             prevOffset = 0;
         }
@@ -950,17 +1112,16 @@ void CodeMap::loadFromIdaFile(const std::string &path, const Word reloc) {
         }
         // routine start
         else if (typeStr == "proc") {
-            string procType;
-            sstr >> procType;
-            if (curProc.isValid()) throw ParseError("Opening new proc '" + nameStr + "' while previous '" + curProc.name + "' still open on line " + to_string(lineno));
-            curProc = Routine{nameStr, Block{Address{curSegment.address, offsetVal}}};
+            const string_view procType = sc.token();
+            if (curProc.isValid()) throw ParseError("Opening new proc '" + string{nameStr} + "' while previous '" + curProc.name + "' still open on line " + to_string(lineno));
+            curProc = Routine{string{nameStr}, Block{Address{curSegment.address, offsetVal}}};
             if (procType == "far") curProc.near = false;
             PARSE_DEBUG("Opened proc: " + curProc.toString());
         }
         // routine end
         else if (typeStr == "endp") {
-            if (!curProc.isValid()) throw ParseError("Closing proc '" + nameStr + "' without prior open on line " + to_string(lineno));
-            if (curProc.name != nameStr) throw ParseError("Closing proc '" + nameStr + "' while '" + curProc.name + "' open on line " + to_string(lineno));
+            if (!curProc.isValid()) throw ParseError("Closing proc '" + string{nameStr} + "' without prior open on line " + to_string(lineno));
+            if (curProc.name != nameStr) throw ParseError("Closing proc '" + string{nameStr} + "' while '" + curProc.name + "' open on line " + to_string(lineno));
             // XXX: likewise, this will be off due to IDA placing the endp on the same offset as the last instruction of the proc, whose length we do not know
             curProc.extents.end = Address{curSegment.address, offsetVal};
             routines.push_back(curProc);
@@ -969,7 +1130,7 @@ void CodeMap::loadFromIdaFile(const std::string &path, const Word reloc) {
         // simple data
         // TODO: support structs
         else if (typeStr == "db" || typeStr == "dw" || typeStr == "dd") {
-            vars.emplace_back(Variable{nameStr, Address{curSegment.address, offsetVal}});
+            vars.emplace_back(Variable{string{nameStr}, Address{curSegment.address, offsetVal}});
         }
 
         if (offsetVal < prevOffset) throw ParseError("Offsets going backwards (" + hexVal(prevOffset) + "->" + hexVal(offsetVal) + ") on line " + to_string(lineno));
@@ -14,11 +14,13 @@ using namespace std;
 OUTPUT_CONF(LOG_ANALYSIS)
 
 Executable::Executable(const MzImage &mz) : 
-    code(mz.loadSegment(), mz.loadModuleData(), mz.loadModuleSize()),
+    code(mz.loadModuleData(), mz.loadModuleData() + mz.loadModuleSize()),
     loadSegment(mz.loadSegment()),
+    codeBase(SEG_TO_OFFSET(loadSegment)),
     codeSize(mz.loadModuleSize()),
     stack(mz.stackPointer()),
-    origPath(mz.path())
+    origPath(mz.path()),
+    instrCacheHits(0), instrCacheMisses(0)
 {
     // relocate entrypoint
     setEntrypoint(mz.entrypoint());
@@ -26,10 +28,12 @@ Executable::Executable(const MzImage &mz) :
 }
 
 Executable::Executable(const Word loadSegment, const std::vector<Byte> &data) :
-    code(loadSegment, data.data(), data.size()),
+    code(data),
     loadSegment(loadSegment),
+    codeBase(SEG_TO_OFFSET(loadSegment)),
     codeSize(data.size()),
-    stack{}
+    stack{},
+    instrCacheHits(0), instrCacheMisses(0)
 {
     setEntrypoint({0, 0});
     init();
@@ -39,10 +43,16 @@ Executable::Executable(const Word loadSegment, const std::vector<Byte> &data) :
 void Executable::init() {
     if (codeSize == 0)
         throw ArgError("Code size is zero while constructing executable");
+    if (codeBase + codeSize > MEM_TOTAL)
+        throw ArgError("Load module of size " + sizeStr(codeSize) + " at " + hexVal(codeBase) + " exceeds the address space");
+    code.resize(codeSize + MEM_GUARD, 0);
     codeExtents = Block{{loadSegment, Word(0)}, Address(SEG_TO_OFFSET(loadSegment) + codeSize - 1)};
     storeSegment({"", Segment::SEG_CODE, ep.segment});
-    stack.relocate(loadSegment);
-    storeSegment({"", Segment::SEG_STACK, stack.segment});
+    // raw data loaded without an MZ header has no stack
+    if (stack.isValid()) {
+        stack.relocate(loadSegment);
+        storeSegment({"", Segment::SEG_STACK, stack.segment});
+    }
     debug("Loaded executable data into memory, code at "s + codeExtents.toString() + ", relocated entrypoint " + entrypoint().toString() + ", stack " + stack.toString());
 }
 
@@ -120,21 +130,129 @@ bool Executable::storeSegment(const Segment &seg) {
 }
 
 Address Executable::find(const ByteString &pattern, Block where) const {
-    if (!where.isValid()) where = { 
-        Address{loadSegment, 0}, 
-        Address{SEG_TO_OFFSET(loadSegment) + codeSize}
-    };
-    return code.find(pattern, where);
+    if (!where.isValid()) where = codeExtents;
+    if (where.size() < pattern.size()) {
+        debug("Block " + where.toString() + " too small to fit pattern of size " + to_string(pattern.size()));
+        return {};
+    }
+    // search only within the load module
+    const Offset start = std::max(where.begin.toLinear(), codeBase);
+    const Offset end = std::min(where.end.toLinear(), codeExtents.end.toLinear());
+    if (start > end) throw AddressError("Invalid search range: " + where.toString());
+    debug("Searching for pattern of size " + sizeStr(pattern.size()) + " within " + where.toString());
+    const Size searchSize = end - start + 1;
+    const Size found = findPattern(code.data() + (start - codeBase), searchSize, pattern);
+    if (found == searchSize) return {};
+    return Address{start + found};
+}
+
+// Translate a segmented address into a pointer into the load module. The end of the load module is a valid location
+// to point at, the instruction decoder may read from there into the guard zone.
+const Byte* Executable::codePointer(const Address &addr) const {
+    const Offset linear = addr.toLinear();
+    if (linear < codeBase || linear > codeBase + codeSize) 
+        throw AddressError("Address " + addr.toString() + " outside load module " + codeExtents.toString());
+    return code.data() + (linear - codeBase);
+}
+
+Word Executable::readWord(const Address &addr) const {
+    const Byte *p = codePointer(addr);
+    return p[0] | (p[1] << 8);
 }
 
 vector<Signature> Executable::getSignatures(const Block &range) const {
-    if (!range.isValid()) throw ArgError("Invalid block provided for signature extraction");
-    if (!range.singleSegment()) throw LogicError("Block boundaries reside in different segments for signature extraction");
-    vector<Signature> ret;
-    Instruction i;
-    for (Address a = range.begin; a <= range.end; a += i.length) {
-        i = Instruction{a, code.pointer(a)};
-        ret.push_back(i.signature());
+    InstructionArena arena;
+    const auto sigs = arena.signatures(decodeBlock(range, arena));
+    return { sigs.begin(), sigs.end() };
+}
+
+// Decode all instructions of a block and append them to the arena, returns where they were put. 
+InstructionArena::Span Executable::decodeBlock(const Block &range, InstructionArena &arena) const {
+    if (!range.isValid()) throw ArgError("Invalid block provided for decoding");
+    if (!range.singleSegment()) throw LogicError("Block boundaries reside in different segments for decoding");
+    const Size begin = arena.size();
+    for (Address a = range.begin; a <= range.end;) {
+        const Instruction &i = cachedInstruction(a);
+        arena.push(a.toLinear(), i);
+        a += i.length;
+    }
+    return { begin, arena.size() - begin };
+}
+
+// count the instructions in a range the same way getSignatures() walks it, but without decoding them
+Size Executable::instructionCount(const Block &range) const {
+    if (!range.isValid()) throw ArgError("Invalid block provided for instruction count");
+    if (!range.singleSegment()) throw LogicError("Block boundaries reside in different segments for instruction count");
+    Size ret = 0;
+    const Offset codeEnd = codeExtents.end.toLinear();
+    for (Address a = range.begin; a <= range.end; ++ret) {
+        const Size length = instructionLength(codePointer(a));
+        if (length == 0) throw CpuError("Invalid instruction at " + a.toString());
+        if (a.toLinear() + length - 1 > codeEnd) throw CpuError("Instruction at " + a.toString() + " truncated by the end of the load module");
+        a += length;
     }
     return ret;
 }
+
+// Obtain the instruction at the specified address. Every location is decoded only once, subsequent requests
+// for the same linear offset are served from the cache. Decoding errors are not cached, they propagate to the caller every time.
+// The decoder may run past the end of the load module into the guard zone, which is caught here by checking where the instruction ends.
+const Instruction& Executable::cachedInstruction(const Address &addr) const {
+    const Offset linear = addr.toLinear();
+    auto found = instrCache.find(linear);
+    if (found == instrCache.end()) {
+        instrCacheMisses++;
+        found = instrCache.emplace(linear, decodeInstruction(addr)).first;
+    }
+    else instrCacheHits++;
+    return found->second;
+}
+
+Instruction Executable::decodeInstruction(const Address &addr) const {
+    const Instruction instr{addr, codePointer(addr)};
+    if (addr.toLinear() + instr.length - 1 > codeExtents.end.toLinear())
+        throw CpuError("Instruction at " + addr.toString() + " truncated by the end of the load module");
+    return instr;
+}
+
+// store instructions decoded elsewhere, locations already present in the cache are left alone
+void Executable::cacheInstructions(const vector<Instruction> &instrs) {
+    for (const Instruction &i : instrs) instrCache.emplace(i.addr.toLinear(), i);
+}
+
+Instruction Executable::getInstruction(const Address &addr) const {
+    Instruction ret = cachedInstruction(addr);
+    // the same location can be reached through different segment:offset pairs, and the cache could have been filled 
+    // in a copy of this executable, so the address and the data pointer need to be refreshed
+    ret.addr = addr;
+    ret.data = code.data() + (addr.toLinear() - codeBase);
+    return ret;
+}
+
+string Executable::instructionCacheInfo() const {
+    const Size total = instrCacheHits + instrCacheMisses;
+    return "Instruction cache of " + origPath + ": " + to_string(instrCache.size()) + " decoded, " + to_string(instrCacheHits) + " hits, " 
+        + to_string(instrCacheMisses) + " misses (" + ratioStr(instrCacheHits, total) + " hit ratio)";
+}
+
+
+void InstructionArena::clear() {
+    offsets_.clear();
+    lengths_.clear();
+    keys_.clear();
+    signatures_.clear();
+}
+
+void InstructionArena::reserve(const Size count) {
+    offsets_.reserve(count);
+    lengths_.reserve(count);
+    keys_.reserve(count);
+    signatures_.reserve(count);
+}
+
+void InstructionArena::push(const Offset offset, const Instruction &i) {
+    offsets_.push_back(offset);
+    lengths_.push_back(i.length);
+    keys_.push_back(i.key);
+    signatures_.push_back(i.signature());
+}
\ No newline at end of file
@@ -3,9 +3,12 @@
 #include "dos/error.h"
 #include "dos/util.h"
 #include "dos/output.h"
+#include "dos/memory.h"
 
 #include <sstream>
 #include <cstring>
+#include <array>
+#include <algorithm>
 
 using namespace std;
 
@@ -36,7 +39,7 @@ MODRM_OPERAND
 #undef X
 
 // maps non-group opcodes to an instruction class
-static const InstructionClass OPCODE_CLASS[] = {
+static constexpr InstructionClass OPCODE_CLASS[] = {
 // 0           1           2           3           4           5           6           7           8           9           A             B           C           D           E           F
 INS_ADD,    INS_ADD,    INS_ADD,    INS_ADD,    INS_ADD,    INS_ADD,    INS_PUSH,   INS_POP,    INS_OR,     INS_OR,     INS_OR,       INS_OR,     INS_OR,     INS_OR,     INS_PUSH,   INS_ERR,    // 0
 INS_ADC,    INS_ADC,    INS_ADC,    INS_ADC,    INS_ADC,    INS_ADC,    INS_PUSH,   INS_POP,    INS_SBB,    INS_SBB,    INS_SBB,      INS_SBB,    INS_SBB,    INS_SBB,    INS_PUSH,   INS_POP,    // 1
@@ -57,7 +60,7 @@ INS_LOCK,   INS_ERR,    INS_REPNZ,  INS_REPZ,   INS_HLT,    INS_CMC,    INS_ERR,
 };
 
 // maps group opcodes to group indexes in the next table
-static const InstructionGroupIndex GRP_IDX[0x100] = {
+static constexpr InstructionGroupIndex GRP_IDX[0x100] = {
 //  0         1         2         3         4         5         6         7         8         9         A         B         C         D         E         F
 IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, // 0
 IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, // 1
@@ -78,7 +81,7 @@ IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_BAD, IGRP_3a,  IGRP_3b,
 };
 
 // maps a group index and the GRP value from a modrm byte to an instruction class for a group opcode
-static const InstructionClass GRP_INS_CLASS[6][8] = {
+static constexpr InstructionClass GRP_INS_CLASS[6][8] = {
     INS_ADD,  INS_OR,  INS_ADC,  INS_SBB,      INS_AND, INS_SUB,      INS_XOR,  INS_CMP,  // GRP1
     INS_ROL,  INS_ROR, INS_RCL,  INS_RCR,      INS_SHL, INS_SHR,      INS_ERR,  INS_SAR,  // GRP2
     INS_TEST, INS_ERR, INS_NOT,  INS_NEG,      INS_MUL, INS_IMUL,     INS_DIV,  INS_IDIV, // GRP3a
@@ -88,7 +91,7 @@ static const InstructionClass GRP_INS_CLASS[6][8] = {
 };
 
 // maps non-modrm opcodes into their first operand's type
-static const OperandType OP1_TYPE[] = {
+static constexpr OperandType OP1_TYPE[] = {
 //   0         1           2              3              4           5           6           7           8           9           A           B           C           D           E           F
 OPR_ERR,    OPR_ERR,    OPR_ERR,       OPR_ERR,       OPR_REG_AL, OPR_REG_AX, OPR_REG_ES, OPR_REG_ES, OPR_ERR,    OPR_ERR,    OPR_ERR,    OPR_ERR,    OPR_REG_AL, OPR_REG_AX, OPR_REG_CS, OPR_ERR,    // 0
 OPR_ERR,    OPR_ERR,    OPR_ERR,       OPR_ERR,       OPR_REG_AL, OPR_REG_AX, OPR_REG_SS, OPR_REG_SS, OPR_ERR,    OPR_ERR,    OPR_ERR,    OPR_ERR,    OPR_REG_AL, OPR_REG_AX, OPR_REG_DS, OPR_REG_DS, // 1
@@ -109,7 +112,7 @@ OPR_NONE,   OPR_NONE,   OPR_NONE,      OPR_NONE,      OPR_NONE,   OPR_NONE,   OP
 };
 
 // maps non-modrm opcodes into their second operand's type
-static const OperandType OP2_TYPE[] = {
+static constexpr OperandType OP2_TYPE[] = {
 //   0            1              2           3           4           5           6           7           8          9          A          B          C           D           E           F
 OPR_ERR,       OPR_ERR,       OPR_ERR,    OPR_ERR,    OPR_IMM8,   OPR_IMM16,  OPR_NONE,   OPR_NONE,   OPR_ERR,   OPR_ERR,   OPR_ERR,   OPR_ERR,   OPR_IMM8,   OPR_IMM16,  OPR_NONE,   OPR_ERR,    // 0
 OPR_ERR,       OPR_ERR,       OPR_ERR,    OPR_ERR,    OPR_IMM8,   OPR_IMM16,  OPR_NONE,   OPR_NONE,   OPR_ERR,   OPR_ERR,   OPR_ERR,   OPR_ERR,   OPR_IMM8,   OPR_IMM16,  OPR_NONE,   OPR_NONE,   // 1
@@ -130,7 +133,7 @@ OPR_NONE,      OPR_NONE,      OPR_NONE,   OPR_NONE,   OPR_NONE,   OPR_NONE,   OP
 };
 
 // map operand type to operand size
-static const OperandSize OPR_SIZE[] = {
+static constexpr OperandSize OPR_SIZE[] = {
     OPRSZ_UNK,  OPRSZ_NONE, // error, none
     OPRSZ_WORD, OPRSZ_BYTE, OPRSZ_BYTE, // ax, al, ah
     OPRSZ_WORD, OPRSZ_BYTE, OPRSZ_BYTE, // bx, bl, bh
@@ -150,7 +153,7 @@ static const OperandSize OPR_SIZE[] = {
 };
 
 // map modrm operand type to operand size
-static const OperandSize MODRM_OPR_SIZE[] = {
+static constexpr OperandSize MODRM_OPR_SIZE[] = {
     OPRSZ_NONE,  // MODRM_NONE
     OPRSZ_BYTE,  // MODRM_Eb
     OPRSZ_BYTE,  // MODRM_Gb
@@ -165,6 +168,122 @@ static const OperandSize MODRM_OPR_SIZE[] = {
     OPRSZ_BYTE,  // MODRM_CL
 };
 
+// the way an instruction is decoded based on its opcode
+enum OpcodeKind : Byte {
+    OPK_REGULAR,      // operands implied by the opcode
+    OPK_MODRM,        // operands described by a ModR/M byte following the opcode
+    OPK_GROUP,        // like above, but the ModR/M byte also selects the instruction from a group
+    OPK_PREFIX_SEG,   // segment override prefix
+    OPK_PREFIX_CHAIN, // repz/repnz prefix
+};
+
+// Everything needed to decode an instruction by its opcode, assembled at compile time from the tables above.
+// The length is the number of bytes in the opcode, the ModR/M byte and the immediate values, but not the prefix or the ModR/M displacement.
+// For group opcodes the immediate depends on the instruction selected by the ModR/M byte, so it is accounted for in the group descriptor.
+// A zero length marks an opcode that does not decode into a valid instruction.
+struct OpcodeDescriptor {
+    OpcodeKind kind;
+    InstructionClass iclass;
+    InstructionGroupIndex grpIdx;
+    OperandType op1type, op2type;
+    ModrmOperand modop1, modop2;
+    OperandSize op1size, op2size;
+    Byte immLength, length;
+};
+
+// group instruction selected by the GRP value of the ModR/M byte, with the operand quirks of some groups already applied
+struct GroupDescriptor {
+    InstructionClass iclass;
+    ModrmOperand modop1, modop2;
+    OperandSize op1size, op2size;
+    Byte immLength;
+};
+
+// size of the immediate value which directly follows a non-modrm opcode for an operand type
+static constexpr Byte operandImmLength(const OperandType ot) {
+    if (ot == OPR_IMM8 || operandIsMemWithByteOffset(ot)) return sizeof(Byte);
+    else if (ot == OPR_IMM16 || operandIsMemWithWordOffset(ot)) return sizeof(Word);
+    else if (ot == OPR_IMM32) return sizeof(DWord);
+    return 0;
+}
+
+// size of the immediate value which follows the ModR/M byte (and displacement) for a modrm operand
+static constexpr Byte modrmImmLength(const ModrmOperand mo) {
+    switch (mo) {
+    case MODRM_Ib: return sizeof(Byte);
+    case MODRM_Iv: return sizeof(Word);
+    default: return 0;
+    }
+}
+
+static constexpr std::array<OpcodeDescriptor, 0x100> buildOpcodeDescriptors() {
+    std::array<OpcodeDescriptor, 0x100> ret{};
+    for (int opcode = 0; opcode < 0x100; ++opcode) {
+        OpcodeDescriptor &d = ret[opcode];
+        d.iclass = OPCODE_CLASS[opcode];
+        d.grpIdx = GRP_IDX[opcode];
+        d.op1type = OP1_TYPE[opcode];
+        d.op2type = OP2_TYPE[opcode];
+        d.modop1 = MODRM_OP1[opcode];
+        d.modop2 = MODRM_OP2[opcode];
+        if (opcode == OP_REPNZ || opcode == OP_REPZ) d.kind = OPK_PREFIX_CHAIN;
+        else if (opcode == OP_PREFIX_ES || opcode == OP_PREFIX_CS || opcode == OP_PREFIX_SS || opcode == OP_PREFIX_DS) d.kind = OPK_PREFIX_SEG;
+        else if (d.grpIdx != IGRP_BAD) d.kind = OPK_GROUP;
+        else if (d.modop1 != MODRM_NONE) d.kind = OPK_MODRM;
+        else d.kind = OPK_REGULAR;
+
+        switch (d.kind) {
+        case OPK_MODRM:
+            d.op1size = MODRM_OPR_SIZE[d.modop1];
+            d.op2size = MODRM_OPR_SIZE[d.modop2];
+            d.immLength = modrmImmLength(d.modop1) + modrmImmLength(d.modop2);
+            d.length = d.iclass == INS_ERR ? 0 : 2 + d.immLength;
+            break;
+        case OPK_GROUP:
+            d.length = 2;
+            break;
+        default:
+            // prefixes are also described as regular opcodes, for the case of one following another
+            d.op1size = OPR_SIZE[d.op1type];
+            d.op2size = OPR_SIZE[d.op2type];
+            // temporary stopgap, derive unknown 1st op's size from 2nd op if possible
+            if (d.op1size == OPRSZ_UNK && operandIsMem(d.op1type) && operandIsImmediate(d.op2type))
+                d.op1size = d.op2size;
+            d.immLength = operandImmLength(d.op1type) + operandImmLength(d.op2type);
+            d.length = (d.op1type == OPR_ERR || d.op2type == OPR_ERR) ? 0 : 1 + d.immLength;
+            break;
+        }
+    }
+    return ret;
+}
+
+static constexpr std::array<std::array<GroupDescriptor, 8>, 0x100> buildGroupDescriptors() {
+    std::array<std::array<GroupDescriptor, 8>, 0x100> ret{};
+    for (int opcode = 0; opcode < 0x100; ++opcode) {
+        const InstructionGroupIndex grpIdx = GRP_IDX[opcode];
+        if (grpIdx == IGRP_BAD) continue;
+        for (int grpInstrIdx = 0; grpInstrIdx < 8; ++grpInstrIdx) {
+            GroupDescriptor &g = ret[opcode][grpInstrIdx];
+            g.iclass = GRP_INS_CLASS[grpIdx][grpInstrIdx];
+            g.modop1 = MODRM_OP1[opcode];
+            g.modop2 = MODRM_OP2[opcode];
+            // special case for implicit 2nd operand for group 3a/3b TEST instruction
+            if (g.iclass == INS_TEST) g.modop2 = grpIdx == IGRP_3a ? MODRM_Ib : MODRM_Iv;
+            // another special case for operand override in group 5 far call and jmp instructions
+            else if (g.iclass == INS_CALL_FAR || g.iclass == INS_JMP_FAR) g.modop1 = MODRM_Mp;
+            g.op1size = MODRM_OPR_SIZE[g.modop1];
+            g.op2size = MODRM_OPR_SIZE[g.modop2];
+            g.immLength = modrmImmLength(g.modop1) + modrmImmLength(g.modop2);
+        }
+    }
+    return ret;
+}
+
+static constexpr auto OPCODE_DESC = buildOpcodeDescriptors();
+static constexpr auto GROUP_DESC = buildGroupDescriptors();
+static_assert(OPCODE_DESC[OP_MOV_AX_Iv].length == 3 && OPCODE_DESC[OP_CALL_Ap].length == 5 && OPCODE_DESC[OP_MOV_Ev_Iv].length == 4);
+static_assert(OPCODE_DESC[OP_GRP3b_Ev].kind == OPK_GROUP && GROUP_DESC[OP_GRP3b_Ev][0].iclass == INS_TEST && GROUP_DESC[OP_GRP3b_Ev][0].immLength == 2);
+
 static const char* INS_NAME[] = {
     "???", "add", "push", "pop", "or", "adc", "sbb", "and", "daa", "sub", "das", "xor", "aaa", "cmp", "aas", "inc", "dec", "jmp", "jmp if", "jmp far", "test", "xchg", "mov", "lea", "nop", "cbw", "cwd",
     "call", "call far", "wait", "pushf", "popf", "sahf", "lahf", "movsb", "movsw", "cmpsb", "cmpsw", "stosb", "stosw", "lodsb", "lodsw", "scasb", "scasw", "ret", "les", "lds", "retf", "int",
@@ -262,117 +381,83 @@ Register defaultMemSegment(const OperandType ot) {
     return ret;
 }
 
-Instruction::Instruction() : addr{}, prefix(PRF_NONE), opcode(OP_INVALID), iclass(INS_ERR), length(0), data(nullptr) {
+Instruction::Instruction() : addr{}, prefix(PRF_NONE), opcode(OP_INVALID), iclass(INS_ERR), length(0), data(nullptr), key(0), value(0) {
+    // no operands, placeholders for missing instructions get rendered in comparisons
+    op1 = op2 = Operand{OPR_NONE, OPRSZ_NONE, OPRSZ_NONE, {0}};
 }
 
-Instruction::Instruction(const Address &addr, const Byte *data) : addr{addr}, prefix(PRF_NONE), opcode(OP_INVALID), iclass(INS_ERR), length(0) {
+Instruction::Instruction(const Address &addr, const Byte *data) : addr{addr}, prefix(PRF_NONE), opcode(OP_INVALID), iclass(INS_ERR), length(0), key(0), value(0) {
+    // the decoder only fills the part of immval matching the operand size, the rest must not be left over from whatever was on the stack
+    op1 = op2 = Operand{OPR_NONE, OPRSZ_NONE, OPRSZ_NONE, {0}};
     load(data);
 }
 
+// Decodes without any bounds checking, the code buffers are padded with a guard zone (MEM_GUARD) long enough for any encoding,
+// and it is up to the owner of the buffer to check whether the decoded instruction ends past the data.
 void Instruction::load(const Byte *data)  {
     this->data = data;
     opcode = *data++;
     length++;
+    const OpcodeDescriptor *desc = &OPCODE_DESC[opcode];
     // in case of a chain opcode, use it to set an appropriate prefix value and replace the opcode with the subsequent instruction
     // TODO: support LOCK, other prefix-like opcodes?
-    if (opcode == OP_REPZ || opcode == OP_REPNZ) { 
+    if (desc->kind == OPK_PREFIX_CHAIN) { 
         prefix = static_cast<InstructionPrefix>(opcode - OP_REPNZ + PRF_CHAIN_REPNZ); // convert opcode to instruction prefix enum
-        // TODO: guard against memory overflow
         opcode = *data++;
         length++;
-        debug("Found chain prefix "s + INS_PRF_ID[prefix] + ", length = " + to_string(length));
+        desc = &OPCODE_DESC[opcode];
     }
     // likewise in case of a segment ovverride prefix, set instruction prefix value and get next opcode
-    else if (opcodeIsSegmentPrefix(opcode)) {
+    else if (desc->kind == OPK_PREFIX_SEG) {
         prefix = static_cast<InstructionPrefix>(((opcode - OP_PREFIX_ES) / 8) + PRF_SEG_ES); // convert opcode to instruction prefix enum, the segment prefix opcode values differ by 8
         opcode = *data++;
         length++;
-        debug("Found segment prefix "s + INS_PRF_ID[prefix] + ", length = " + to_string(length));
+        desc = &OPCODE_DESC[opcode];
     }
 
-    // regular instruction opcode
-    if (!opcodeIsModrm(opcode)) {
-        iclass = instr_class(opcode);
-        // get type of operands
-        op1.type = OP1_TYPE[opcode];
-        op2.type = OP2_TYPE[opcode];
-        debug("regular opcode "s + opcodeName(opcode) + ", operand types: op1 = "s + OPR_TYPE_ID[op1.type] + ", op2 = " + OPR_TYPE_ID[op2.type] 
-            + ", class " + INS_CLASS_ID[iclass]);
-        // TODO: do not derive size from operand type, but from opcode, same for modrm and group
-        op1.size = OPR_SIZE[op1.type];
-        op2.size = OPR_SIZE[op2.type];
-        // temporary stopgap, derive unknown 1st op's size from 2nd op if possible
-        if (op1.size == OPRSZ_UNK && operandIsMem(op1.type) && operandIsImmediate(op2.type))
-            op1.size = op2.size;
-
-    }
+    switch (desc->kind) {
     // modr/m insruction opcode
-    else if (!opcodeIsGroup(opcode)) {
+    case OPK_MODRM: {
         const Byte modrm = *data++; // load modrm byte
         length++;
-        const ModrmOperand 
-            modop1 = modrm_op1(opcode),
-            modop2 = modrm_op2(opcode);
-        iclass = instr_class(opcode);
+        iclass = desc->iclass;
         if (iclass == INS_ERR)
             throw CpuError("Invalid instruction (opcode: " + hexVal(opcode) + " at " + addr.toString());        
-        debug("modrm opcode "s + opcodeName(opcode) + ", modrm = " + hexVal(modrm) + ", operand types: op1 = "s + MODRM_OPR_ID[modop1] + ", op2 = " + MODRM_OPR_ID[modop2] 
-            + ", class " + INS_CLASS_ID[iclass]);
         // convert from messy modrm operand designation to our nice type
-        op1.type = getModrmOperand(modrm, modop1);
-        op2.type = getModrmOperand(modrm, modop2);
-        op1.size = MODRM_OPR_SIZE[modop1];
-        op2.size = MODRM_OPR_SIZE[modop2];
+        op1.type = getModrmOperand(modrm, desc->modop1);
+        op2.type = getModrmOperand(modrm, desc->modop2);
+        op1.size = desc->op1size;
+        op2.size = desc->op2size;
+        break;
     }
-    // group instruction opcode
-    else {
-        if (!opcodeIsGroup(opcode))
-            throw CpuError("Opcode is not group: " + hexVal(opcode) + " at " + addr.toString());
+    // group instruction opcode, the rest is just like a "normal" modrm opcode once the instruction is selected from the group
+    case OPK_GROUP: {
         const Byte modrm = *data++; // load modrm byte
         length++;
-        // obtain index of group for instruction class lookup
-        const InstructionGroupIndex grpIdx = GRP_IDX[opcode];
         const Byte grpInstrIdx = modrm_grp(modrm) >> MODRM_GRP_SHIFT;
-        debug("group opcode "s + opcodeName(opcode) + ", modrm = " + hexVal(modrm) + ", group index " + GRP_IDX_ID[grpIdx] + ", instruction " + hexVal(grpInstrIdx));
-        if (grpIdx < IGRP_1 || grpIdx > IGRP_5)
-            throw CpuError("Group index out of range: " + to_string(grpIdx) + " at " + addr.toString());
-        // groups have up to 8 instructions (index 0-based)
-        if (grpInstrIdx >= 8)
-            throw CpuError("Group Instruction index out of range: " + to_string(grpInstrIdx) + " at " + addr.toString());
-        // determine instruction class
-        iclass = GRP_INS_CLASS[grpIdx][grpInstrIdx];
+        const GroupDescriptor &grp = GROUP_DESC[opcode][grpInstrIdx];
+        iclass = grp.iclass;
         if (iclass == INS_ERR)
-            throw CpuError("Invalid group instruction (group: " + to_string(grpIdx) + ", index: " + to_string(grpInstrIdx) + ") at " + addr.toString());
-        // the rest is just like a "normal" modrm opcode
-        ModrmOperand 
-            modop1 = modrm_op1(opcode),
-            modop2 = modrm_op2(opcode);
-        // special case for implicit 2nd operand for group 3a/3b TEST instruction
-        if (iclass == INS_TEST) {
-            switch(grpIdx) {
-            case IGRP_3a: modop2 = MODRM_Ib; break;
-            case IGRP_3b: modop2 = MODRM_Iv; break;
-            default:
-                throw CpuError("Invalid group index for TEST opcode at " + addr.toString());
-            }
-        }
-        // another special case for operand override in group 5 far call and jmp instructions
-        else if (iclass == INS_CALL_FAR || iclass == INS_JMP_FAR) {
-            if (grpIdx != IGRP_5)
-                throw CpuError("Unexpected group index for far call/jump instruction: " + to_string(grpIdx) + " at " + addr.toString());
-            modop1 = MODRM_Mp;
-        }
-        debug("modrm operand types: op1 = "s + MODRM_OPR_ID[modop1] + ", op2 = " + MODRM_OPR_ID[modop2] + ", class " + INS_CLASS_ID[iclass]);
-        // convert from messy modrm operand designation to our nice type
-        op1.type = getModrmOperand(modrm, modop1);
-        op2.type = getModrmOperand(modrm, modop2);
-        op1.size = MODRM_OPR_SIZE[modop1];
-        op2.size = MODRM_OPR_SIZE[modop2];
+            throw CpuError("Invalid group instruction (group: " + to_string(desc->grpIdx) + ", index: " + to_string(grpInstrIdx) + ") at " + addr.toString());
+        op1.type = getModrmOperand(modrm, grp.modop1);
+        op2.type = getModrmOperand(modrm, grp.modop2);
+        op1.size = grp.op1size;
+        op2.size = grp.op2size;
+        break;
+    }
+    // regular instruction opcode, also a prefix following another prefix
+    default:
+        iclass = desc->iclass;
+        op1.type = desc->op1type;
+        op2.type = desc->op2type;
+        // TODO: do not derive size from operand type, but from opcode, same for modrm and group
+        op1.size = desc->op1size;
+        op2.size = desc->op2size;
+        break;
     }
 
     if (op1.type == OPR_ERR || op2.type == OPR_ERR)
         throw CpuError("Error parsing instruction operand(s) at " + addr.toString());
-    debug("generalized operands, op1: type = "s + OPR_TYPE_ID[op1.type] + ", size = " + OPR_SIZE_ID[op1.size] + ", op2: type = " + OPR_TYPE_ID[op2.type] + ", size = " + OPR_SIZE_ID[op2.size]);
     // load immediate values if present
     Size immSize = loadImmediate(op1, data);
     data += immSize;
@@ -380,9 +465,73 @@ void Instruction::load(const Byte *data)  {
     immSize = loadImmediate(op2, data);
     data += immSize;
     length += immSize;
-    debug("Instruction @" + addr.toString() + ": " + toString() + ", length = " + to_string(length));
+    canonicalize();
+}
+
+// number of displacement bytes encoded after a ModR/M byte for memory operands
+static constexpr Byte modrmDisplacementLength(const Byte modrm) {
+    switch (modrm & MODRM_MOD_MASK) {
+    case MODRM_MOD_NODISP: return (modrm & MODRM_MEM_MASK) == MODRM_MEM_ADDR ? sizeof(Word) : 0;
+    case MODRM_MOD_DISP8:  return sizeof(Byte);
+    case MODRM_MOD_DISP16: return sizeof(Word);
+    default: return 0;
+    }
+}
+
+// mirrors the cases where getModrmOperand() yields an error: memory-only operands with a register ModR/M and invalid segment registers
+static constexpr bool modrmOperandValid(const Byte modrm, const ModrmOperand op) {
+    if ((op == MODRM_M || op == MODRM_Mp) && (modrm & MODRM_MOD_MASK) == MODRM_MOD_REG) return false;
+    if (op == MODRM_Sw && (modrm & MODRM_REG_MASK) > MODRM_REG_DS) return false;
+    return true;
 }
 
+// Calculate the length of the instruction at the provided location without decoding its operands, for when all that is needed
+// is where the next instruction starts. Returns 0 in every case where constructing an Instruction would throw.
+Size instructionLength(const Byte *data) {
+    Size prefixLength = 0;
+    const OpcodeDescriptor *desc = &OPCODE_DESC[data[0]];
+    if (desc->kind == OPK_PREFIX_CHAIN || desc->kind == OPK_PREFIX_SEG) {
+        prefixLength = 1;
+        desc = &OPCODE_DESC[data[1]];
+    }
+    switch (desc->kind) {
+    case OPK_MODRM: {
+        const Byte modrm = data[prefixLength + 1];
+        if (desc->length == 0 || !modrmOperandValid(modrm, desc->modop1) || !modrmOperandValid(modrm, desc->modop2)) return 0;
+        return prefixLength + desc->length + modrmDisplacementLength(modrm);
+    }
+    case OPK_GROUP: {
+        const Byte modrm = data[prefixLength + 1];
+        const GroupDescriptor &grp = GROUP_DESC[data[prefixLength]][modrm_grp(modrm) >> MODRM_GRP_SHIFT];
+        if (grp.iclass == INS_ERR || !modrmOperandValid(modrm, grp.modop1) || !modrmOperandValid(modrm, grp.modop2)) return 0;
+        return prefixLength + desc->length + modrmDisplacementLength(modrm) + grp.immLength;
+    }
+    default:
+        if (desc->length == 0) return 0;
+        return prefixLength + desc->length;
+    }
+}
+
+// longest encoding the decoder can consume, a prefix followed by an opcode with a 16bit displacement and the biggest immediate
+static constexpr Size longestEncoding() {
+    Size ret = 0;
+    for (Size opcode = 0; opcode < OPCODE_DESC.size(); ++opcode) {
+        const OpcodeDescriptor &desc = OPCODE_DESC[opcode];
+        Size length = desc.length;
+        if (desc.kind == OPK_MODRM) length += sizeof(Word);
+        else if (desc.kind == OPK_GROUP) {
+            Size immLength = 0;
+            for (const GroupDescriptor &grp : GROUP_DESC[opcode]) immLength = std::max<Size>(immLength, grp.immLength);
+            length += sizeof(Word) + immLength;
+        }
+        ret = std::max(ret, 1 + length);
+    }
+    return ret;
+}
+static_assert(longestEncoding() == INSTRUCTION_MAX_LENGTH);
+// the decoder does no bounds checking, it relies on code buffers being padded
+static_assert(INSTRUCTION_MAX_LENGTH <= MEM_GUARD);
+
 // calculate an absolute offset from an offset that is relative to this instruction's end, based on the immediate operand 
 // - this is useful for branch instructions like call and the various jumps, whose operand is the number of bytes to jump forward or back, 
 // relative to the byte past the instruction
@@ -525,29 +674,33 @@ Register Instruction::memSegmentId() const {
 }
 
 std::string Instruction::Operand::toString() const {
-    ostringstream str;
+    char buf[INSTRUCTION_STRLEN];
+    FormatBuffer str{buf, sizeof(buf)};
+    render(str);
+    return str.str();
+}
+
+void Instruction::Operand::render(FormatBuffer &out) const {
     if (operandIsReg(type))
-        str << OPR_NAME[type];
+        out.put(OPR_NAME[type]);
     else if (operandIsMemNoOffset(type))
-        str << "[" << OPR_NAME[type] << "]";
+        out.put('[').put(OPR_NAME[type]).put(']');
     else if (operandIsMemWithByteOffset(type)) {
-        if (type == OPR_MEM_OFF8) str << "[" << hexVal(immval.u8, true, false)  << "]";
-        else str << "[" << OPR_NAME[type] << signedHexVal(static_cast<SByte>(immval.u8)) << "]";
+        if (type == OPR_MEM_OFF8) out.put('[').hex(immval.u8).put(']');
+        else out.put('[').put(OPR_NAME[type]).signedHex(static_cast<SByte>(immval.u8), 2).put(']');
     }
     else if (operandIsMemWithWordOffset(type)) {
-        if (type == OPR_MEM_OFF16) str << "[" << hexVal(immval.u16, true, false) << "]";
-        else str << "[" << OPR_NAME[type] << signedHexVal(static_cast<SWord>(immval.u16)) << "]";
+        if (type == OPR_MEM_OFF16) out.put('[').hex(immval.u16).put(']');
+        else out.put('[').put(OPR_NAME[type]).signedHex(static_cast<SWord>(immval.u16), 4).put(']');
     }
     else if (type == OPR_IMM0 || type == OPR_IMM1)
-        str << OPR_NAME[type];
+        out.put(OPR_NAME[type]);
     else if (type == OPR_IMM8)
-        str << hexVal(immval.u8, true, false);
+        out.hex(immval.u8);
     else if (type == OPR_IMM16)
-        str << hexVal(immval.u16, true, false);
+        out.hex(immval.u16);
     else if (type == OPR_IMM32)
-        str << hexVal(immval.u32, true, false);
-
-    return str.str();
+        out.hex(immval.u32);
 }
 
 InstructionMatch Instruction::Operand::match(const Operand &other) const {
@@ -559,7 +712,7 @@ InstructionMatch Instruction::Operand::match(const Operand &other) const {
         // of the subject memory object, which is handled as a mismatch above.
         if (operandTypeToWord(type) == operandTypeToWord(other.type)) {
             // compare offset/immediate values
-            if (wordValue() == other.wordValue()) return INS_MATCH_FULL;
+            if (canonicalValue() == other.canonicalValue()) return INS_MATCH_FULL;
             else return INS_MATCH_DIFF;
         }
         else return INS_MATCH_MISMATCH;
@@ -581,10 +734,16 @@ InstructionMatch Instruction::Operand::match(const Operand &other) const {
 }
 
 std::string Instruction::toString(const bool extended) const {
-    ostringstream str;
+    char buf[INSTRUCTION_STRLEN];
+    FormatBuffer str{buf, sizeof(buf)};
+    render(str, extended);
+    return str.str();
+}
+
+void Instruction::render(FormatBuffer &out, const bool extended) const {
     // output chain prefix if present
     if (prefix > PRF_SEG_DS)
-        str << PRF_NAME[prefix] << " ";
+        out.put(PRF_NAME[prefix]).put(' ');
     
     // output instruction name
     // conditional jumps, lookup specific jump name
@@ -592,60 +751,58 @@ std::string Instruction::toString(const bool extended) const {
         Byte idx = opcode - OP_JO_Jb;
         // jcxz special case
         if (idx >= JMP_NAME_COUNT) idx = JMP_NAME_COUNT - 1;
-        str << JMP_NAME[idx];
+        out.put(JMP_NAME[idx]);
     }
     // otherwise just output name corresponding to instruction class
     else {
-        str << INS_NAME[iclass];
+        out.put(INS_NAME[iclass]);
     }
     // special extra label for short jump opcode
-    if (opcode == OP_JMP_Jb) str << " short";
+    if (opcode == OP_JMP_Jb) out.put(" short");
 
     // output operands
     if (op1.type != OPR_NONE) {
-        str << " ";
+        out.put(' ');
         // show size prefix if not implicit from operands
         if ((operandIsMem(op1.type) && operandIsImmediate(op2.type)) || opcode == OP_POP_Ev) {
             OperandSize immSize = op1.size;
             if (immSize == OPRSZ_UNK) immSize = op2.size;
             switch(immSize) {
-            case OPRSZ_BYTE:  str << "byte ";  break;
-            case OPRSZ_WORD:  str << "word ";  break;
-            case OPRSZ_DWORD: str << "dword "; break;
+            case OPRSZ_BYTE:  out.put("byte ");  break;
+            case OPRSZ_WORD:  out.put("word ");  break;
+            case OPRSZ_DWORD: out.put("dword "); break;
             default:
                 throw CpuError("unexpected immediate operand size: "s + OPR_SIZE_ID[immSize]);
             }
         }
         // segment override prefix if present
         if (prefix > PRF_NONE && prefix < PRF_CHAIN_REPNZ && operandIsMem(op1.type))
-            str << PRF_NAME[prefix];
+            out.put(PRF_NAME[prefix]);
         // for near branch instructions (call, jump, loop), the immediate relative offset operand is added to the address 
         // of the byte past the current instruction to form an absolute offset
         if (isNearBranch() && operandIsImmediate(op1.type)) {
             const Word aoff = absoluteOffset();
             const Word endAddr = addr.offset + length;
-            str << hexVal(aoff, true, false);
+            out.hex(aoff);
             if (extended) {
                 if (aoff < endAddr) {
-                    str << " (" << hexVal(static_cast<Word>(endAddr - aoff), true, false) << " up)";
+                    out.put(" (").hex(static_cast<Word>(endAddr - aoff)).put(" up)");
                 } else {
-                    str << " (" << hexVal(static_cast<Word>(aoff - endAddr), true, false) << " down)";
+                    out.put(" (").hex(static_cast<Word>(aoff - endAddr)).put(" down)");
                 }
             }
         }
         else {
-            str << op1.toString();
+            op1.render(out);
         }
     }
     if (op2.type != OPR_NONE) {
-        str << ", ";
+        out.put(", ");
         // segment override prefix if present
         if (prefix > PRF_NONE && prefix < PRF_CHAIN_REPNZ && operandIsMem(op2.type))
-            str << PRF_NAME[prefix];
-        str << op2.toString();
+            out.put(PRF_NAME[prefix]);
+        op2.render(out);
     }
-
-    return str.str();
 }
 
 // create a search pattern from the instruction's encoding bytes; i.e. the binary data of the instruction with any offsets and immediates replaced with placeholder values
@@ -668,64 +825,62 @@ ByteString Instruction::pattern() const {
     return ret;
 }
 
+// layout of the canonical instruction key, from the least significant bit:
+// |op2size|op1size|opcode|op2type|op1type|class|prefix|
+//  3b      3b      8b     6b      6b      7b    3b
+// The operand types are ambiguated to their word equivalents and the opcode is only stored for conditional jumps,
+// so instructions which only differ in the encoding of the same operation produce equal keys.
+static constexpr int 
+    KEY_OP2SIZE_SHIFT = 0,
+    KEY_OP1SIZE_SHIFT = KEY_OP2SIZE_SHIFT + 3,
+    KEY_OPCODE_SHIFT = KEY_OP1SIZE_SHIFT + 3,
+    KEY_OP2TYPE_SHIFT = KEY_OPCODE_SHIFT + 8,
+    KEY_OP1TYPE_SHIFT = KEY_OP2TYPE_SHIFT + 6,
+    KEY_CLASS_SHIFT = KEY_OP1TYPE_SHIFT + 6,
+    KEY_PREFIX_SHIFT = KEY_CLASS_SHIFT + 7,
+    KEY_BITS = KEY_PREFIX_SHIFT + 3;
+// the signature is the part of the key above the opcode
+static constexpr int KEY_SIGNATURE_SHIFT = KEY_OP2TYPE_SHIFT;
+static_assert(PRF_CHAIN_REPZ <= 0b111, "Instruction prefix does not fit in key");
+static_assert(INS_IDIV <= 0b1111111, "Instruction class does not fit in key");
+static_assert(OPR_IMM32 <= 0b111111, "Operand type does not fit in key");
+static_assert(OPRSZ_DWORD <= 0b111, "Operand size does not fit in key");
+static_assert(KEY_BITS - KEY_SIGNATURE_SHIFT <= sizeof(Signature) * 8, "Signature does not fit in key");
+
+void Instruction::canonicalize() {
+    const Byte keyOpcode = iclass == INS_JMP_IF ? opcode : 0;
+    key = static_cast<QWord>(prefix) << KEY_PREFIX_SHIFT
+        | static_cast<QWord>(iclass) << KEY_CLASS_SHIFT
+        | static_cast<QWord>(operandTypeToWord(op1.type)) << KEY_OP1TYPE_SHIFT
+        | static_cast<QWord>(operandTypeToWord(op2.type)) << KEY_OP2TYPE_SHIFT
+        | static_cast<QWord>(keyOpcode) << KEY_OPCODE_SHIFT
+        | static_cast<QWord>(op1.size) << KEY_OP1SIZE_SHIFT
+        | static_cast<QWord>(op2.size) << KEY_OP2SIZE_SHIFT;
+    value = static_cast<QWord>(op2.canonicalValue()) << 32 | op1.canonicalValue();
+}
+
 // similar to the search pattern above, a signature is an ambiguation of an instruction, 
 // but this time used to lookup equivalent instruction sequences using edit distance
+// |reserved|prefix|class|op1type|op2type|
+//  10b      3b     7b    6b      6b    
 Signature Instruction::signature() const {
-    Signature ret = 0;
-    // fuse the instruction subtypes into a singular 32bit value that will serve as the instruction's signature:
-    // |reserved|prefix|class|op1type|op2type|
-    //  10b      3b     7b    6b      6b    
-    const int reserved = 10;
-    int shift = (sizeof(ret) * 8) - reserved;
-    if (prefix > 0b111) throw RangeError("Instruction prefix out of range: " + hexVal((Word)prefix));
-    DWord val = static_cast<DWord>(prefix) << (shift -= 3);
-    ret |= val;
-    if (iclass > 0b1111111) throw RangeError("Instruction class out of range: " + hexVal((Word)iclass));
-    val = static_cast<DWord>(iclass) << (shift -= 7);
-    ret |= val;
-    // ambiguate away embedded immediate size differences by converting a byte type to an equivalent word type
-    // TODO: create specialized enum for signatures, this could fit in 16bits?
-    // TODO: also, no need to store off8/off16 for the operand type
-    auto optype = operandTypeToWord(op1.type);
-    if (optype > 0b111111) throw RangeError("Instruction operand 1 type out of range: " + hexVal((Word)optype));
-    val = static_cast<DWord>(optype) << (shift -= 6);
-    ret |= val;
-    // if (op1.size > 0b111) throw RangeError("Instruction operand 1 size out of range: " + hexVal((Word)op1.size));
-    // val = static_cast<DWord>(op1.size) << (shift -= 3);
-    // ret |= val;
-    optype = operandTypeToWord(op2.type);
-    if (optype > 0b111111) throw RangeError("Instruction operand 2 type out of range: " + hexVal((Word)optype));
-    val = static_cast<DWord>(optype) << (shift -= 6);
-    ret |= val;
-    // if (op2.size > 0b111) throw RangeError("Instruction operand 2 size out of range: " + hexVal((Word)op2.size));    
-    // val = static_cast<DWord>(op2.size) << (shift -= 3);
-    // ret |= val;
-    return ret;
+    return static_cast<Signature>(key >> KEY_SIGNATURE_SHIFT);
 }
 
 InstructionMatch Instruction::match(const Instruction &other) const {
-    // normally we check whether instructions match in their "class", e.g. MOV, not whether they
-    // have the same opcode. An exception are conditional jumps, which all belong to class JMP_IF,
-    // so the opcode needs to be checked as well, but these do not have alternate encodings beyond these opcodes.
-    if (prefix != other.prefix || iclass != other.iclass || (iclass == INS_JMP_IF && opcode != other.opcode))
-        return INS_MATCH_MISMATCH;
-
-    // this can only return FULL (everything matches), DIFF (operand type match, different value) or MISMATCH (operand type different)
-    const InstructionMatch 
-        op1match = op1.match(other.op1), 
-        op2match = op2.match(other.op2);
-
-    if (op1match == INS_MATCH_MISMATCH || op2match == INS_MATCH_MISMATCH)
-        return INS_MATCH_MISMATCH; // either operand mismatch -> instruction mismatch
-    else if (op1match == INS_MATCH_DIFF && op2match == INS_MATCH_DIFF)
+    // the key covers the prefix, class, canonical operand types and sizes, as well as the opcode for conditional jumps, 
+    // which all belong to class JMP_IF, so any difference there is a mismatch
+    if (key != other.key) return INS_MATCH_MISMATCH;
+    if (value == other.value) return INS_MATCH_FULL;
+    const QWord diff = value ^ other.value;
+    const bool 
+        op1diff = (diff & 0xffffffff) != 0,
+        op2diff = (diff >> 32) != 0;
+    if (op1diff && op2diff)
         return INS_MATCH_DIFF; // difference on both operands
-    // TODO: handle both operands different from original?
-    else if (op1match == INS_MATCH_DIFF)
+    else if (op1diff)
         return INS_MATCH_DIFFOP1; // difference on operand 1
-    else if (op2match == INS_MATCH_DIFF)
-        return INS_MATCH_DIFFOP2; // difference on operand 2
-        
-    return INS_MATCH_FULL;
+    return INS_MATCH_DIFFOP2; // difference on operand 2
 }
 
 // lookup table for converting modrm mod and mem values into OperandType
@@ -809,7 +964,6 @@ Size Instruction::loadImmediate(Operand &op, const Byte *data) {
         memcpy(&byteVal, data, size);
         op.immval.u8 = byteVal;
         op.immsize = OPRSZ_BYTE;
-        debug("8bit operand, value = "s + hexVal(op.immval.u8) + ", instruction length = " + to_string(length + size));
         break;
     case OPR_MEM_OFF16:
     case OPR_MEM_BX_SI_OFF16:
@@ -825,28 +979,23 @@ Size Instruction::loadImmediate(Operand &op, const Byte *data) {
         memcpy(&wordVal, data, size);
         op.immval.u16 = wordVal;
         op.immsize = OPRSZ_WORD;
-        debug("16bit operand, value = "s + hexVal(op.immval.u16) + ", instruction length = " + to_string(length + size));
         break;    
     case OPR_IMM0:
         op.immval.u32 = 0;
         op.immsize = OPRSZ_NONE;
-        debug("imm0 operand");
         break;
     case OPR_IMM1:
         op.immval.u32 = 1;
         op.immsize = OPRSZ_NONE;
-        debug("imm1 operand");
         break;    
     case OPR_IMM32:
         size = sizeof(DWord);
         memcpy(&dwordVal, data, size);
         op.immval.u32 = dwordVal;
         op.immsize = OPRSZ_DWORD;
-        debug("32bit immediate = "s + hexVal(op.immval.u32) + ", instruction length = " + to_string(length + size));
         break;
     default:
         // register and memory operands with no displacement
-        debug("direct or no operand, immval = 0");
         op.immval.u32 = 0; 
         op.immsize = OPRSZ_NONE;
         break;
@@ -886,6 +1035,20 @@ DWord Instruction::Operand::dwordValue() const {
     return ret;
 }
 
+// offset or immediate value normalized to be comparable across the byte and word variants of the operand type,
+// byte memory offsets are sign-extended the same way the cpu does when computing the effective address
+DWord Instruction::Operand::canonicalValue() const {
+    if (operandIsMemWithByteOffset(type)) return static_cast<Word>(static_cast<SWord>(static_cast<SByte>(immval.u8)));
+    else if (operandIsMemWithWordOffset(type) || type == OPR_IMM16) return immval.u16;
+    switch (type) {
+    case OPR_IMM1:  return 1;
+    case OPR_IMM8:  return immval.u8;
+    case OPR_IMM32: return immval.u32;
+    default: break;
+    }
+    return 0;
+}
+
 Address Instruction::Operand::farAddr() const {
    const DWord val = dwordValue();
    const Word
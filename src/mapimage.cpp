@@ -0,0 +1,186 @@
+#include "dos/mapimage.h"
+#include "dos/codemap.h"
+#include "dos/error.h"
+#include "dos/output.h"
+
+#include <bit>
+#include <fstream>
+#include <unordered_map>
+
+using namespace std;
+
+OUTPUT_CONF(LOG_ANALYSIS)
+
+static constexpr DWord MAPIMAGE_MAGIC = 0x504d5a4d; // "MZMP"
+static constexpr Word MAPIMAGE_VERSION = 1;
+
+// the records are used in place, so their layout is the file layout
+static_assert(std::endian::native == std::endian::little, "binary maps are little-endian");
+static_assert(sizeof(MapImage::BlockRec) == 8 && sizeof(MapImage::SegmentRec) == 8 && sizeof(MapImage::RoutineRec) == 32 && sizeof(MapImage::VariableRec) == 12);
+
+bool MapImage::isImage(const std::string &path) {
+    ifstream file{path, ios::binary};
+    DWord magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return file && magic == MAPIMAGE_MAGIC;
+}
+
+static MapImage::BlockRec blockRec(Block b, const Word reloc) {
+    b.rebase(reloc);
+    return { b.begin.segment, b.begin.offset, b.end.segment, b.end.offset };
+}
+
+void MapImage::save(const CodeMap &map, const std::string &path, const Word reloc) {
+    // strings are stored once in the pool, each followed by a null terminator
+    std::string pool;
+    unordered_map<std::string, DWord> interned;
+    const auto intern = [&](const std::string &str) {
+        const auto [it, inserted] = interned.try_emplace(str, static_cast<DWord>(pool.size()));
+        if (inserted) pool.append(str).push_back('\0');
+        return it->second;
+    };
+    vector<SegmentRec> segments;
+    for (Segment s : map.getSegments()) {
+        s.address -= reloc;
+        segments.push_back({ intern(s.name), s.address, static_cast<Word>(s.type) });
+    }
+    vector<RoutineRec> routines;
+    vector<BlockRec> blocks;
+    vector<DWord> comments;
+    for (const Routine &r : map.getRoutines()) {
+        RoutineRec rec{ intern(r.name), static_cast<DWord>(r.idx), blockRec(r.extents, reloc), static_cast<DWord>(blocks.size()),
+            static_cast<Word>(r.reachable.size()), static_cast<Word>(r.unreachable.size()), static_cast<DWord>(comments.size()), static_cast<Word>(r.comments.size()), 0 };
+        if (r.near) rec.flags |= ROUTINE_NEAR;
+        if (r.ignore) rec.flags |= ROUTINE_IGNORE;
+        if (r.complete) rec.flags |= ROUTINE_COMPLETE;
+        if (r.unclaimed) rec.flags |= ROUTINE_UNCLAIMED;
+        if (r.external) rec.flags |= ROUTINE_EXTERNAL;
+        if (r.detached) rec.flags |= ROUTINE_DETACHED;
+        if (r.assembly) rec.flags |= ROUTINE_ASSEMBLY;
+        if (r.duplicate) rec.flags |= ROUTINE_DUPLICATE;
+        for (const Block &b : r.reachable) blocks.push_back(blockRec(b, reloc));
+        for (const Block &b : r.unreachable) blocks.push_back(blockRec(b, reloc));
+        for (const std::string &c : r.comments) comments.push_back(intern(c));
+        routines.push_back(rec);
+    }
+    vector<VariableRec> variables;
+    for (const Variable &v : map.getVariables()) {
+        Address addr = v.addr;
+        addr.rebase(reloc);
+        VariableRec rec{ intern(v.name), addr.segment, addr.offset, 0, 0 };
+        if (v.external) rec.flags |= VAR_EXTERNAL;
+        if (v.bss) rec.flags |= VAR_BSS;
+        variables.push_back(rec);
+    }
+    vector<BlockRec> unclaimed;
+    for (const Block &b : map.getUnclaimed()) unclaimed.push_back(blockRec(b, reloc));
+
+    // the tables follow the header in this order, every record size is a multiple of 4 so they stay aligned
+    Header header{ MAPIMAGE_MAGIC, MAPIMAGE_VERSION, static_cast<Word>(map.isIda() ? MAP_IDA : 0), static_cast<DWord>(map.codeSize()) };
+    DWord offset = sizeof(Header);
+    const auto place = [&](Table &t, const auto &records) {
+        t = { static_cast<DWord>(records.size()), offset };
+        offset += records.size() * sizeof(records[0]);
+    };
+    place(header.segments, segments);
+    place(header.routines, routines);
+    place(header.blocks, blocks);
+    place(header.variables, variables);
+    place(header.unclaimed, unclaimed);
+    place(header.comments, comments);
+    header.poolSize = pool.size();
+    header.pool = offset;
+
+    debug("Saving binary map of " + to_string(routines.size()) + " routines, " + to_string(variables.size()) + " variables to " + path + ", string pool size " + to_string(pool.size()));
+    ofstream file{path, ios::binary};
+    const auto write = [&](const auto &records) { file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(records[0])); };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write(segments);
+    write(routines);
+    write(blocks);
+    write(variables);
+    write(unclaimed);
+    write(comments);
+    write(pool);
+    if (!file) throw IoError("Unable to write binary map: " + path);
+}
+
+MapImage::MapImage(const std::string &path, const Word reloc) : file(path), base(file.text().data()), header(nullptr), reloc(reloc) {
+    const Size size = file.text().size();
+    if (size < sizeof(Header)) throw IoError("Binary map too small: " + path);
+    header = reinterpret_cast<const Header*>(base);
+    if (header->magic != MAPIMAGE_MAGIC || header->version != MAPIMAGE_VERSION) throw IoError("Unsupported binary map format: " + path);
+    // check everything the accessors reach, so they can skip it
+    const auto checkTable = [&](const Table &t, const Size recSize) {
+        if (t.offset % sizeof(DWord) != 0 || t.offset > size || t.count > (size - t.offset) / recSize) throw IoError("Invalid table in binary map: " + path);
+    };
+    checkTable(header->segments, sizeof(SegmentRec));
+    checkTable(header->routines, sizeof(RoutineRec));
+    checkTable(header->blocks, sizeof(BlockRec));
+    checkTable(header->variables, sizeof(VariableRec));
+    checkTable(header->unclaimed, sizeof(BlockRec));
+    checkTable(header->comments, sizeof(DWord));
+    if (header->pool > size || header->poolSize > size - header->pool || (header->poolSize && base[header->pool + header->poolSize - 1] != '\0'))
+        throw IoError("Invalid string pool in binary map: " + path);
+    const auto checkString = [&](const DWord offset) {
+        if (offset >= header->poolSize) throw IoError("Invalid string reference in binary map: " + path);
+    };
+    for (Size i = 0; i < segmentCount(); ++i) checkString(segmentRec(i).name);
+    for (Size i = 0; i < variableCount(); ++i) checkString(variableRec(i).name);
+    for (Size i = 0; i < header->comments.count; ++i) checkString(table<DWord>(header->comments)[i]);
+    for (Size i = 0; i < routineCount(); ++i) {
+        const RoutineRec &r = routineRec(i);
+        checkString(r.name);
+        if (r.blocks > header->blocks.count || r.reachable + r.unreachable > header->blocks.count - r.blocks
+            || r.comments > header->comments.count || r.commentCount > header->comments.count - r.comments)
+            throw IoError("Invalid routine record in binary map: " + path);
+    }
+}
+
+Block MapImage::block(const BlockRec &b) const {
+    Block ret{Address{b.beginSeg, b.beginOff}, Address{b.endSeg, b.endOff}};
+    ret.relocate(reloc);
+    return ret;
+}
+
+Address MapImage::variableAddress(const Size idx) const {
+    const VariableRec &v = variableRec(idx);
+    Address ret{v.segment, v.offset};
+    ret.relocate(reloc);
+    return ret;
+}
+
+Segment MapImage::segment(const Size idx) const {
+    const SegmentRec &s = segmentRec(idx);
+    return Segment{std::string{string(s.name)}, static_cast<Segment::Type>(s.type), static_cast<Word>(s.address + reloc)};
+}
+
+Routine MapImage::routine(const Size idx) const {
+    const RoutineRec &rec = routineRec(idx);
+    Routine r{std::string{string(rec.name)}, block(rec.extents)};
+    r.idx = static_cast<RoutineIdx>(rec.idx);
+    r.near = rec.flags & ROUTINE_NEAR;
+    r.ignore = rec.flags & ROUTINE_IGNORE;
+    r.complete = rec.flags & ROUTINE_COMPLETE;
+    r.unclaimed = rec.flags & ROUTINE_UNCLAIMED;
+    r.external = rec.flags & ROUTINE_EXTERNAL;
+    r.detached = rec.flags & ROUTINE_DETACHED;
+    r.assembly = rec.flags & ROUTINE_ASSEMBLY;
+    r.duplicate = rec.flags & ROUTINE_DUPLICATE;
+    const BlockRec *blocks = table<BlockRec>(header->blocks) + rec.blocks;
+    r.reachable.reserve(rec.reachable);
+    for (Size i = 0; i < rec.reachable; ++i) r.reachable.push_back(block(blocks[i]));
+    r.unreachable.reserve(rec.unreachable);
+    for (Size i = rec.reachable; i < Size{rec.reachable} + rec.unreachable; ++i) r.unreachable.push_back(block(blocks[i]));
+    const DWord *comments = table<DWord>(header->comments) + rec.comments;
+    for (Size i = 0; i < rec.commentCount; ++i) r.comments.emplace_back(string(comments[i]));
+    return r;
+}
+
+Variable MapImage::variable(const Size idx) const {
+    const VariableRec &rec = variableRec(idx);
+    Variable v{std::string{string(rec.name)}, variableAddress(idx)};
+    v.external = rec.flags & VAR_EXTERNAL;
+    v.bss = rec.flags & VAR_BSS;
+    return v;
+}
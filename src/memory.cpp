@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <algorithm>
 
 #include "dos/memory.h"
 #include "dos/error.h"
@@ -21,10 +22,15 @@ Memory::Memory() : break_(INIT_BREAK) {
         data_[i] = pattern[j];
         if (++j >= sizeof pattern) j = 0;
     }
+    std::fill(data_.begin() + MEM_TOTAL, data_.end(), 0);
 }
 
+// the loaded data gets a guard zone of its own, so instructions running off its end decode the same regardless of what follows in memory
 Memory::Memory(const Word segment, const Byte *data, const Size size) : Memory() {
-    writeBuf(SEG_TO_OFFSET(segment), data, size);
+    const Offset start = SEG_TO_OFFSET(segment);
+    writeBuf(start, data, size);
+    const Offset guardEnd = std::min(start + size + MEM_GUARD, MEM_TOTAL);
+    if (start + size < guardEnd) std::fill(data_.begin() + start + size, data_.begin() + guardEnd, 0);
 }
 
 void Memory::allocBlock(const Size para) {
@@ -70,7 +76,6 @@ void Memory::writeBuf(const Offset addr, const Byte *data, const Size size) {
     copy(data, data + size, begin(data_) + addr);
 }
 
-// TODO: use std::search with custom predicate to cover -1 case
 Address Memory::find(const ByteString &pattern, Block where) const {
     if (!where.isValid()) where = { {0}, {MEM_TOTAL - 1} };
     if (where.size() < pattern.size()) {
@@ -78,26 +83,13 @@ Address Memory::find(const ByteString &pattern, Block where) const {
         return {};
     }
     const Offset start = where.begin.toLinear();
-    const Offset end = std::min(where.end.toLinear(), MEM_TOTAL);
+    const Offset end = std::min(where.end.toLinear(), MEM_TOTAL - 1);
     if (start > end) throw AddressError("Invalid search range: " + where.toString());
-    const Size patSize = pattern.size();
-    debug("Searching for pattern of size " + sizeStr(patSize) + " within " + where.toString());
-    Address found;
-    vector<Byte> buffer(patSize);
-    for (Offset dataIdx = start; dataIdx + patSize - 1 <= end; ++dataIdx) {
-        std::copy(data_.begin() + dataIdx, data_.begin() + dataIdx + patSize, buffer.begin());
-        //debug("dataIdx = " + hexVal(dataIdx) + ", buffer: " + bytesToHex(buffer));
-        bool match = true;
-        // ouch, O(n^2)
-        for (Offset patIdx = 0; patIdx < pattern.size(); ++patIdx) {
-            const SWord pat = pattern[patIdx];
-            //debug(hexVal(pat, false) + " ");
-            if (pat == -1) continue;
-            if (pat != buffer[patIdx]) { match = false; break; }
-        }
-        if (match) { found = Address{dataIdx}; break; }
-    }
-    return found;
+    debug("Searching for pattern of size " + sizeStr(pattern.size()) + " within " + where.toString());
+    const Size searchSize = end - start + 1;
+    const Size found = findPattern(data_.data() + start, searchSize, pattern);
+    if (found == searchSize) return {};
+    return Address{start + found};
 }
 
 string Memory::info() const {
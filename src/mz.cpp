@@ -18,56 +18,43 @@ using namespace std;
 
 OUTPUT_CONF(LOG_OS)
 
-// only parse and read exe header and relocation table
-MzImage::MzImage(const std::string &path) : path_(path), loadSegment_(0) {
+// Only parse the exe header and the relocation table, the file is mapped into memory but the load module is not accessed 
+// until load() is called.
+MzImage::MzImage(const std::string &path) : path_(path), loadModule_(nullptr), loadSegment_(0), loaded_(false) {
     if (path_.empty()) 
         throw ArgError("Empty path for MZ file!");
     const auto file = checkFile(path);
     if (!file.exists)
         throw IoError("MZ file " + path + " does not exist");
 
-    filesize_ = file.size;
+    file_ = std::make_unique<MappedFile>(path_);
+    filesize_ = file_->fileSize();
     if (filesize_ < MZ_HEADER_SIZE)
         throw IoError("MZ file " + path + " too small: " + to_string(filesize_) + " bytes");
+    const Byte *data = file_->bytes();
 
     // parse MZ header
-    ifstream mzFile{path_, ios::binary};
-    if (!mzFile)
-        throw IoError("Unable to open file "s + path_);
-    if (!mzFile.read(reinterpret_cast<char*>(&header_), MZ_HEADER_SIZE))
-        throw IoError(("Unable to read header from file "s + path_));
-    const auto hdrReadSize = mzFile.gcount();
-    if (hdrReadSize != MZ_HEADER_SIZE)
-        throw IoError("Incorrect read size for MZ header: "s + to_string(hdrReadSize));
+    memcpy(&header_, data, MZ_HEADER_SIZE);
     if (header_.signature != MZ_SIGNATURE)
         throw IoError("MZ executable file has incorrect signature: " + hexVal(header_.signature));
 
-    // read in any bytes between end of header and beginning of relocation table (optional overlay information)
+    // copy any bytes between end of header and beginning of relocation table (optional overlay information)
     debug("Relocation table at offset "s + hexVal(header_.reloc_table_offset) + ", header size = " + hexVal(MZ_HEADER_SIZE));
     if (header_.reloc_table_offset > MZ_HEADER_SIZE) {
-        const Size ovlInfoSize = header_.reloc_table_offset - MZ_HEADER_SIZE;
-        ovlinfo_ = vector<Byte>(ovlInfoSize);
-        if (!mzFile.read(reinterpret_cast<char*>(ovlinfo_.data()), ovlInfoSize))
+        if (header_.reloc_table_offset > filesize_)
             throw IoError("Unable to read overlay info from "s + path_);
-        const auto ovlReadSize = mzFile.gcount();
-        if (ovlReadSize != ovlInfoSize) 
-            throw IoError("Incorrect read size for overlay info: " + to_string(ovlReadSize));
+        ovlinfo_ = vector<Byte>(data + MZ_HEADER_SIZE, data + header_.reloc_table_offset);
     }
 
     // read in relocation entries
     if (header_.num_relocs) {
-        if (!mzFile.seekg(header_.reloc_table_offset, ios::beg))
-            throw IoError("Unable to seek to relocation table!");
-        for (size_t i = 0; i < header_.num_relocs; ++i) {
-            Word relocData[2];
-            if (!mzFile.read(reinterpret_cast<char*>(&relocData), MZ_RELOC_SIZE))
-                throw IoError("Unable to read data for relocation " + to_string(i));
-            auto relocReadSize = mzFile.gcount();
-            if (relocReadSize != MZ_RELOC_SIZE)
-                throw IoError("Invalid relocation read size from MZ file: "s + to_string(relocReadSize));
+        if (header_.reloc_table_offset + header_.num_relocs * MZ_RELOC_SIZE > filesize_)
+            throw IoError("Relocation table extends past the end of "s + path_);
+        const Byte *relocData = data + header_.reloc_table_offset;
+        for (size_t i = 0; i < header_.num_relocs; ++i, relocData += MZ_RELOC_SIZE) {
             Relocation reloc;
-            reloc.segment = relocData[1];
-            reloc.offset = relocData[0];
+            reloc.offset = relocData[0] | (relocData[1] << 8);
+            reloc.segment = relocData[2] | (relocData[3] << 8);
             relocs_.push_back(reloc);
         }
     }
@@ -77,20 +64,7 @@ MzImage::MzImage(const std::string &path) : path_(path), loadSegment_(0) {
     if (header_.pages_in_file == 0)
         throw DosError("Page count in MZ header is zero");
     loadModuleSize_ = (header_.pages_in_file - 1) * PAGE_SIZE + header_.last_page_size - loadModuleOffset_;
-    // store original values at relocation offsets
-    for (auto &reloc : relocs_) {
-        Address relocAddr(reloc.segment, reloc.offset);
-        Offset fileOffset = relocAddr.toLinear() + loadModuleOffset_;
-        if (!mzFile.seekg(fileOffset, ios::beg))
-            throw IoError("Unable to seek to relocation offset " + hexVal(fileOffset));
-        Word relocVal;
-        if (!mzFile.read(reinterpret_cast<char*>(&relocVal), sizeof(relocVal)))
-            throw IoError("Unable to read relocation value at offset " + hexVal(fileOffset));
-        auto relocValSize = mzFile.gcount();
-        if (relocValSize != sizeof(relocVal))
-            throw IoError("Invalid relocation value read size from MZ file: "s + to_string(relocValSize));
-        reloc.value = relocVal;
-    }
+    // the original values at relocation offsets are only read from the load module when needed
     debug("Loaded MZ exe header from "s + path_ + ", entrypoint @ " + entrypoint().toString() + ", stack @ " + stackPointer().toString());
 }
 
@@ -99,8 +73,8 @@ MzImage::MzImage(const std::string &path, const Word loadSegment) : MzImage(path
     load(loadSegment);
 }
 
-MzImage::MzImage(const std::vector<Byte> &code) : filesize_(0), loadModuleSize_(code.size()), loadModuleOffset_(0), entrypoint_(0, 0), loadSegment_(0) {
-    std::copy(code.begin(), code.end(), std::back_inserter(loadModuleData_));
+MzImage::MzImage(const std::vector<Byte> &code) : filesize_(0), loadModuleSize_(code.size()), loadModuleData_(code), 
+    loadModuleOffset_(0), loadModule_(loadModuleData_.data()), entrypoint_(0, 0), loadSegment_(0), loaded_(true) {
 }
 
 std::string MzImage::dump() const {
@@ -145,7 +119,7 @@ std::string MzImage::dump() const {
             msg << "\t[" << std::dec << i << "]: " << std::hex << r.segment << ":" << r.offset 
                 << ", linear: 0x" << a.toLinear() 
                 << ", file offset: 0x" << a.toLinear() + loadModuleOffset_ 
-                << ", file value = 0x" << r.value;
+                << ", file value = 0x" << relocationValue(r);
             i++;
         }
     }
@@ -155,32 +129,57 @@ std::string MzImage::dump() const {
     return msg.str();
 }
 
-// read actual load module data
+// Make the load module available and patch the relocations for the specified segment. The module is accessed directly in the file 
+// mapping, the pages holding relocations become private copies once written to.
 void MzImage::load(const Word loadSegment) {
     debug("Loading executable code: size = "s + hexVal(loadModuleSize_) + " bytes starting at file offset "s + hexVal(loadModuleOffset_) + ", relocation factor " + hexVal(loadSegment));
-    ifstream mzFile{path_, ios::binary};
-    if (!mzFile) 
+    if (file_ == nullptr) 
         throw IoError("Unable to open MZ file: " + path_);
-    if (!mzFile.seekg(loadModuleOffset_))
-        throw IoError("Unable to seek to load module at offset " + hexVal(loadModuleOffset_));
-    loadModuleData_ = vector<Byte>(loadModuleSize_, 0);
-    loadSegment_ = loadSegment;
-    if (!mzFile.read(reinterpret_cast<char*>(loadModuleData_.data()), loadModuleSize_))
-        throw IoError("Error while reading load module data from "s + path_);
-    const auto bytesRead = mzFile.gcount();
-    if (bytesRead != loadModuleSize_) 
-        throw IoError("Incorrect number of bytes read from "s  + path_ + ": " + to_string(bytesRead));
-    // patch relocations
+    if (loadModuleOffset_ > filesize_ || loadModuleSize_ > filesize_ - loadModuleOffset_)
+        throw IoError("Load module of size " + hexVal(loadModuleSize_) + " at offset " + hexVal(loadModuleOffset_) + " extends past the end of "s + path_);
+    Byte *module = file_->mutableBytes() + loadModuleOffset_;
     for (const Relocation &r : relocs_) {
-        const Address addr(r.segment, r.offset);
-        const Offset off = addr.toLinear();
-        const Word patchedVal = r.value + loadSegment;
+        const Offset off = Address(r.segment, r.offset).toLinear();
+        if (loadModuleOffset_ + off + sizeof(Word) > filesize_)
+            throw IoError("Unable to read relocation value at offset " + hexVal(off + loadModuleOffset_));
+    }
+    if (!relocs_.empty()) {
+        file_->setWritable(true);
+        // keep the original values from the first load so the image can be loaded again at a different segment, all of them 
+        // before patching any, as the table can list the same location more than once
+        if (!loaded_) for (Relocation &r : relocs_) {
+            const Offset off = Address(r.segment, r.offset).toLinear();
+            if (off + sizeof(Word) <= loadModuleSize_) r.value = module[off] | (module[off + 1] << 8);
+        }
+        for (const Relocation &r : relocs_) {
+            const Address addr(r.segment, r.offset);
+            const Offset off = addr.toLinear();
+            if (off + sizeof(Word) > loadModuleSize_) {
+                warn("Relocation at " + addr.toString() + " outside of the load module, ignoring");
+                continue;
+            }
+            const Word patchedVal = r.value + loadSegment;
 #ifdef DEBUG        
-        debug("Patching relocation at " + addr.toString() + " to " + hexVal(patchedVal));
+            debug("Patching relocation at " + addr.toString() + " to " + hexVal(patchedVal));
 #endif
-        loadModuleData_[off] = lowByte(patchedVal);
-        loadModuleData_[off + 1] = hiByte(patchedVal);
+            module[off] = lowByte(patchedVal);
+            module[off + 1] = hiByte(patchedVal);
+        }
+        file_->setWritable(false);
     }
+    loadModule_ = module;
+    loadSegment_ = loadSegment;
+    loaded_ = true;
+}
+
+// The value stored in the file at a relocation's location, before patching.
+Word MzImage::relocationValue(const Relocation &reloc) const {
+    const Offset off = Address(reloc.segment, reloc.offset).toLinear();
+    // once patched, the file mapping no longer holds the original value
+    if (loaded_ && off + sizeof(Word) <= loadModuleSize_) return reloc.value;
+    const Offset fileOff = loadModuleOffset_ + off;
+    if (file_ == nullptr || fileOff + sizeof(Word) > filesize_) return 0;
+    return file_->bytes()[fileOff] | (file_->bytes()[fileOff + 1] << 8);
 }
 
 void MzImage::writeLoadModule(const std::string &path) const {
@@ -4,6 +4,7 @@
 #include "dos/output.h"
 #include "dos/executable.h"
 #include "dos/analysis.h"
+#include "dos/mapimage.h"
 
 #include <iostream>
 #include <string>
@@ -32,7 +33,13 @@ void usage() {
            "--nocpu:        omit CPU-related information like instruction decoding from debug output\n"
            "--noanal:       omit analysis-related information from debug output\n"
            "--linkmap file  use a linker map from Microsoft C to seed initial location of routines\n"
-           "--load segment: override default load segment (0x0)", LOG_OTHER, LOG_ERROR);
+           "--load segment: override default load segment (0x0)\n"
+           "--threads n:    decode code ahead of the exploration on n threads, the output is the same as with a single one\n"
+           "--nocache:      do not reuse or save the exploration state in file.map.cache\n"
+           "--previous exe: update the existing file.map of a previous build of the executable, only exploring the changed code\n"
+           "--calls name:   print the callers and callees of a routine from the call graph saved in file.map.calls\n"
+           "--xrefs target: print the references to a variable, routine or address from the index saved in file.map.xrefs\n"
+           "--convert file: save the map in the binary format as file, or a binary map in the text format; all tools accept either", LOG_OTHER, LOG_ERROR);
     exit(1);
 }
 
@@ -89,15 +96,76 @@ void loadAndPrintMap(const string &mapfile, const bool verbose, const bool brief
     if (map.isIda()) map.save(mapfile + ".map");
 }
 
+void convertMap(const string &mapfile, const string &outPath, const bool overwrite) {
+    if (!checkFile(mapfile).exists) fatal("Mapfile does not exist: " + mapfile);
+    if (!overwrite && checkFile(outPath).exists) fatal("Output file already exists: " + outPath);
+    const bool binary = MapImage::isImage(mapfile);
+    const CodeMap map{mapfile};
+    if (binary) map.save(outPath, 0, overwrite);
+    else map.saveBinary(outPath, 0, overwrite);
+    info("Converted "s + (binary ? "binary" : "text") + " map " + mapfile + " to " + (binary ? "text" : "binary") + " map " + outPath);
+}
+
+string routineName(const CodeMap &map, const Address &ep) {
+    const Routine *r = map.findEntrypoint(ep);
+    return r ? r->name : ep.toString();
+}
+
+void printCalls(const string &mapfile, const string &name) {
+    const CodeMap map{mapfile};
+    const string graphPath = mapfile + ".calls";
+    if (!checkFile(graphPath).exists) fatal("Call graph does not exist: " + graphPath);
+    const CallGraph graph{graphPath};
+    const Routine r = map.getRoutine(name);
+    if (!r.isValid()) fatal("Routine not found in map: " + name);
+    const Size node = graph.findNode(r.entrypoint());
+    if (node == CallGraph::NO_NODE) fatal("Routine " + name + " is not in the call graph, it may need to be regenerated");
+    const auto callers = graph.callers(node), callees = graph.callees(node);
+    cout << r.name << " is called from " << callers.size() << " locations:" << endl;
+    for (const auto &e : callers) cout << "  " << e.site.toString() << " in " << routineName(map, graph.entrypoint(e.node)) << (e.near ? "" : " (far)") << endl;
+    cout << r.name << " calls " << callees.size() << " locations:" << endl;
+    for (const auto &e : callees) cout << "  " << e.site.toString() << " -> " << routineName(map, graph.entrypoint(e.node)) << (e.near ? "" : " (far)") << endl;
+    for (const auto &u : graph.unresolved()) {
+        if (u.caller == node) cout << "  " << u.site.toString() << " -> unresolved" << (u.near ? "" : " (far)") << endl;
+    }
+}
+
+void printXrefs(const string &mapfile, const string &target) {
+    const CodeMap map{mapfile};
+    const string indexPath = mapfile + ".xrefs";
+    if (!checkFile(indexPath).exists) fatal("Cross-reference index does not exist: " + indexPath);
+    const XrefIndex index{indexPath};
+    // the target is the name of a variable or routine, otherwise an address
+    Address addr = map.getVariable(target).addr;
+    if (!addr.isValid()) {
+        const Routine r = map.getRoutine(target);
+        if (r.isValid()) addr = r.entrypoint();
+        else try {
+            addr = Address{target};
+        }
+        catch (ArgError &e) {
+            fatal("Not a variable, routine or address in map: " + target);
+        }
+    }
+    const auto range = index.refsTo(addr);
+    cout << target << " is referenced from " << range.size() << " locations:" << endl;
+    for (Size i = range.begin; i < range.end; ++i) {
+        const Address &src = index.source(i);
+        const Routine *r = map.findRoutine(src);
+        cout << "  " << src.toString() << " in " << (r ? r->name : "unknown") << " (" << xrefKindName(index.kind(i)) << ")" << endl;
+    }
+}
+
 int main(int argc, char *argv[]) {
     setOutputLevel(LOG_INFO);
     if (argc < 2) {
         usage();
     }
     Word loadSegment = 0x1000;
-    string file1, file2, linkmapPath;
+    Size threads = 1;
+    string file1, file2, linkmapPath, prevPath, callsName, xrefsTarget, convertPath;
     bool verbose = false;
-    bool brief = false, format = false, overwrite = false;
+    bool brief = false, format = false, overwrite = false, cache = true;
     for (int aidx = 1; aidx < argc; ++aidx) {
         string arg(argv[aidx]);
         if (arg == "--debug") setOutputLevel(LOG_DEBUG);
@@ -105,6 +173,7 @@ int main(int argc, char *argv[]) {
         else if (arg == "--nocpu") setModuleVisibility(LOG_CPU, false);
         else if (arg == "--noanal") setModuleVisibility(LOG_ANALYSIS, false);
         else if (arg == "--overwrite") overwrite = true;
+        else if (arg == "--nocache") cache = false;
         else if (arg == "--brief") {
             info("Showing only only uncompleted routines and unclaimed blocks in code segments");
             brief = true;
@@ -116,6 +185,28 @@ int main(int argc, char *argv[]) {
             loadSegment = static_cast<Word>(stoi(loadSegStr, nullptr, 16));
             info("Overloading default load segment: "s + hexVal(loadSegment));
         }
+        else if (arg == "--threads") {
+            if (++aidx >= argc) fatal("Option requires an argument: --threads");
+            const int count = stoi(string{argv[aidx]});
+            if (count < 1) fatal("Invalid thread count: "s + argv[aidx]);
+            threads = static_cast<Size>(count);
+        }
+        else if (arg == "--calls") {
+            if (++aidx >= argc) fatal("Option requires an argument: --calls");
+            callsName = string{argv[aidx]};
+        }
+        else if (arg == "--xrefs") {
+            if (++aidx >= argc) fatal("Option requires an argument: --xrefs");
+            xrefsTarget = string{argv[aidx]};
+        }
+        else if (arg == "--convert") {
+            if (++aidx >= argc) fatal("Option requires an argument: --convert");
+            convertPath = string{argv[aidx]};
+        }
+        else if (arg == "--previous") {
+            if (++aidx >= argc) fatal("Option requires an argument: --previous");
+            prevPath = string{argv[aidx]};
+        }
         else if (arg == "--linkmap") {
             if (++aidx >= argc) fatal("Option requires an argument: --linkmap");
             linkmapPath = string{argv[aidx]};
@@ -127,29 +218,62 @@ int main(int argc, char *argv[]) {
     }
     try {
         if (file1.empty()) fatal("Need at least one input file");
-        if (file2.empty()) { // print existing map and exit
+        if (!callsName.empty()) { // query the call graph of an existing map
+            if (!file2.empty()) fatal("Option --calls takes only the map file");
+            printCalls(file1, callsName);
+        }
+        else if (!xrefsTarget.empty()) { // query the cross-references of an existing map
+            if (!file2.empty()) fatal("Option --xrefs takes only the map file");
+            printXrefs(file1, xrefsTarget);
+        }
+        else if (!convertPath.empty()) { // convert an existing map between the text and binary formats
+            if (!file2.empty()) fatal("Option --convert takes only the map file");
+            convertMap(file1, convertPath, overwrite);
+        }
+        else if (file2.empty()) { // print existing map and exit
             loadAndPrintMap(file1, verbose, brief, format);
         }
         else { // regular operation, scan executable for routines
+            if (!prevPath.empty() && !linkmapPath.empty()) fatal("Options --previous and --linkmap are mutually exclusive");
+            if (!prevPath.empty() && !checkFile(file2).exists) fatal("Map of the previous executable does not exist: " + file2);
+            // the map is updated in place when exploring incrementally
+            if (!prevPath.empty()) overwrite = true;
             if (!overwrite && checkFile(file2).exists) {
                 fatal("Output file already exists: " + file2);
                 return 1;
             }
             Executable exe = loadExe(file1, loadSegment);
-            Analyzer a = Analyzer(Analyzer::Options());
+            Analyzer::Options opt;
+            opt.threads = threads;
+            if (cache) opt.cachePath = file2 + ".cache";
+            Analyzer a = Analyzer(opt);
             // optionally seed search queue with link map
             if (!linkmapPath.empty()) {
                 CodeMap linkmap{linkmapPath, loadSegment, CodeMap::MAP_MSLINK};
                 info("Using linker map file " + linkmapPath + " to seed scan: " + to_string(linkmap.segmentCount()) + " segments, " + to_string(linkmap.routineCount()) + " routines, " + to_string(linkmap.variableCount()) + " variables");
                 a.seedQueue(linkmap, exe);
             }
-            CodeMap map = a.exploreCode(exe);
+            CodeMap map;
+            if (!prevPath.empty()) {
+                const CodeMap prevMap{file2, loadSegment};
+                const Executable prevExe = loadExe(prevPath, loadSegment);
+                if (checkFile(file2 + ".calls").exists) a.seedCalls(CallGraph{file2 + ".calls", loadSegment});
+                if (checkFile(file2 + ".xrefs").exists) a.seedXrefs(XrefIndex{file2 + ".xrefs", loadSegment});
+                map = a.exploreCode(exe, prevMap, prevExe);
+            }
+            else map = a.exploreCode(exe);
             if (map.empty()) {
                 fatal("Unable to find any routines");
                 return 1;
             }
             if (verbose) cout << map.getSummary(verbose, brief).text;
             map.save(file2, loadSegment, overwrite);
+            const CallGraph graph = a.callGraph(map);
+            graph.save(file2 + ".calls", loadSegment);
+            info("Saved call graph of " + to_string(graph.edgeCount()) + " calls, " + to_string(graph.unresolved().size()) + " unresolved, to " + file2 + ".calls");
+            const XrefIndex xrefs = a.xrefIndex();
+            xrefs.save(file2 + ".xrefs", loadSegment);
+            info("Saved " + to_string(xrefs.size()) + " cross-references to " + file2 + ".xrefs");
             info("Please review the output file (" + file2 + "), assign names to routines/segments\nYou may need to resolve inaccuracies with routine block ranges manually; this tool is not perfect");
         }
     }
@@ -18,7 +18,7 @@ static map<LogModule, bool> moduleVisibility = {
     { LOG_OTHER,     true },
 };
 
-void output(const std::string &msg, const LogModule mod, const LogPriority pri, const Color color, const bool suppressNewline) {
+void output(std::string_view msg, const LogModule mod, const LogPriority pri, const Color color, const bool suppressNewline) {
     if (pri < globalPriority || !moduleVisibility[mod]) return;
     if (color != OUT_DEFAULT) cout << output_color(color);
     cout << msg;
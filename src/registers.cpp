@@ -118,12 +118,18 @@ string Registers::dump() const {
     return str.str();    
 }
 
-CpuState::CpuState() {
-    for (int i = REG_AL; i <= REG_FLAGS; ++i) {
-        Register r = (Register)i;
-        regs_.set(r, 0);
-        known_.set(r, 0);
-    }
+static DWord knownBits(const Register r) {
+    if (regIsWord(r)) return 0b11u << (2 * (r - REG_AX));
+    return 1u << (2 * (PARENT_REG[r] - REG_AX) + (BYTE_SHIFT[r] == BYTE_HIGH));
+}
+
+static Word knownMask(const DWord known, const Register r) {
+    const DWord bits = known >> (2 * (r - REG_AX));
+    return ((bits & 1) ? 0x00ff : 0) | ((bits & 2) ? 0xff00 : 0);
+}
+
+CpuState::CpuState() : known_(0), stackSize_(0) {
+    for (int i = REG_AX; i <= REG_FLAGS; ++i) regs_.set(static_cast<Register>(i), 0);
 }
 
 // TODO: set other known register types
@@ -138,8 +144,8 @@ CpuState::CpuState(const Address &code, const Address &stack) : CpuState() {
 }
 
 bool CpuState::isKnown(const Register r) const {
-    if (regIsWord(r)) return known_.get(r) == WORD_KNOWN;
-    else return known_.get(r) == BYTE_KNOWN;
+    const DWord bits = knownBits(r);
+    return (known_ & bits) == bits;
 }
 
 Word CpuState::getValue(const Register r) const {
@@ -155,6 +161,50 @@ void CpuState::setUnknown(const Register r) {
     setState(r, 0, false);
 }
 
+void CpuState::push(const Word val) {
+    if (stackSize_ == STACK_CAPACITY) {
+        std::copy(stack_.begin() + 1, stack_.end(), stack_.begin());
+        stackSize_--;
+    }
+    stack_[stackSize_++] = val;
+}
+
+bool CpuState::operator==(const CpuState &other) const {
+    if (known_ != other.known_ || stackSize_ != other.stackSize_) return false;
+    for (int i = REG_AX; i <= REG_FLAGS; ++i) {
+        const Register r = static_cast<Register>(i);
+        const Word mask = knownMask(known_, r);
+        if ((regs_.get(r) & mask) != (other.regs_.get(r) & mask)) return false;
+    }
+    return std::equal(stack_.begin(), stack_.begin() + stackSize_, other.stack_.begin());
+}
+
+void CpuState::save(std::ostream &str) const {
+    writeBinaryValue(str, known_, sizeof(DWord));
+    for (int i = REG_AX; i <= REG_FLAGS; ++i) writeBinaryValue(str, regs_.get(static_cast<Register>(i)), sizeof(Word));
+    writeBinaryValue(str, stackSize_, sizeof(Byte));
+    for (Size i = 0; i < stackSize_; ++i) writeBinaryValue(str, stack_[i], sizeof(Word));
+}
+
+void CpuState::load(std::istream &str) {
+    known_ = readBinaryValue(str, sizeof(DWord));
+    for (int i = REG_AX; i <= REG_FLAGS; ++i) regs_.set(static_cast<Register>(i), readBinaryValue(str, sizeof(Word)));
+    const Size stackSize = readBinaryValue(str, sizeof(Byte));
+    if (stackSize > STACK_CAPACITY) throw IoError("Invalid stack size of saved register state: " + to_string(stackSize));
+    stackSize_ = stackSize;
+    for (Size i = 0; i < stackSize_; ++i) stack_[i] = readBinaryValue(str, sizeof(Word));
+}
+
+Size CpuState::hash() const {
+    Size ret = known_ * 31 + stackSize_;
+    for (int i = REG_AX; i <= REG_FLAGS; ++i) {
+        const Register r = static_cast<Register>(i);
+        ret = ret * 31 + (regs_.get(r) & knownMask(known_, r));
+    }
+    for (Size i = 0; i < stackSize_; ++i) ret = ret * 31 + stack_[i];
+    return ret;
+}
+
 
 
 string CpuState::stateString(const Register r) const {
@@ -188,19 +238,15 @@ string CpuState::toString() const {
         << regString(REG_SS) << ", " << regString(REG_ES) << endl
         << regString(REG_IP) << ", " << regString(REG_FLAGS) << endl;
     str << "stack: <";
-    for (const Word &v : stack_) str << hexVal(v, false) << " ";
-    if (!stack_.empty()) str.seekp(-1, std::ios_base::end);
+    // top of the stack first
+    for (Size i = stackSize_; i > 0; --i) str << hexVal(stack_[i - 1], false) << " ";
+    if (stackSize_ != 0) str.seekp(-1, std::ios_base::end);
     str << ">";
     return str.str();
 }  
 
 void CpuState::setState(const Register r, const Word value, const bool known) {
-    if (regIsWord(r)) {
-        regs_.set(r, value);
-        known_.set(r, known ? WORD_KNOWN : 0);
-    }
-    else {
-        regs_.set(r, value);
-        known_.set(r, known ? BYTE_KNOWN : 0);
-    }
+    regs_.set(r, value);
+    if (known) known_ |= knownBits(r);
+    else known_ &= ~knownBits(r);
 }
@@ -27,14 +27,114 @@ string Branch::toString() const {
     return str.str();
 }
 
-ScanQueue::ScanQueue(const Address &origin, const Size codeSize, const Destination &seed, const std::string name) :
-    visited(codeSize, NULL_ROUTINE),
-    origin(origin),
-    seed(seed)
-{
+VisitedMap::VisitedMap(const Size size) : size_(size), cacheBegin(0), cacheEnd(0), cacheIdx(NULL_ROUTINE) {
+    runs.emplace(0, NULL_ROUTINE);
+}
+
+void VisitedMap::reset(const Size size) {
+    size_ = size;
+    runs.clear();
+    runs.emplace(0, NULL_ROUTINE);
+    cacheBegin = cacheEnd = 0;
+    cacheIdx = NULL_ROUTINE;
+}
+
+VisitedMap::VisitedMap(const std::vector<RoutineIdx> &values) : VisitedMap(values.size()) {
+    if (!values.empty()) runs.begin()->second = values.front();
+    for (Offset off = 1; off < values.size(); ++off) {
+        if (values[off] != std::prev(runs.end())->second) runs.emplace_hint(runs.end(), off, values[off]);
+    }
+}
+
+VisitedMap::Run VisitedMap::find(const Offset off) const {
+    if (off >= cacheBegin && off < cacheEnd) return { cacheBegin, cacheEnd, cacheIdx };
+    if (off >= size_) throw ArgError("Offset " + hexVal(off) + " past visited map of size " + hexVal(size_));
+    auto it = runs.upper_bound(off);
+    cacheEnd = it == runs.end() ? size_ : it->first;
+    --it;
+    cacheBegin = it->first;
+    cacheIdx = it->second;
+    return { cacheBegin, cacheEnd, cacheIdx };
+}
+
+void VisitedMap::assign(const Offset off, const Size length, const RoutineIdx idx) {
+    if (length == 0) return;
+    const Offset end = off + length;
+    if (end > size_) throw ArgError("Unable to assign range " + hexVal(off) + "-" + hexVal(end) + " past visited map of size " + hexVal(size_));
+    // the run continuing after the range keeps its value
+    const bool tail = end < size_;
+    const RoutineIdx tailIdx = tail ? get(end) : NULL_ROUTINE;
+    cacheBegin = cacheEnd = 0;
+    auto it = runs.erase(runs.lower_bound(off), runs.upper_bound(end));
+    // start a new run unless the previous one has the same index
+    if (it == runs.begin() || std::prev(it)->second != idx) it = std::next(runs.emplace_hint(it, off, idx));
+    if (tail && tailIdx != idx) runs.emplace_hint(it, end, tailIdx);
+}
+
+VisitedMap::Run VisitedMap::next(const Offset off, const RoutineIdx idx) const {
+    if (off >= size_) return { size_, size_, idx };
+    auto it = std::prev(runs.upper_bound(off));
+    for (; it != runs.end(); ++it) {
+        if (it->second != idx) continue;
+        const auto nextIt = std::next(it);
+        return { std::max(it->first, off), nextIt == runs.end() ? size_ : nextIt->first, idx };
+    }
+    return { size_, size_, idx };
+}
+
+RoutineIdx VisitedMap::maxIdx() const {
+    RoutineIdx ret = BAD_ROUTINE;
+    for (const auto &[begin, idx] : runs) ret = std::max(ret, idx);
+    return ret;
+}
+
+void VisitedMap::save(std::ostream &str) const {
+    writeBinaryValue(str, size_, sizeof(DWord));
+    writeBinaryValue(str, runs.size(), sizeof(DWord));
+    for (const auto &[begin, idx] : runs) {
+        writeBinaryValue(str, begin, sizeof(DWord));
+        writeBinaryValue(str, static_cast<DWord>(idx), sizeof(DWord));
+    }
+}
+
+void VisitedMap::load(std::istream &str) {
+    const Size size = readBinaryValue(str, sizeof(DWord));
+    const Size count = readBinaryValue(str, sizeof(DWord));
+    std::map<Offset, RoutineIdx> loaded;
+    for (Size i = 0; i < count; ++i) {
+        const Offset begin = readBinaryValue(str, sizeof(DWord));
+        const auto idx = static_cast<RoutineIdx>(static_cast<DWord>(readBinaryValue(str, sizeof(DWord))));
+        if (begin >= size || (i == 0) != (begin == 0)) throw ArgError("Invalid run at " + hexVal(begin) + " in visited map of size " + hexVal(size));
+        if (idx < BAD_ROUTINE || (i != 0 && std::prev(loaded.end())->second == idx)) 
+            throw ArgError("Invalid routine index " + to_string(idx) + " of run at " + hexVal(begin) + " in visited map");
+        loaded.emplace_hint(loaded.end(), begin, idx);
+    }
+    if (loaded.size() != count) throw ArgError("Duplicate runs in visited map");
+    size_ = size;
+    runs.swap(loaded);
+    cacheBegin = cacheEnd = 0;
+}
+
+ScanQueue::ScanQueue(const Address &origin, const Size codeSize, const Destination &seed, const std::string name) {
+    reset(origin, codeSize, seed, name);
+}
+
+void ScanQueue::reset(const Address &origin, const Size codeSize, const Destination &seed, const std::string name) {
     debug("Initializing queue, origin: " + origin.toString() + ", size = " + to_string(codeSize) + ", seed: " + seed.toString() + ", name: '" + name + "'");
+    visited.reset(codeSize);
+    this->origin = origin;
+    this->seed = seed;
+    curSearch = {};
+    queue.clear();
+    entrypoints.clear();
+    queueIndex.clear();
+    epAddrIndex.clear();
+    epNameIndex.clear();
+    epIdxIndex.clear();
+    epIndexed = 0;
+    statePool.clear();
     if (seed.address.isValid()) {
-        queue.push_front(seed);
+        pushFront(seed);
         RoutineEntrypoint ep{seed.address, seed.routineIdx, true};
         if (!name.empty()) ep.name = name;
         entrypoints.push_back(ep);
@@ -49,7 +149,16 @@ RoutineIdx ScanQueue::getRoutineIdx(Offset off) const {
     assert(off >= origin.toLinear());
     off -= origin.toLinear();
     assert(off < visited.size());
-    return visited.at(off); 
+    return visited.get(off); 
+}
+
+VisitedMap::Run ScanQueue::getRoutineRun(Offset off) const {
+    const Offset base = origin.toLinear();
+    assert(off >= base);
+    VisitedMap::Run run = visited.find(off - base);
+    run.begin += base;
+    run.end += base;
+    return run;
 }
 
 void ScanQueue::setRoutineIdx(Offset off, const Size length, RoutineIdx idx) {
@@ -58,60 +167,117 @@ void ScanQueue::setRoutineIdx(Offset off, const Size length, RoutineIdx idx) {
     off -= origin.toLinear();
     if (off >= visited.size() || off + length > visited.size()) 
         throw ArgError("Unable to mark visited location at offset " + hexVal(off) + " with length " + sizeStr(length) + " past array of size " + hexVal(visited.size()));
-    fill(visited.begin() + off, visited.begin() + off + length, idx);
+    visited.assign(off, length, idx);
 }
 
+// register a routine explored earlier without queueing it, its reachable blocks are marked as visited
+RoutineIdx ScanQueue::addRoutine(const Routine &r) {
+    const RoutineIdx idx = routineCount() + 1;
+    RoutineEntrypoint ep{r.entrypoint(), idx, r.near};
+    ep.name = r.name;
+    entrypoints.push_back(ep);
+    for (const Block &b : r.reachable) setRoutineIdx(b.begin.toLinear(), b.size(), idx);
+    return idx;
+}
+
+// clear the routine index from the location to the end of its run
 void ScanQueue::clearRoutineIdx(Offset off) {
     assert(off >= origin.toLinear());
     off -= origin.toLinear();
     assert(off < visited.size());
-    auto it = visited.begin() + off;
-    const auto clearId = *it;
-    if (clearId == NULL_ROUTINE) return;
-    while (it != visited.end() && *it == clearId) {
-        *it = NULL_ROUTINE;
-        ++it;
-    }
+    const VisitedMap::Run run = visited.find(off);
+    if (run.idx == NULL_ROUTINE) return;
+    visited.assign(off, run.end - off, NULL_ROUTINE);
 }
 
 Destination ScanQueue::nextPoint() {
     if (!empty()) {
         curSearch = queue.front();
         queue.pop_front();
+        auto found = queueIndex.find(queueKey(curSearch.address, curSearch.isCall));
+        if (--found->second == 0) queueIndex.erase(found);
     }
     return curSearch;
 }
 
+void ScanQueue::pushFront(const Destination &dest) {
+    queue.push_front(dest);
+    queueIndex[queueKey(dest.address, dest.isCall)]++;
+}
+
+void ScanQueue::pushBack(const Destination &dest) {
+    queue.push_back(dest);
+    queueIndex[queueKey(dest.address, dest.isCall)]++;
+}
+
 bool ScanQueue::hasPoint(const Address &dest, const bool call) const {
-    Destination findme(dest, 0, call, CpuState());
-    const auto &it = std::find_if(queue.begin(), queue.end(), [&](const Destination &p){
-        return p.match(findme);
-    });
-    return it != queue.end();
+    return queueIndex.count(queueKey(dest, call)) != 0;
 };
 
+vector<Address> ScanQueue::pendingPoints() const {
+    vector<Address> ret;
+    ret.reserve(queue.size());
+    for (const Destination &d : queue) ret.push_back(d.address);
+    return ret;
+}
+
+CpuStateRef ScanQueue::snapshot(const CpuState &regs) {
+    auto &bucket = statePool[regs.hash()];
+    for (const auto &s : bucket) {
+        if (*s == regs) return s;
+    }
+    return bucket.emplace_back(std::make_shared<const CpuState>(regs));
+}
+
+void ScanQueue::indexEntrypoints() const {
+    // entrypoints replaced with a shorter list, start over
+    if (epIndexed > entrypoints.size()) {
+        epAddrIndex.clear();
+        epNameIndex.clear();
+        epIdxIndex.clear();
+        epIndexed = 0;
+    }
+    for (; epIndexed < entrypoints.size(); ++epIndexed) {
+        const RoutineEntrypoint &ep = entrypoints[epIndexed];
+        epAddrIndex.emplace(ep.addr.toLinear(), epIndexed);
+        epIdxIndex.emplace(ep.idx, epIndexed);
+        epNameIndex.emplace(ep.name, epIndexed);
+    }
+}
+
 RoutineIdx ScanQueue::isEntrypoint(const Address &addr) const {
-    const auto &found = std::find(entrypoints.begin(), entrypoints.end(), addr);
-    if (found != entrypoints.end()) return found->idx;
+    indexEntrypoints();
+    const auto found = epAddrIndex.find(addr.toLinear());
+    if (found != epAddrIndex.end()) return entrypoints[found->second].idx;
     else return NULL_ROUTINE;
 }
 
 RoutineEntrypoint ScanQueue::getEntrypoint(const std::string &name) const {
-    const auto &found = std::find_if(entrypoints.begin(), entrypoints.end(), [&](const RoutineEntrypoint &ep){
-        return ep.name == name;
-    });
-    if (found != entrypoints.end()) return *found;
+    indexEntrypoints();
+    const auto found = epNameIndex.find(name);
+    if (found != epNameIndex.end()) return entrypoints[found->second];
     return {};
 }
 
 RoutineEntrypoint ScanQueue::getEntrypoint(const RoutineIdx idx) const {
-    const auto &found = std::find_if(entrypoints.begin(), entrypoints.end(), [&](const RoutineEntrypoint &ep){
-        return ep.idx == idx;
-    });
-    if (found != entrypoints.end()) return *found;
+    indexEntrypoints();
+    const auto found = epIdxIndex.find(idx);
+    if (found != epIdxIndex.end()) return entrypoints[found->second];
     return {};
 }
 
+bool ScanQueue::nameEntrypoint(const Address &addr, const std::string &name) {
+    indexEntrypoints();
+    const auto found = epAddrIndex.find(addr.toLinear());
+    if (found == epAddrIndex.end()) return false;
+    RoutineEntrypoint &ep = entrypoints[found->second];
+    const auto named = epNameIndex.find(ep.name);
+    if (named != epNameIndex.end() && named->second == found->second) epNameIndex.erase(named);
+    ep.name = name;
+    epNameIndex.emplace(name, found->second);
+    return true;
+}
+
 // return the set of routines found by the queue, these will only have the entrypoint set and an automatic name generated
 vector<Routine> ScanQueue::getRoutines() const {
     auto routines = vector<Routine>{routineCount()};
@@ -132,22 +298,12 @@ vector<Routine> ScanQueue::getRoutines() const {
 // TODO: proper segments
 vector<Block> ScanQueue::getUnvisited() const {
     vector<Block> ret;
-    Offset off = 0;
-    Block curBlock;
-    // iterate over contents of visited map
-    for (const RoutineIdx idx : visited) {
-        if (idx == NULL_ROUTINE && !curBlock.begin.isValid()) { 
-            // switching to unvisited, open new block
-            curBlock.begin = Address{off};
-        }
-        else if (idx != NULL_ROUTINE && curBlock.begin.isValid()) { 
-            // switching to visited, close current block if open
-            curBlock.end = Address{off - 1};
-            curBlock.relocate(origin.segment);
-            ret.push_back(curBlock);
-            curBlock = Block();
-        }
-        off += 1;
+    for (auto run = visited.next(0, NULL_ROUTINE); run.size() != 0; run = visited.next(run.end, NULL_ROUTINE)) {
+        // a trailing unvisited run is never closed by a visited byte, so it is not reported
+        if (run.end == visited.size()) break;
+        Block b{Address{run.begin}, Address{run.end - 1}};
+        b.relocate(origin.segment);
+        ret.push_back(b);
     }
     return ret;
 }
@@ -175,7 +331,7 @@ bool ScanQueue::saveCall(const Address &dest, const CpuState &regs, const bool n
     else { // not a known entrypoint and not yet in queue
         destId = getRoutineIdx(dest.toLinear());
         RoutineIdx newRoutineIdx = routineCount() + 1;
-        queue.emplace_back(Destination(dest, newRoutineIdx, true, regs));
+        pushBack(Destination(dest, newRoutineIdx, true, snapshot(regs)));
         if (destId == NULL_ROUTINE)
             debug("Call destination not belonging to any routine, claiming as entrypoint for new routine " + to_string(newRoutineIdx) + ", queue size = " + to_string(size()));
         else 
@@ -208,7 +364,7 @@ bool ScanQueue::saveJump(const Address &dest, const CpuState &regs) {
             debug("Unable to move jump destination " + destCopy.toString() + " to segment of routine " + ep.toString() + ", ignoring");
             return false;
         }
-        queue.emplace_front(Destination(destCopy, curSearch.routineIdx, false, regs));
+        pushFront(Destination(destCopy, curSearch.routineIdx, false, snapshot(regs)));
         debug("Jump destination not yet visited, scheduled visit from routine " + to_string(curSearch.routineIdx) + ", queue size = " + to_string(size()));
         return true;
     }
@@ -259,6 +415,48 @@ void ScanQueue::dumpVisited(const string &path) const {
     }
 }
 
+void ScanQueue::saveState(std::ostream &str) const {
+    visited.save(str);
+    writeBinaryValue(str, entrypoints.size(), sizeof(DWord));
+    for (const auto &ep : entrypoints) {
+        writeBinaryValue(str, ep.addr.segment, sizeof(Word));
+        writeBinaryValue(str, ep.addr.offset, sizeof(Word));
+        writeBinaryValue(str, static_cast<DWord>(ep.idx), sizeof(DWord));
+        writeBinaryValue(str, ep.near, sizeof(Byte));
+        writeBinaryString(str, ep.name);
+    }
+}
+
+void ScanQueue::loadState(std::istream &str) {
+    VisitedMap loadedVisited;
+    loadedVisited.load(str);
+    if (loadedVisited.size() != visited.size()) 
+        throw ArgError("Visited map size mismatch: "s + hexVal(loadedVisited.size()) + " vs " + hexVal(visited.size()));
+    const Size epCount = readBinaryValue(str, sizeof(DWord));
+    if (epCount > visited.size()) throw ArgError("Invalid entrypoint count: "s + to_string(epCount));
+    if (loadedVisited.maxIdx() > static_cast<RoutineIdx>(epCount)) 
+        throw ArgError("Visited map routine index "s + to_string(loadedVisited.maxIdx()) + " past entrypoint count " + to_string(epCount));
+    vector<RoutineEntrypoint> loadedEntrypoints(epCount);
+    for (auto &ep : loadedEntrypoints) {
+        const Word segment = readBinaryValue(str, sizeof(Word));
+        const Word offset = readBinaryValue(str, sizeof(Word));
+        ep.addr = Address{segment, offset};
+        ep.idx = static_cast<RoutineIdx>(static_cast<DWord>(readBinaryValue(str, sizeof(DWord))));
+        ep.near = readBinaryValue(str, sizeof(Byte)) != 0;
+        ep.name = readBinaryString(str);
+        if (ep.idx < 1 || ep.idx > static_cast<RoutineIdx>(epCount)) 
+            throw ArgError("Invalid routine index "s + to_string(ep.idx) + " of entrypoint " + ep.addr.toString());
+    }
+    visited = std::move(loadedVisited);
+    entrypoints = std::move(loadedEntrypoints);
+    queue.clear();
+    queueIndex.clear();
+    epAddrIndex.clear();
+    epNameIndex.clear();
+    epIdxIndex.clear();
+    epIndexed = 0;
+}
+
 void ScanQueue::dumpEntrypoints() const {
     debug("Scan queue contains " + to_string(entrypoints.size()) + " entrypoints");
     for (const auto &ep : entrypoints) {
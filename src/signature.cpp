@@ -21,8 +21,9 @@ OUTPUT_CONF(LOG_ANALYSIS)
 
 SignatureLibrary::SignatureLibrary(const CodeMap &map, const Executable &exe, const Size minInstructions, const Size maxInstructions) {
     const Word loadSeg = exe.loadAddr().segment;
-    for (Size idx = 0; idx < map.routineCount(); ++idx) {
-        Routine routine = map.getRoutine(idx);
+    // reused for decoding every routine
+    InstructionArena arena;
+    for (const Routine &routine : map.getRoutines()) {
         // TODO: external also, maybe enable with switch
         if (routine.ignore || routine.external) {
             debug("Ignoring routine: " + routine.dump(false));
@@ -36,16 +37,17 @@ SignatureLibrary::SignatureLibrary(const CodeMap &map, const Executable &exe, co
             continue;
         }
         // extract string of signatures for reference routine
-        SignatureString sig = exe.getSignatures(block);
-        const Size sigSize = sig.size();
+        arena.clear();
+        const auto sigSpan = arena.signatures(exe.decodeBlock(block, arena));
+        const Size sigSize = sigSpan.size();
         if (sigSize == 0) debug("Empty signature, ignoring");
         else if (sigSize < minInstructions) debug("Routine too small: " + to_string(sigSize) + " instructions");
         else if (maxInstructions != 0 && sigSize > maxInstructions) debug("Routine too big: " + to_string(sigSize) + " instructions");
         else {
             Block extents{routine.extents};
             extents.rebase(loadSeg);
-            verbose("Extracted signature for routine " + routine.name + ", " + to_string(sig.size()) + " instructions");
-            sigs.emplace_back(SignatureItem{routine.name, extents, std::move(sig)});
+            verbose("Extracted signature for routine " + routine.name + ", " + to_string(sigSize) + " instructions");
+            sigs.emplace_back(SignatureItem{routine.name, extents, SignatureString(sigSpan.begin(), sigSpan.end())});
         }
     }
     verbose("Loaded signatures for " + to_string(sigs.size()) + " routines from executable");
@@ -112,49 +114,57 @@ void SignatureLibrary::save(const std::string &path) const {
         if (si.routineExtents.isValid())
             file << " " << si.routineExtents.toString(false, false);
         file << "/";
+        char buf[SIGNATURE_STRLEN];
+        FormatBuffer sigStr{buf, sizeof(buf)};
         for (Size j = 0; j < size; ++j) {
-            if (j != 0) file << ",";
-            file << hexVal(si.signature[j], false, false);
+            sigStr.clear();
+            if (j != 0) sigStr.put(',');
+            sigStr.hex(si.signature[j], false);
+            file << sigStr.view();
         }
-        file << endl;
+        file << '\n';
     }
 }
 
 void SignatureLibrary::dump() const {
-    const auto dumpOp = [](const OperandType ot, const InstructionPrefix p) {
+    char buf[SIGNATURE_STRLEN + INSTRUCTION_STRLEN];
+    FormatBuffer line{buf, sizeof(buf)};
+    const auto dumpOp = [&line](const OperandType ot, const InstructionPrefix p) {
         if (operandIsMem(ot)) {
-            if (prefixIsSegment(p)) cout << prefixName(p);
-            cout << "[" << operandName(ot);
+            if (prefixIsSegment(p)) line.put(prefixName(p));
+            line.put('[').put(operandName(ot));
             if (operandIsMemWithOffset(ot)) {
-                if (!operandIsMemImmediate(ot)) cout << "+";
-                if (operandIsMemWithByteOffset(ot)) cout << "off8";
-                else if (operandIsMemWithWordOffset(ot)) cout << "off16";
+                if (!operandIsMemImmediate(ot)) line.put('+');
+                if (operandIsMemWithByteOffset(ot)) line.put("off8");
+                else if (operandIsMemWithWordOffset(ot)) line.put("off16");
             }
-            cout << "]";
+            line.put(']');
         }
-        else cout << operandName(ot);
+        else line.put(operandName(ot));
     };
     for (Size i = 0; i < signatureCount(); ++i) {
         const SignatureItem &si = getSignature(i);  
-        cout << si.routineName << ": " << si.size() << " instructions" << endl;
+        cout << si.routineName << ": " << si.size() << " instructions\n";
         for (const Signature s : si.signature) {
             const InstructionPrefix p = static_cast<InstructionPrefix>((s >> 19) & 0b111);
             const InstructionClass c = static_cast<InstructionClass>((s >> 12) & 0b1111111);
             const OperandType
                 op1 = static_cast<OperandType>((s >> 6) & 0b111111),
                 op2 = static_cast<OperandType>(s & 0b111111);
-            cout << "\t";
-            if (prefixIsChain(p)) cout << prefixName(p) << " ";
-            cout << instructionName(c);
+            line.clear();
+            line.put('\t');
+            if (prefixIsChain(p)) line.put(prefixName(p)).put(' ');
+            line.put(instructionName(c));
             if (op1 > OPR_NONE) {
-                cout << " ";
+                line.put(' ');
                 dumpOp(op1, p);
             }
             if (op2 > OPR_NONE) {
-                cout << ", ";
+                line.put(", ");
                 dumpOp(op2, p);
             }
-            cout << endl;
+            cout << line.view() << '\n';
         }
     }
+    cout << flush;
 }
@@ -5,8 +5,14 @@
 #include <algorithm>
 #include <filesystem>
 #include <bitset>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <cerrno>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "dos/util.h"
 #include "dos/output.h"
@@ -200,6 +206,152 @@ std::string hexVal(const void* ptr) {
     return str.str();
 }
 
+FormatBuffer::FormatBuffer(char *data, const Size capacity) : data(data), capacity(capacity), length(0) {
+    assert(data && capacity > 0);
+    data[0] = '\0';
+}
+
+FormatBuffer& FormatBuffer::put(const char c) {
+    if (full()) return *this;
+    data[length++] = c;
+    data[length] = '\0';
+    return *this;
+}
+
+FormatBuffer& FormatBuffer::put(const char *str) {
+    return put(std::string_view{str});
+}
+
+FormatBuffer& FormatBuffer::put(std::string_view str) {
+    const Size count = std::min(str.size(), capacity - 1 - length);
+    memcpy(data + length, str.data(), count);
+    length += count;
+    data[length] = '\0';
+    return *this;
+}
+
+FormatBuffer& FormatBuffer::hex(const DWord val, const bool prefix, const int pad) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    char digits[sizeof(DWord) * 2];
+    int count = 0;
+    DWord rest = val;
+    do {
+        digits[count++] = HEX_DIGITS[rest & 0xf];
+        rest >>= 4;
+    } while (rest);
+    if (prefix) put("0x");
+    for (int i = count; i < pad; ++i) put('0');
+    while (count) put(digits[--count]);
+    return *this;
+}
+
+FormatBuffer& FormatBuffer::signedHex(const SDWord val, const int pad, const bool plus) {
+    if (val < 0) {
+        put('-');
+        return hex(static_cast<DWord>(-static_cast<int64_t>(val)), true, pad);
+    }
+    if (plus) put('+');
+    return hex(static_cast<DWord>(val), true, pad);
+}
+
+FormatBuffer& FormatBuffer::dec(const Size val) {
+    char digits[20];
+    int count = 0;
+    Size rest = val;
+    do {
+        digits[count++] = '0' + rest % 10;
+        rest /= 10;
+    } while (rest);
+    while (count) put(digits[--count]);
+    return *this;
+}
+
+FormatBuffer& FormatBuffer::fill(const Size column, const char c) {
+    while (length < column && !full()) put(c);
+    return *this;
+}
+
+void FormatBuffer::clear() {
+    length = 0;
+    data[0] = '\0';
+}
+
+MappedFile::MappedFile(const std::string &path) : path(path), data(nullptr), size(0) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw IoError("Unable to open file " + path + ": " + strerror(errno));
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        const int err = errno;
+        close(fd);
+        throw IoError("Unable to stat file " + path + ": " + strerror(err));
+    }
+    size = static_cast<Size>(statbuf.st_size);
+    if (size != 0) {
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            const int err = errno;
+            close(fd);
+            throw IoError("Unable to map file " + path + ": " + strerror(err));
+        }
+        data = static_cast<char*>(map);
+    }
+    close(fd);
+}
+
+void MappedFile::setWritable(const bool writable) {
+    if (data == nullptr) return;
+    if (mprotect(data, size, writable ? PROT_READ | PROT_WRITE : PROT_READ) != 0)
+        throw IoError("Unable to make mapping of " + path + (writable ? " writable: " : " read-only: ") + strerror(errno));
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(data, size);
+}
+
+bool TextScanner::isHex(const char c, const bool upperOnly) {
+    if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F')) return true;
+    return !upperOnly && c >= 'a' && c <= 'f';
+}
+
+bool TextScanner::line(std::string_view &out) {
+    if (atEnd()) return false;
+    const Size start = pos;
+    while (pos < text.size() && text[pos] != '\n' && text[pos] != '\r') pos++;
+    out = text.substr(start, pos - start);
+    if (pos < text.size() && text[pos++] == '\r' && pos < text.size() && text[pos] == '\n') pos++;
+    return true;
+}
+
+std::string_view TextScanner::token() {
+    space();
+    const Size start = pos;
+    while (pos < text.size() && !isSpace(text[pos])) pos++;
+    return text.substr(start, pos - start);
+}
+
+bool TextScanner::space() {
+    const Size start = pos;
+    while (pos < text.size() && isSpace(text[pos])) pos++;
+    return pos != start;
+}
+
+bool TextScanner::literal(std::string_view str) {
+    if (text.substr(pos, str.size()) != str) return false;
+    pos += str.size();
+    return true;
+}
+
+bool TextScanner::hex(Size &value, const Size maxDigits, const bool upperOnly) {
+    Size digits = 0;
+    value = 0;
+    while (pos < text.size() && digits < maxDigits && isHex(text[pos], upperOnly)) {
+        const char c = text[pos++];
+        value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        digits++;
+    }
+    return digits != 0;
+}
+
 std::string sizeStr(const Size s) {
     ostringstream str;
     str << to_string(s) << "/" << hexVal(s);
@@ -317,6 +469,41 @@ void writeBinaryFile(const std::string &path, const Byte *buf, const Size size)
     file.write(reinterpret_cast<const char*>(buf), size);
 }
 
+void writeBinaryValue(std::ostream &str, const QWord value, const Size size) {
+    assert(size <= sizeof(QWord));
+    Byte buf[sizeof(QWord)];
+    for (Size i = 0; i < size; ++i) buf[i] = static_cast<Byte>(value >> (i * 8));
+    str.write(reinterpret_cast<const char*>(buf), size);
+}
+
+QWord readBinaryValue(std::istream &str, const Size size) {
+    assert(size <= sizeof(QWord));
+    Byte buf[sizeof(QWord)];
+    if (!str.read(reinterpret_cast<char*>(buf), size)) throw IoError("Unexpected end of binary data");
+    QWord ret = 0;
+    for (Size i = 0; i < size; ++i) ret |= static_cast<QWord>(buf[i]) << (i * 8);
+    return ret;
+}
+
+void writeBinaryString(std::ostream &str, const std::string &value) {
+    writeBinaryValue(str, value.size(), sizeof(Word));
+    str.write(value.data(), value.size());
+}
+
+std::string readBinaryString(std::istream &str) {
+    string ret(readBinaryValue(str, sizeof(Word)), '\0');
+    if (!str.read(ret.data(), ret.size())) throw IoError("Unexpected end of binary data");
+    return ret;
+}
+
+QWord hashBytes(const Byte *data, const Size size, QWord basis) {
+    for (Size i = 0; i < size; ++i) {
+        basis ^= data[i];
+        basis *= 0x100000001b3ULL;
+    }
+    return basis;
+}
+
 std::string binString(const Word &value) {
     bitset<16> bits{value};
     return bits.to_string();
@@ -381,6 +568,66 @@ void erasePattern(ByteString &str, const ByteString &pat) {
     }
 }
 
+// Rough ranking of how common byte values are in 16bit x86 code and data, the higher the more common. Used for picking an anchor 
+// byte of a search pattern, the exact order does not matter much, only that zeroes, 0xff and the most frequent opcodes and modrm bytes 
+// are avoided.
+static constexpr auto BYTE_COMMONNESS = []{
+    std::array<Byte, 256> ret{};
+    constexpr Byte common[] = { 
+        0x74, 0x75, 0xeb, 0xc3, 0x5d, 0x55, 0xec, 0x04, 0x02, 0x83, 0x76, 0x56, 0x50, 0x7e,
+        0xe8, 0x26, 0x5e, 0x06, 0x01, 0x46, 0x89, 0x8b, 0xff, 0x00 
+    };
+    for (Size i = 0; i < ARRAY_SIZE(common); ++i) ret[common[i]] = i + 1;
+    return ret;
+}();
+
+// Returns the offset of the first occurrence of a pattern within the data, -1 in the pattern matches any byte. 
+// Returns the size of the data if the pattern is not found. The rarest fixed byte of the pattern is used as an anchor 
+// and located with memchr(), a candidate which fails verification is skipped past with a Horspool shift table
+// which takes the wildcards into account.
+Size findPattern(const Byte *data, const Size size, const ByteString &pattern) {
+    const Size patSize = pattern.size();
+    if (patSize == 0) return 0;
+    if (patSize > size) return size;
+    // the last fixed byte decides the shift, the anchor is the rarest fixed byte
+    Size last = patSize, anchor = patSize;
+    for (Size i = 0; i < patSize; ++i) {
+        const SWord pat = pattern[i];
+        if (pat == -1) continue;
+        // not a byte value, cannot match anything
+        if (pat < 0 || pat > 0xff) return size;
+        last = i;
+        if (anchor == patSize || BYTE_COMMONNESS[pat] < BYTE_COMMONNESS[pattern[anchor]]) anchor = i;
+    }
+    // all wildcards, matches right away
+    if (anchor == patSize) return 0;
+    // the pattern can be shifted until the byte under its last fixed position lines up with an identical byte or a wildcard
+    Size shift[256];
+    std::fill(std::begin(shift), std::end(shift), last + 1);
+    for (Size i = 0; i < last; ++i) {
+        const SWord pat = pattern[i];
+        if (pat == -1) std::fill(std::begin(shift), std::end(shift), last - i);
+        else shift[pat] = last - i;
+    }
+    const Byte anchorByte = static_cast<Byte>(pattern[anchor]);
+    const Size lastStart = size - patSize;
+    Size pos = 0;
+    while (pos <= lastStart) {
+        const void *hit = memchr(data + pos + anchor, anchorByte, lastStart - pos + 1);
+        if (hit == nullptr) break;
+        pos = static_cast<const Byte*>(hit) - data - anchor;
+        const Byte *window = data + pos;
+        bool match = true;
+        for (Size i = last + 1; i-- > 0;) {
+            const SWord pat = pattern[i];
+            if (pat != -1 && pat != window[i]) { match = false; break; }
+        }
+        if (match) return pos;
+        pos += shift[window[last]];
+    }
+    return size;
+}
+
 std::vector<std::string> extractRegex(const std::regex &re, const std::string &str) {
     smatch match;
     if (!regex_match(str, match, re)) return {};
@@ -0,0 +1,112 @@
+#include "dos/xref.h"
+#include "dos/util.h"
+#include "dos/error.h"
+#include "dos/output.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+OUTPUT_CONF(LOG_ANALYSIS)
+
+static constexpr DWord XREF_MAGIC = 0x52585a4d; // "MZXR"
+static constexpr Word XREF_VERSION = 1;
+
+string xrefKindName(const XrefKind kind) {
+    static const string names[] = { "read", "write", "call", "jump" };
+    if (kind > XREF_JUMP) return "unknown";
+    return names[kind];
+}
+
+XrefIndex::XrefIndex(vector<Xref> refs) {
+    std::sort(refs.begin(), refs.end(), [](const Xref &a, const Xref &b) {
+        if (a.target != b.target) return a.target < b.target;
+        if (a.source != b.source) return a.source < b.source;
+        return a.kind < b.kind;
+    });
+    refs.erase(std::unique(refs.begin(), refs.end(), [](const Xref &a, const Xref &b) {
+        return a.target == b.target && a.source == b.source && a.kind == b.kind;
+    }), refs.end());
+    linear_.reserve(refs.size());
+    targets_.reserve(refs.size());
+    sources_.reserve(refs.size());
+    kinds_.reserve(refs.size());
+    for (const Xref &x : refs) {
+        linear_.push_back(x.target.toLinear());
+        targets_.push_back(x.target);
+        sources_.push_back(x.source);
+        kinds_.push_back(x.kind);
+    }
+    debug("Built cross-reference index of " + to_string(size()) + " references");
+}
+
+XrefIndex::Range XrefIndex::refsTo(const Address &target) const {
+    const auto range = std::equal_range(linear_.begin(), linear_.end(), target.toLinear());
+    return { static_cast<Size>(range.first - linear_.begin()), static_cast<Size>(range.second - linear_.begin()) };
+}
+
+XrefIndex::Range XrefIndex::refsTo(const Block &area) const {
+    if (!area.isValid()) return { 0, 0 };
+    const auto first = std::lower_bound(linear_.begin(), linear_.end(), area.begin.toLinear());
+    const auto last = std::upper_bound(first, linear_.end(), area.end.toLinear());
+    return { static_cast<Size>(first - linear_.begin()), static_cast<Size>(last - linear_.begin()) };
+}
+
+vector<Xref> XrefIndex::refs() const {
+    vector<Xref> ret;
+    ret.reserve(size());
+    for (Size i = 0; i < size(); ++i) ret.push_back(at(i));
+    return ret;
+}
+
+static void writeAddress(ostream &str, Address addr, const Word reloc) {
+    addr.rebase(reloc);
+    writeBinaryValue(str, addr.segment, sizeof(Word));
+    writeBinaryValue(str, addr.offset, sizeof(Word));
+}
+
+static Address readAddress(istream &str, const Word reloc) {
+    const Word segment = readBinaryValue(str, sizeof(Word));
+    const Word offset = readBinaryValue(str, sizeof(Word));
+    Address ret{segment, offset};
+    ret.relocate(reloc);
+    return ret;
+}
+
+void XrefIndex::save(const string &path, const Word reloc) const {
+    // references to memory below the load segment (e.g. the PSP or interrupt vectors) cannot be stored relative to it
+    Size skip = 0;
+    for (const Address &t : targets_) if (t.segment < reloc) skip++;
+    debug("Saving " + to_string(size() - skip) + " cross-references to " + path + ", reversing relocation by " + hexVal(reloc) + ", skipping " + to_string(skip) + " below load segment");
+    ofstream file{path, ios::binary};
+    writeBinaryValue(file, XREF_MAGIC, sizeof(DWord));
+    writeBinaryValue(file, XREF_VERSION, sizeof(Word));
+    writeBinaryValue(file, size() - skip, sizeof(DWord));
+    for (Size i = 0; i < size(); ++i) {
+        if (targets_[i].segment < reloc) continue;
+        writeAddress(file, targets_[i], reloc);
+        writeAddress(file, sources_[i], reloc);
+        writeBinaryValue(file, kinds_[i], sizeof(Byte));
+    }
+    if (!file) throw IoError("Unable to write cross-references: " + path);
+}
+
+XrefIndex::XrefIndex(const string &path, const Word reloc) {
+    ifstream file{path, ios::binary};
+    if (!file) throw IoError("Unable to open cross-references: " + path);
+    if (readBinaryValue(file, sizeof(DWord)) != XREF_MAGIC || readBinaryValue(file, sizeof(Word)) != XREF_VERSION)
+        throw IoError("Unsupported cross-reference format: " + path);
+    const Size count = readBinaryValue(file, sizeof(DWord));
+    for (Size i = 0; i < count; ++i) {
+        const Address target = readAddress(file, reloc);
+        const Address source = readAddress(file, reloc);
+        const auto kind = static_cast<XrefKind>(readBinaryValue(file, sizeof(Byte)));
+        if (kind > XREF_JUMP) throw IoError("Invalid cross-reference kind in " + path);
+        if (!linear_.empty() && target.toLinear() < linear_.back()) throw IoError("Cross-references out of order in " + path);
+        linear_.push_back(target.toLinear());
+        targets_.push_back(target);
+        sources_.push_back(source);
+        kinds_.push_back(kind);
+    }
+}
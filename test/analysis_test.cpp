@@ -1,5 +1,10 @@
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <sstream>
+#include <fstream>
 #include "debug.h"
 #include "gtest/gtest.h"
 #include "dos/util.h"
@@ -9,19 +14,24 @@
 #include "dos/opcodes.h"
 #include "dos/executable.h"
 #include "dos/editdistance.h"
+#include "dos/output.h"
 
 using namespace std;
 
 class AnalysisTest : public ::testing::Test {
 protected:
     // wrappers for access to private members, no this is not a black box test, why you ask?
-    auto& getRoutines(CodeMap &rm) { return rm.routines; }
+    auto& getRoutines(CodeMap &rm) { rm.indexed = false; return rm.routines; }
+    auto& getVariables(CodeMap &rm) { rm.indexed = false; return rm.vars; }
     void setMapSize(CodeMap &rm, const Size size) { rm.mapSize = size; }
     auto emptyCodeMap() { return CodeMap(); }
     auto emptyScanQueue() { return ScanQueue(); }
     auto& sqOrigin(ScanQueue &sq) { return sq.origin; }
     auto& sqVisited(ScanQueue &sq) { return sq.visited; }
     auto& sqEntrypoints(ScanQueue &sq) { return sq.entrypoints; }
+    auto& sqQueue(ScanQueue &sq) { return sq.queue; }
+    auto& analyzerQueue(Analyzer &a) { return a.scanQueue; }
+    Byte* exeData(Executable &exe, const Address &addr) { return exe.code.data() + (addr.toLinear() - exe.codeBase); }
     void mapSetSegments(CodeMap &rm, const vector<Segment> &segments) { rm.setSegments(segments); }
     const vector<Block>& getUnclaimed(const CodeMap &rm) { return rm.unclaimed; }
     auto analyzerInstructionMatch(Analyzer &a, const Executable &ref, const Executable &tgt, const Instruction &refInstr, const Instruction &tgtInstr) { 
@@ -50,7 +60,29 @@ protected:
         }
         return true;
     }
-    void writeExeData(Executable &exe, const Address &addr, const Byte value) { return exe.code.writeByte(addr.toLinear(), value); }
+    // whole contents of a saved map, call graph, cache etc. for comparisons
+    string fileText(const string &path) {
+        ifstream file{path, ios::binary};
+        return string{istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+    }
+    string mapText(const CodeMap &map, const string &path = "test.map") {
+        map.save(path, 0x1000, true);
+        return fileText(path);
+    }
+    void writeExeData(Executable &exe, const Address &addr, const Byte value) { exe.instrCache.clear(); exe.code[addr.toLinear() - exe.codeBase] = value; }
+    // synthetic code made of a sequence of calls to many single instruction routines:
+    // call routine_1; call routine_2; ...; jmp $; routine_1: ret; routine_2: ret; ...
+    vector<Byte> manyRoutinesCode(const Size count) {
+        vector<Byte> code;
+        const Size callsSize = count * 3 + 2;
+        for (Size i = 0; i < count; ++i) {
+            const Word rel = static_cast<Word>(callsSize + i - (i * 3 + 3));
+            code.insert(code.end(), { 0xe8, lowByte(rel), hiByte(rel) });
+        }
+        code.insert(code.end(), { 0xeb, 0xfe });
+        code.insert(code.end(), count, 0xc3);
+        return code;
+    }
 };
 
 // TODO: divest tests of analysis.cpp as distinct test suite
@@ -117,6 +149,37 @@ TEST_F(AnalysisTest, CpuState) {
     TRACELN(rs.toString());    
 }
 
+TEST_F(AnalysisTest, CpuStateSnapshots) {
+    CpuState s1, s2;
+    ASSERT_EQ(s1, s2);
+    s1.setValue(REG_AH, 0x12);
+    ASSERT_FALSE(s1 == s2);
+    s2.setValue(REG_AX, 0x1234);
+    s2.setUnknown(REG_AL);
+    // unknown values do not count
+    ASSERT_EQ(s1, s2);
+    ASSERT_EQ(s1.hash(), s2.hash());
+    // the oldest values fall out of a full stack
+    for (Word v = 0; v < CpuState::STACK_CAPACITY + 2; ++v) s1.push(v);
+    for (Word v = CpuState::STACK_CAPACITY + 2; v > 2; --v) ASSERT_EQ(s1.pop(), v - 1);
+    ASSERT_TRUE(s1.stackEmpty());
+    s1.push(0xabcd);
+    ASSERT_FALSE(s1 == s2);
+    s2.push(0xabcd);
+    ASSERT_EQ(s1, s2);
+
+    // destinations saved with equal states share a snapshot
+    ScanQueue sq{Address{0x1000, 0}, 0x100, {}};
+    ASSERT_TRUE(sq.saveCall(Address{0x1000, 0x10}, s1, true));
+    ASSERT_TRUE(sq.saveCall(Address{0x1000, 0x20}, s2, true));
+    ASSERT_TRUE(sq.saveCall(Address{0x1000, 0x30}, CpuState{}, true));
+    const auto &queue = sqQueue(sq);
+    ASSERT_EQ(queue.size(), 3);
+    ASSERT_EQ(queue[0].regs, queue[1].regs);
+    ASSERT_NE(queue[0].regs, queue[2].regs);
+    ASSERT_EQ(*queue[2].regs, CpuState{});
+}
+
 TEST_F(AnalysisTest, CodeMap) {
     // test loading of routine map from ida file
     const CodeMap idaMap{"../bin/hello.lst", 0, CodeMap::MAP_IDALST};
@@ -145,7 +208,7 @@ TEST_F(AnalysisTest, CodeMap) {
 TEST_F(AnalysisTest, CodeMapFromQueue) {
     // test routine map generation from contents of a search queue
     ScanQueue sq = emptyScanQueue();
-    vector<RoutineIdx> &visited = sqVisited(sq);
+    vector<RoutineIdx> visited;
     vector<RoutineEntrypoint> &entrypoints = sqEntrypoints(sq);
     const Word loadSegment = 0;
     vector<Segment> segments = {
@@ -164,6 +227,7 @@ TEST_F(AnalysisTest, CodeMapFromQueue) {
     // force the end of the routine map to overflow the segment
     // where the last (unreachable) block starts
     visited.insert(visited.end(), 70000, 0);
+    sqVisited(sq) = VisitedMap{visited};
     entrypoints = { {0x8, 1}, {0xc, 2}, {0x13, 3} };
     CodeMap queueMap{sq, segments, {}, loadSegment, visited.size()};
     TRACE(queueMap.getSummary().text);
@@ -207,6 +271,46 @@ TEST_F(AnalysisTest, CodeMapFromQueue) {
     TRACE(queueMap.getSummary().text);
 }
 
+TEST_F(AnalysisTest, CodeMapFromLargeQueue) {
+    // a mostly empty search queue spanning many segments, blocks should be built per run and not per byte
+    ScanQueue sq = emptyScanQueue();
+    vector<RoutineIdx> visited(0x96000, 0);
+    vector<Segment> segments;
+    for (Word s = 0; s < 0xa; ++s) segments.push_back({"TestSeg" + to_string(s), Segment::SEG_CODE, static_cast<Word>(s * 0x1000)});
+    fill(visited.begin() + 0x100, visited.begin() + 0x200, 1);
+    fill(visited.begin() + 0x300, visited.begin() + 0x380, 1);
+    fill(visited.begin() + 0x45000, visited.begin() + 0x46000, 2);
+    sqVisited(sq) = VisitedMap{visited};
+    sqEntrypoints(sq) = { {0x100, 1}, {0x45000, 2} };
+    const auto start = chrono::steady_clock::now();
+    CodeMap queueMap{sq, segments, {}, 0, visited.size()};
+    const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    TRACELN("Built map of " << visited.size() << " bytes in " << elapsed.count() << "us");
+    ASSERT_EQ(queueMap.routineCount(), 2);
+
+    Routine r1 = queueMap.getRoutine(0);
+    ASSERT_EQ(r1.reachable.size(), 2);
+    ASSERT_EQ(r1.reachable.at(0), Block(0x100, 0x1ff));
+    ASSERT_EQ(r1.reachable.at(1), Block(0x300, 0x37f));
+    ASSERT_EQ(r1.unreachable.size(), 1);
+    ASSERT_EQ(r1.unreachable.at(0), Block(0x200, 0x2ff));
+
+    Routine r2 = queueMap.getRoutine(1);
+    ASSERT_EQ(r2.extents, Block(0x45000, 0x45fff));
+    ASSERT_EQ(r2.reachable.size(), 1);
+    ASSERT_EQ(r2.unreachable.size(), 0);
+
+    // the gaps are split on segment boundaries
+    const auto &unclaimed = getUnclaimed(queueMap);
+    ASSERT_EQ(unclaimed.size(), 12);
+    ASSERT_EQ(unclaimed.at(0), Block(0x0, 0xff));
+    ASSERT_EQ(unclaimed.at(1), Block(0x380, 0xffff));
+    ASSERT_EQ(unclaimed.at(2), Block(0x10000, 0x1ffff));
+    ASSERT_EQ(unclaimed.at(5), Block(0x40000, 0x44fff));
+    ASSERT_EQ(unclaimed.at(6), Block(0x46000, 0x4ffff));
+    ASSERT_EQ(unclaimed.at(11), Block(0x90000, 0x95fff));
+}
+
 TEST_F(AnalysisTest, CodeMapFromLinkMap) {
     const string path{"../bin/link.map"};
     CodeMap linkMap{path, 0, CodeMap::MAP_MSLINK};
@@ -217,6 +321,163 @@ TEST_F(AnalysisTest, BigCodeMap) {
     ASSERT_EQ(rm.routineCount(), 400);
 }
 
+TEST_F(AnalysisTest, MapParsers) {
+    struct Fixture { string path; CodeMap::Type type; Size size, segments, routines, vars; string routine; Address entrypoint; };
+    const vector<Fixture> fixtures = {
+        { "../bin/egame.map", CodeMap::MAP_MZRE, 0x28f70, 7, 400, 1022, "routine_7", {0x1000, 0x10} },
+        { "../bin/hello.lst", CodeMap::MAP_IDALST, 0x1a43, 3, 54, 73, "main", {0x1000, 0x10} },
+        { "../bin/link.map", CodeMap::MAP_MSLINK, 0x6fe15, 88, 976, 848, "_Load3DPlaneInfo", {0, 6} },
+    };
+    for (const auto &f : fixtures) {
+        const auto start = chrono::steady_clock::now();
+        const CodeMap map{f.path, 0x1000, f.type};
+        const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        TRACELN("Loaded " << f.path << " in " << elapsed.count() << "ms: " << map.segmentCount() << " segments, " << map.routineCount() << " routines, " << map.variableCount() << " variables");
+        ASSERT_EQ(map.codeSize(), f.size);
+        ASSERT_EQ(map.segmentCount(), f.segments);
+        ASSERT_EQ(map.routineCount(), f.routines);
+        ASSERT_EQ(map.variableCount(), f.vars);
+        ASSERT_EQ(map.getRoutine(f.routine).entrypoint(), f.entrypoint);
+    }
+
+    // mixed line endings, no terminator on the last line
+    const string path = "parse.map";
+    const auto writeMap = [&](const string &text) { ofstream{path, ios::binary} << text; };
+    writeMap("Size 10\r\nS1 CODE 0000\rr1: S1 NEAR 0000-0005 R0000-0005  U0006-0007 complete\nv1: S1 VAR 0008 bss");
+    const CodeMap map{path, 0x1000};
+    ASSERT_EQ(map.routineCount(), 1);
+    const Routine r = map.getRoutine("r1");
+    ASSERT_TRUE(r.complete);
+    ASSERT_EQ(r.unreachable.size(), 1);
+    ASSERT_TRUE(map.getVariable("v1").bss);
+    // malformed lines
+    writeMap("Size 10\nS1 CODE 0000\nv1: S1 VAR 0008 bogus\n");
+    ASSERT_THROW(CodeMap(path, 0x1000), ParseError);
+    writeMap("Size 10\nS1 CODE 0000\nr1: S1 NEAR 0000-00005\n");
+    ASSERT_THROW(CodeMap(path, 0x1000), ParseError);
+    writeMap("Size 10 \nS1 CODE 0000\n");
+    ASSERT_THROW(CodeMap(path, 0x1000), ParseError);
+}
+
+TEST_F(AnalysisTest, MapLookups) {
+    CodeMap map{"../bin/egame.map", 0x1000};
+    // accessors refer to the map contents without copying
+    ASSERT_EQ(&map.getRoutines()[5], &map.getRoutine(5));
+    ASSERT_EQ(&map.getVariables()[5], &map.getVariable(5));
+    for (const Routine &r : map.getRoutines()) {
+        const Routine *byName = map.findRoutine(r.name), *byEp = map.findEntrypoint(r.entrypoint());
+        ASSERT_NE(byName, nullptr);
+        ASSERT_EQ(byName->name, r.name);
+        ASSERT_NE(byEp, nullptr);
+        ASSERT_EQ(byEp->entrypoint(), r.entrypoint());
+    }
+    for (const Variable &v : map.getVariables()) {
+        const Variable *byName = map.findVariable(v.name), *byAddr = map.findVariable(v.addr);
+        ASSERT_NE(byName, nullptr);
+        ASSERT_EQ(byName->name, v.name);
+        ASSERT_NE(byAddr, nullptr);
+        ASSERT_EQ(byAddr->addr, v.addr);
+    }
+    ASSERT_EQ(map.findRoutine("routine_7")->entrypoint(), Address(0x1000, 0x10));
+    ASSERT_EQ(map.findRoutine(string{"nonexistent"}), nullptr);
+    ASSERT_EQ(map.findVariable(string{"nonexistent"}), nullptr);
+    ASSERT_EQ(map.findEntrypoint(Address{0x1000, 0x11}), nullptr);
+    // the indexes follow modifications
+    map.getMutableRoutine(0).name = "renamed";
+    ASSERT_EQ(map.findRoutine("renamed"), &map.getRoutine(0));
+    Routine &added = map.getMutableRoutine("added");
+    ASSERT_EQ(map.findRoutine("added"), &added);
+}
+
+TEST_F(AnalysisTest, BinaryMap) {
+    const Word loadSegment = 0x1000;
+    const auto readText = [](const string &path) { ostringstream str; str << ifstream{path}.rdbuf(); return str.str(); };
+    CodeMap textMap{"../bin/egame.map", loadSegment};
+    textMap.getMutableRoutine(3).addComment("first comment");
+    textMap.getMutableRoutine(3).addComment("second comment");
+    textMap.saveBinary("egame.bmap", loadSegment, true);
+    ASSERT_THROW(textMap.saveBinary("egame.bmap", loadSegment), AnalysisError);
+
+    auto start = chrono::steady_clock::now();
+    const CodeMap binMap{"egame.bmap", loadSegment};
+    const auto binTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    start = chrono::steady_clock::now();
+    const CodeMap reloaded{"../bin/egame.map", loadSegment};
+    const auto textTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    TRACELN("Loaded " << binMap.routineCount() << " routines, " << binMap.variableCount() << " variables from binary map in " << binTime.count() << "us, text map in " << textTime.count() << "us");
+
+    ASSERT_EQ(binMap.codeSize(), textMap.codeSize());
+    ASSERT_EQ(binMap.segmentCount(), textMap.segmentCount());
+    ASSERT_EQ(binMap.routineCount(), textMap.routineCount());
+    ASSERT_EQ(binMap.variableCount(), textMap.variableCount());
+    ASSERT_TRUE(std::ranges::equal(binMap.getUnclaimed(), textMap.getUnclaimed()));
+    for (Size i = 0; i < textMap.routineCount(); ++i) {
+        const Routine r1 = textMap.getRoutine(i), r2 = binMap.getRoutine(i);
+        ASSERT_EQ(r1.idx, r2.idx);
+        ASSERT_EQ(r1.reachable, r2.reachable);
+        ASSERT_EQ(r1.unreachable, r2.unreachable);
+        ASSERT_EQ(r1.comments, r2.comments);
+    }
+    ASSERT_EQ(binMap.getRoutine(3).comments.size(), 2);
+    // the text rendering is the same, relocated or not
+    textMap.save("egame_text.map", loadSegment, true);
+    binMap.save("egame_bin.map", loadSegment, true);
+    ASSERT_EQ(readText("egame_text.map"), readText("egame_bin.map"));
+    Block moved = textMap.getRoutine(5).extents;
+    moved.relocate(0x1000);
+    ASSERT_EQ(CodeMap("egame.bmap", 0x2000).getRoutine(5).extents, moved);
+
+    // lookups work on the index built after loading
+    const Routine r = textMap.getRoutine(10);
+    ASSERT_EQ(binMap.getRoutine(r.entrypoint()).name, r.name);
+
+    // the map source is preserved
+    const CodeMap idaMap{"../bin/hello.lst", loadSegment, CodeMap::MAP_IDALST};
+    idaMap.saveBinary("hello.bmap", loadSegment, true);
+    ASSERT_TRUE(CodeMap("hello.bmap", loadSegment).isIda());
+
+    // truncated file
+    const string data = readText("egame.bmap");
+    ofstream{"bad.bmap", ios::binary} << data.substr(0, data.size() / 2);
+    ASSERT_THROW(CodeMap("bad.bmap", loadSegment), IoError);
+}
+
+TEST_F(AnalysisTest, RoutineLookupBenchmark) {
+    const Size QUERIES = 20000;
+    CodeMap rm{"../bin/egame.map", 0x1000};
+    const auto &routines = getRoutines(rm);
+    // the linear search which the index replaced
+    const auto naiveFind = [&](const Address &addr) -> const Routine* {
+        for (const Routine &r : routines) {
+            if (r.extents.contains(addr)) return &r;
+            for (const Block &b : r.reachable) if (b.contains(addr)) return &r;
+        }
+        return nullptr;
+    };
+    mt19937 rng{1234};
+    const Offset base = SEG_TO_OFFSET(0x1000);
+    vector<Address> queries;
+    for (Size i = 0; i < QUERIES; ++i) queries.emplace_back(base + rng() % rm.codeSize());
+    Size found = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Address &a : queries) if (rm.findRoutine(a)) found++;
+    const auto indexed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    Size naiveFound = 0;
+    start = chrono::steady_clock::now();
+    for (const Address &a : queries) if (naiveFind(a)) naiveFound++;
+    const auto naive = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    TRACELN("Looked up " << QUERIES << " addresses among " << rm.routineCount() << " routines, found " << found << " in " << indexed.count() 
+        << "us, naive search " << naive.count() << "us");
+    ASSERT_EQ(found, naiveFound);
+    ASSERT_NE(found, 0);
+    for (Size i = 0; i < QUERIES; i += 7) ASSERT_EQ(rm.findRoutine(queries[i]), naiveFind(queries[i]));
+    // collisions of blocks against the whole map
+    for (const Routine &r : routines) {
+        ASSERT_EQ(rm.colidesBlock(r.extents).name, r.name);
+        for (const Block &b : r.unreachable) ASSERT_EQ(rm.findCollision(b), b);
+    }
+}
+
 TEST_F(AnalysisTest, FindRoutines) {
     const Word loadSegment = 0x1234;
     const Size expectedFound = 40;
@@ -645,6 +906,521 @@ TEST_F(AnalysisTest, FindDuplicates) {
     ASSERT_EQ(foundDuplicates, expectedDuplicates);
 }
 
+TEST_F(AnalysisTest, InstructionCache) {
+    const Word loadSegment = 0x1234;
+    MzImage mz{"../bin/hello.exe", loadSegment};
+    Executable exe{mz};
+    ASSERT_EQ(exe.instructionCacheHits(), 0);
+    ASSERT_EQ(exe.instructionCacheMisses(), 0);
+    // first access decodes, second one is served from the cache
+    const Address ep = exe.entrypoint();
+    const Instruction i1 = exe.getInstruction(ep);
+    ASSERT_EQ(exe.instructionCacheMisses(), 1);
+    const Instruction i2 = exe.getInstruction(ep);
+    ASSERT_EQ(exe.instructionCacheHits(), 1);
+    ASSERT_EQ(i1.toString(), i2.toString());
+    ASSERT_EQ(i1.length, i2.length);
+    // the same linear location through a different segment:offset pair hits the cache, but keeps the requested address
+    Address alias = ep;
+    alias.move(ep.segment - 1);
+    ASSERT_EQ(alias.toLinear(), ep.toLinear());
+    const Instruction i3 = exe.getInstruction(alias);
+    ASSERT_EQ(exe.instructionCacheHits(), 2);
+    ASSERT_EQ(i3.addr, alias);
+    ASSERT_EQ(i3.data, exe.codePointer(ep));
+    // cached result must be identical to a fresh decode
+    const Instruction fresh{ep, exe.codePointer(ep)};
+    ASSERT_EQ(i1.match(fresh), INS_MATCH_FULL);
+    ASSERT_EQ(i1.signature(), fresh.signature());
+    // repeated passes over the same code decode nothing new
+    Analyzer a{Analyzer::Options()};
+    const CodeMap map = a.exploreCode(exe);
+    TRACELN(exe.instructionCacheInfo());
+    Size decoded = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (Size i = 0; i < map.routineCount(); ++i) {
+            const Block b = map.getRoutine(i).mainBlock();
+            if (b.isValid()) exe.getSignatures(b);
+        }
+        TRACELN(exe.instructionCacheInfo());
+        if (pass == 0) decoded = exe.instructionCacheMisses();
+    }
+    ASSERT_EQ(exe.instructionCacheMisses(), decoded);
+    ASSERT_GT(exe.instructionCacheHits(), 2);
+}
+
+TEST_F(AnalysisTest, DecodeBlock) {
+    const Word loadSegment = 0x1234;
+    MzImage mz{"../bin/hello.exe", loadSegment};
+    Executable exe{mz};
+    Analyzer a{Analyzer::Options()};
+    const CodeMap map = a.exploreCode(exe);
+    // decode the main blocks of all routines into a single arena, one after another
+    InstructionArena arena;
+    vector<pair<Block, InstructionArena::Span>> spans;
+    for (Size i = 0; i < map.routineCount(); ++i) {
+        const Block b = map.getRoutine(i).mainBlock();
+        if (!b.isValid()) continue;
+        const auto span = exe.decodeBlock(b, arena);
+        if (!spans.empty()) {
+            ASSERT_EQ(span.begin, spans.back().second.begin + spans.back().second.count);
+        }
+        spans.emplace_back(b, span);
+    }
+    ASSERT_FALSE(spans.empty());
+    ASSERT_EQ(arena.size(), spans.back().second.begin + spans.back().second.count);
+    for (const auto &[block, span] : spans) {
+        const auto sigs = exe.getSignatures(block);
+        const auto arenaSigs = arena.signatures(span);
+        ASSERT_EQ(sigs, vector<Signature>(arenaSigs.begin(), arenaSigs.end()));
+        ASSERT_EQ(exe.instructionCount(block), span.count);
+        for (Size i = 0; i < span.count; ++i) {
+            const Instruction instr = exe.getInstruction(Address{arena.offsets(span)[i]});
+            ASSERT_EQ(arena.lengths(span)[i], instr.length);
+            ASSERT_EQ(arena.keys(span)[i], instr.key);
+        }
+        ASSERT_EQ(arena.offsets(span).front(), block.begin.toLinear());
+        ASSERT_LE(arena.offsets(span).back() + arena.lengths(span).back() - 1, block.end.toLinear() + INSTRUCTION_MAX_LENGTH);
+    }
+    // the arena is reused after clearing
+    arena.clear();
+    ASSERT_EQ(arena.size(), 0);
+    const auto span = exe.decodeBlock(spans.front().first, arena);
+    ASSERT_EQ(span.begin, 0);
+    ASSERT_EQ(span.count, spans.front().second.count);
+    ASSERT_THROW(exe.decodeBlock(Block{}, arena), ArgError);
+}
+
+// Explores synthetic executables with increasing routine counts on increasing thread counts, reports the time taken. 
+// Timing only, run explicitly with --gtest_also_run_disabled_tests and --debug to see the numbers.
+TEST_F(AnalysisTest, DISABLED_ManyRoutines) {
+    const int LOG_LEVEL = getOutputLevel();
+    for (const Size count : { 1000, 2000, 4000, 8000 }) {
+        for (const Size threads : { 1, 2, 4 }) {
+            Executable exe{0x1000, manyRoutinesCode(count)};
+            Analyzer::Options opt;
+            opt.threads = threads;
+            Analyzer a{opt};
+            setOutputLevel(LOG_WARN);
+            const auto start = chrono::steady_clock::now();
+            const CodeMap map = a.exploreCode(exe);
+            const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            setOutputLevel(static_cast<LogPriority>(LOG_LEVEL));
+            TRACELN("Explored " << count << " routines with " << threads << " threads in " << elapsed.count() << "ms");
+            ASSERT_EQ(map.routineCount(), count + 1);
+        }
+    }
+}
+
+TEST_F(AnalysisTest, ParallelExploration) {
+    const int LOG_LEVEL = getOutputLevel();
+    // a synthetic executable with many routines next to hello.exe and hellofar.exe (far calls)
+    MzImage mz{"../bin/hello.exe", 0x1000}, mzFar{"../bin/hellofar.exe", 0x1000};
+    const vector<Executable> exes{ Executable{mz}, Executable{mzFar}, Executable{0x1000, manyRoutinesCode(500)} };
+    for (Size ei = 0; ei < exes.size(); ++ei) {
+        string single;
+        for (const Size threads : { 1, 2, 4 }) {
+            Executable exe = exes[ei];
+            Analyzer::Options opt;
+            opt.threads = threads;
+            Analyzer a{opt};
+            setOutputLevel(LOG_WARN);
+            const string saved = mapText(a.exploreCode(exe), "parallel" + to_string(ei) + ".map");
+            setOutputLevel(static_cast<LogPriority>(LOG_LEVEL));
+            ASSERT_FALSE(saved.empty());
+            // the map must not depend on the number of threads
+            if (threads == 1) single = saved;
+            else ASSERT_EQ(saved, single);
+        }
+    }
+}
+
+TEST_F(AnalysisTest, ExplorationCache) {
+    const string cachePath = "explore.cache";
+    deleteFile(cachePath);
+    Analyzer::Options opt;
+    opt.cachePath = cachePath;
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    // the first run explores and saves the cache
+    Executable exe1{mz};
+    const string text1 = mapText(Analyzer{opt}.exploreCode(exe1));
+    ASSERT_TRUE(checkFile(cachePath).exists);
+    ASSERT_NE(exe1.instructionCacheMisses(), 0);
+    // an unchanged rerun does not decode anything
+    Executable exe2{mz};
+    const string text2 = mapText(Analyzer{opt}.exploreCode(exe2));
+    ASSERT_EQ(exe2.instructionCacheMisses(), 0);
+    ASSERT_EQ(text2, text1);
+    // a different load segment does not match
+    MzImage mzOther{"../bin/hello.exe", 0x2000};
+    Executable exe3{mzOther};
+    Analyzer{opt}.exploreCode(exe3);
+    ASSERT_NE(exe3.instructionCacheMisses(), 0);
+    deleteFile(cachePath);
+
+    // call routine_1; jmp $; routine_1: ret; unreached: ret
+    const vector<Byte> code = { 0xe8, 0x02, 0x00, 0xeb, 0xfe, 0xc3, 0xc3 };
+    Executable small1{0x1000, code};
+    ASSERT_EQ(Analyzer{opt}.exploreCode(small1).routineCount(), 2);
+    // a corrupt cache is not used, the exploration starts over: header with one seed, then the visited map size and run count
+    const Offset runsPos = 4 + 2 + 8 + 4 + 5 + 4 + 4;
+    Size runCount;
+    {
+        ifstream cache{cachePath, ios::binary};
+        cache.seekg(runsPos - 4);
+        runCount = readBinaryValue(cache, sizeof(DWord));
+        ASSERT_GE(runCount, 2);
+    }
+    const Offset epsPos = runsPos + runCount * 8 + 4;
+    // entrypoint index past the entrypoints, run index past the entrypoints, consecutive runs of the same routine
+    for (const auto &[pos, value] : vector<pair<Offset, DWord>>{ { epsPos + 4, 0x7f }, { runsPos + 4, 0x7f }, { runsPos + 12, 1 } }) {
+        const string valid = fileText(cachePath);
+        {
+            fstream cache{cachePath, ios::binary | ios::in | ios::out};
+            cache.seekp(pos);
+            writeBinaryValue(cache, value, sizeof(DWord));
+        }
+        Executable corrupt{0x1000, code};
+        ASSERT_EQ(Analyzer{opt}.exploreCode(corrupt).routineCount(), 2);
+        ASSERT_NE(corrupt.instructionCacheMisses(), 0);
+        // and gets replaced by a valid one
+        ASSERT_EQ(fileText(cachePath), valid);
+    }
+    // a new seed at an explored entrypoint only names the routine, also the entrypoint seed when seeded like from a linker map
+    Executable known{0x1000, code};
+    Analyzer k{opt};
+    const CpuState initRegs{known.entrypoint(), known.stackAddr()};
+    analyzerQueue(k) = ScanQueue{known.loadAddr(), known.size(), Destination{}};
+    analyzerQueue(k).saveCall(Address{0x1000, 5}, initRegs, true, "named");
+    analyzerQueue(k).saveCall(known.entrypoint(), initRegs, true, "start");
+    const CodeMap knownMap = k.exploreCode(known);
+    ASSERT_EQ(knownMap.routineCount(), 2);
+    ASSERT_EQ(knownMap.getRoutine("named").entrypoint(), Address(0x1000, 5));
+    ASSERT_EQ(knownMap.getRoutine("start").entrypoint(), known.entrypoint());
+    ASSERT_EQ(known.instructionCacheMisses(), 0);
+    // an additional seed gets explored on top of the cached state
+    Executable small2{0x1000, code};
+    Analyzer a{opt};
+    analyzerQueue(a) = ScanQueue{small2.loadAddr(), small2.size(), Destination(small2.entrypoint(), 1, true, initRegs)};
+    analyzerQueue(a).saveCall(Address{0x1000, 6}, initRegs, true, "extra");
+    const CodeMap seeded = a.exploreCode(small2);
+    ASSERT_EQ(seeded.routineCount(), 3);
+    ASSERT_TRUE(seeded.getRoutine("extra").isValid());
+    ASSERT_EQ(small2.instructionCacheMisses(), 1);
+    // renaming a seed keeps using the cache, with the new name
+    Executable renamed{0x1000, code};
+    Analyzer r{opt};
+    analyzerQueue(r) = ScanQueue{renamed.loadAddr(), renamed.size(), Destination(renamed.entrypoint(), 1, true, initRegs)};
+    analyzerQueue(r).saveCall(Address{0x1000, 6}, initRegs, true, "renamed");
+    const CodeMap renamedMap = r.exploreCode(renamed);
+    ASSERT_EQ(renamedMap.routineCount(), 3);
+    ASSERT_TRUE(renamedMap.getRoutine("renamed").isValid());
+    ASSERT_FALSE(renamedMap.getRoutine("extra").isValid());
+    ASSERT_EQ(renamed.instructionCacheMisses(), 0);
+    // a seed changing nearness is explored again
+    Executable far{0x1000, code};
+    Analyzer f{opt};
+    analyzerQueue(f) = ScanQueue{far.loadAddr(), far.size(), Destination(far.entrypoint(), 1, true, initRegs)};
+    analyzerQueue(f).saveCall(Address{0x1000, 6}, initRegs, false, "extra");
+    ASSERT_FALSE(f.exploreCode(far).getRoutine("extra").near);
+    ASSERT_NE(far.instructionCacheMisses(), 0);
+    // a cache missing one of the seeds is not used
+    Executable small3{0x1000, code};
+    Analyzer b{opt};
+    analyzerQueue(b) = ScanQueue{small3.loadAddr(), small3.size(), Destination(Address{0x1000, 6}, 1, true, initRegs)};
+    ASSERT_EQ(b.exploreCode(small3).routineCount(), 1);
+    ASSERT_EQ(small3.instructionCacheMisses(), 1);
+    deleteFile(cachePath);
+}
+
+TEST_F(AnalysisTest, IncrementalExploration) {
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    Executable prevExe{mz};
+    Analyzer prev{Analyzer::Options()};
+    const CodeMap prevMap = prev.exploreCode(prevExe);
+    const CallGraph prevCalls = prev.callGraph(prevMap);
+    const XrefIndex prevXrefs = prev.xrefIndex();
+    const string prevText = mapText(prevMap);
+    // nothing changed, nothing gets decoded
+    Executable same{mz};
+    ASSERT_EQ(mapText(Analyzer{Analyzer::Options()}.exploreCode(same, prevMap, prevExe)), prevText);
+    ASSERT_EQ(same.instructionCacheMisses(), 0);
+    // change the immediate value of a comparison within one of the routines
+    Executable changed{mz};
+    Address cmpAddr;
+    for (Size ri = prevMap.routineCount() / 2; ri < prevMap.routineCount() && !cmpAddr.isValid(); ++ri) {
+        const Block main = prevMap.getRoutine(ri).mainBlock();
+        for (Address a = main.begin; a <= main.end && !cmpAddr.isValid();) {
+            const Instruction i = prevExe.getInstruction(a);
+            if (i.iclass == INS_CMP && (i.op2.type == OPR_IMM8 || i.op2.type == OPR_IMM16)) cmpAddr = a + static_cast<Offset>(i.length - 1);
+            a += i.length;
+        }
+    }
+    ASSERT_TRUE(cmpAddr.isValid());
+    TRACELN("Changing comparison immediate at " << cmpAddr.toString());
+    *exeData(changed, cmpAddr) ^= 0x5a;
+    Executable full = changed;
+    const string fullText = mapText(Analyzer{Analyzer::Options()}.exploreCode(full));
+    const string incrementalText = mapText(Analyzer{Analyzer::Options()}.exploreCode(changed, prevMap, prevExe));
+    ASSERT_EQ(incrementalText, fullText);
+    TRACELN("Decoded " << changed.instructionCacheMisses() << " instructions incrementally vs " << full.instructionCacheMisses() << " for full exploration");
+    ASSERT_LT(changed.instructionCacheMisses() * 4, full.instructionCacheMisses());
+    // the call sites and references carried over from the previous exploration are not recorded again, and the result
+    // matches a full exploration also when the change hits a routine reached with a known DS (routine_2 is called with
+    // the data segment loaded, the change at 0x24d decodes a reference to data through it), or removes or retargets
+    // the only call to a routine (routine_5 calls routine_14 at 0x468, routine_22 calls routine_27 at 0xff2)
+    const vector<pair<Address, vector<Byte>>> changes = {
+        { cmpAddr, { static_cast<Byte>(*exeData(same, cmpAddr) ^ 0x5a) } },
+        { Address{0x1000, 0x24d}, { static_cast<Byte>(*exeData(same, Address{0x1000, 0x24d}) ^ 0x5a) } },
+        { Address{0x1000, 0x468}, { 0x90, 0x90, 0x90 } },
+        { Address{0x1000, 0xff2}, { 0xe8, 0x00, 0x00 } },
+    };
+    // the full exploration numbers routines and variables in the order it finds them, name them after their addresses instead
+    const auto entryNames = [&](CodeMap map) {
+        for (Routine &r : getRoutines(map)) r.name = "routine_" + hexVal(r.entrypoint().offset, false);
+        for (Variable &v : getVariables(map)) v.name = "var_" + hexVal(v.addr.toLinear(), false);
+        return mapText(map);
+    };
+    for (const auto &[changeAddr, bytes] : changes) {
+        Executable fullExe{mz}, incrementalExe{mz};
+        vector<Byte> patch = bytes;
+        // retarget the call to the entrypoint of routine_25
+        if (patch.front() == 0xe8) {
+            const Word rel = static_cast<Word>(prevMap.getRoutine("routine_25").entrypoint().offset - (changeAddr.offset + 3));
+            patch[1] = static_cast<Byte>(rel & 0xff);
+            patch[2] = static_cast<Byte>(rel >> 8);
+        }
+        for (Size i = 0; i < patch.size(); ++i) {
+            *exeData(fullExe, changeAddr + static_cast<Offset>(i)) = patch[i];
+            *exeData(incrementalExe, changeAddr + static_cast<Offset>(i)) = patch[i];
+        }
+        TRACELN("Changing " << patch.size() << " bytes at " << changeAddr.toString());
+        Analyzer fullAnalyzer{Analyzer::Options()}, incremental{Analyzer::Options()};
+        const CodeMap fullMap = fullAnalyzer.exploreCode(fullExe);
+        incremental.seedCalls(prevCalls);
+        incremental.seedXrefs(prevXrefs);
+        const CodeMap incrementalMap = incremental.exploreCode(incrementalExe, prevMap, prevExe);
+        ASSERT_EQ(entryNames(incrementalMap), entryNames(fullMap));
+        fullAnalyzer.callGraph(fullMap).save("incremental.calls", 0x1000);
+        const string fullCalls = fileText("incremental.calls");
+        incremental.callGraph(incrementalMap).save("incremental.calls", 0x1000);
+        ASSERT_EQ(fileText("incremental.calls"), fullCalls);
+        fullAnalyzer.xrefIndex().save("incremental.xrefs", 0x1000);
+        const string fullXrefs = fileText("incremental.xrefs");
+        incremental.xrefIndex().save("incremental.xrefs", 0x1000);
+        ASSERT_EQ(fileText("incremental.xrefs"), fullXrefs);
+    }
+    // a routine cannot be reused from an executable loaded elsewhere
+    MzImage mzOther{"../bin/hello.exe", 0x2000};
+    Executable other{mzOther};
+    ASSERT_THROW(Analyzer{Analyzer::Options()}.exploreCode(other, prevMap, prevExe), ArgError);
+}
+
+TEST_F(AnalysisTest, CallGraph) {
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    Executable exe{mz};
+    Analyzer a{Analyzer::Options()};
+    const CodeMap map = a.exploreCode(exe);
+    const CallGraph graph = a.callGraph(map);
+    ASSERT_EQ(graph.nodeCount(), map.routineCount());
+    const Size start = graph.findNode(exe.entrypoint());
+    ASSERT_NE(start, CallGraph::NO_NODE);
+    ASSERT_EQ(graph.callees(start).size(), 10);
+    ASSERT_EQ(graph.callers(start).size(), 0);
+    ASSERT_EQ(graph.findNode(Address{0x1000, 0x1}), CallGraph::NO_NODE);
+    // both directions hold the same edges
+    Size edges = 0;
+    for (Size n = 0; n < graph.nodeCount(); ++n) {
+        for (const auto &e : graph.callees(n)) {
+            const auto callers = graph.callers(e.node);
+            ASSERT_TRUE(std::any_of(callers.begin(), callers.end(), [&](const auto &c) { return c.node == n && c.site == e.site; }));
+            edges++;
+        }
+    }
+    ASSERT_EQ(edges, graph.edgeCount());
+    ASSERT_NE(graph.unresolved().size(), 0);
+    // callees come before their callers
+    const auto order = graph.topologicalOrder();
+    ASSERT_EQ(order.size(), graph.nodeCount());
+    vector<Size> position(order.size());
+    for (Size i = 0; i < order.size(); ++i) position[order[i]] = i;
+    for (Size n = 0; n < graph.nodeCount(); ++n) {
+        for (const auto &e : graph.callees(n)) ASSERT_LE(position[e.node], position[n]);
+    }
+    // save and load with relocation
+    graph.save("hello.map.calls", 0x1000);
+    const CallGraph loaded{"hello.map.calls", 0x1000};
+    ASSERT_EQ(loaded.nodeCount(), graph.nodeCount());
+    ASSERT_EQ(loaded.edgeCount(), graph.edgeCount());
+    const auto sites = graph.callSites(), loadedSites = loaded.callSites();
+    ASSERT_EQ(loadedSites.size(), sites.size());
+    for (Size i = 0; i < sites.size(); ++i) {
+        ASSERT_EQ(loadedSites[i].site, sites[i].site);
+        ASSERT_EQ(loadedSites[i].dest, sites[i].dest);
+        ASSERT_EQ(loadedSites[i].near, sites[i].near);
+    }
+    // the registers the routines were entered with come along
+    ASSERT_FALSE(graph.entryStates().empty());
+    ASSERT_EQ(loaded.entryStates().size(), graph.entryStates().size());
+    for (Size n = 0; n < graph.nodeCount(); ++n) {
+        const CpuState *regs = graph.entryState(n), *loadedRegs = loaded.entryState(n);
+        ASSERT_EQ(loadedRegs == nullptr, regs == nullptr);
+        if (regs) ASSERT_EQ(*loadedRegs, *regs);
+    }
+}
+
+TEST_F(AnalysisTest, Xrefs) {
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    Executable exe{mz};
+    Analyzer a{Analyzer::Options()};
+    const CodeMap map = a.exploreCode(exe);
+    const XrefIndex index = a.xrefIndex();
+    ASSERT_FALSE(index.empty());
+    // sorted by target, then source
+    for (Size i = 1; i < index.size(); ++i) {
+        ASSERT_LE(index.target(i - 1), index.target(i));
+        if (index.target(i - 1) == index.target(i)) {
+            ASSERT_LT(index.source(i - 1), index.source(i));
+        }
+    }
+    // every recorded variable has a data reference, every callee of the graph has a call reference
+    for (Size vi = 0; vi < map.variableCount(); ++vi) {
+        const auto range = index.refsTo(map.getVariable(vi).addr);
+        ASSERT_FALSE(range.empty());
+        for (Size i = range.begin; i < range.end; ++i) {
+            ASSERT_TRUE(index.kind(i) == XREF_READ || index.kind(i) == XREF_WRITE);
+        }
+    }
+    const CallGraph graph = a.callGraph(map);
+    for (Size n = 0; n < graph.nodeCount(); ++n) {
+        for (const auto &e : graph.callers(n)) {
+            const auto range = index.refsTo(graph.entrypoint(n));
+            bool found = false;
+            for (Size i = range.begin; i < range.end; ++i) found = found || (index.source(i) == e.site && index.kind(i) == XREF_CALL);
+            ASSERT_TRUE(found);
+        }
+    }
+    // a block lookup covers all the single address lookups within it
+    const Routine start = map.getRoutine("start");
+    Size blockCount = 0;
+    for (Offset off = start.extents.begin.toLinear(); off <= start.extents.end.toLinear(); ++off) blockCount += index.refsTo(Address{off}).size();
+    ASSERT_EQ(index.refsTo(start.extents).size(), blockCount);
+    ASSERT_TRUE(index.refsTo(Address{0xffff, 0xf}).empty());
+    // save and load with relocation
+    index.save("hello.map.xrefs", 0x1000);
+    const XrefIndex loaded{"hello.map.xrefs", 0x1000};
+    // absolute references below the load segment are not saved
+    Size absolute = 0;
+    while (absolute < index.size() && index.target(absolute).segment < 0x1000) absolute++;
+    ASSERT_NE(absolute, 0);
+    ASSERT_EQ(loaded.size(), index.size() - absolute);
+    for (Size i = 0; i < loaded.size(); ++i) {
+        ASSERT_EQ(loaded.target(i), index.target(absolute + i));
+        ASSERT_EQ(loaded.source(i), index.source(absolute + i));
+        ASSERT_EQ(loaded.kind(i), index.kind(absolute + i));
+    }
+    // multiplication and division only read their memory operand, negation writes it
+    const vector<Byte> code = {
+        0xb8, 0x00, 0x10,       // mov ax, 0x1000
+        0x8e, 0xd8,             // mov ds, ax
+        0xf7, 0x26, 0x00, 0x02, // mul word [0x200]
+        0xf7, 0x2e, 0x02, 0x02, // imul word [0x202]
+        0xf7, 0x36, 0x04, 0x02, // div word [0x204]
+        0xf7, 0x3e, 0x06, 0x02, // idiv word [0x206]
+        0xf7, 0x1e, 0x08, 0x02, // neg word [0x208]
+        0xeb, 0xfe              // jmp $
+    };
+    Executable synth{0x1000, code};
+    Analyzer sa{Analyzer::Options()};
+    sa.exploreCode(synth);
+    const XrefIndex synthIndex = sa.xrefIndex();
+    for (const Word off : { 0x200, 0x202, 0x204, 0x206, 0x208 }) {
+        const auto range = synthIndex.refsTo(Address{0x1000, off});
+        ASSERT_EQ(range.size(), 1);
+        ASSERT_EQ(synthIndex.kind(range.begin), off == 0x208 ? XREF_WRITE : XREF_READ);
+    }
+}
+
+TEST_F(AnalysisTest, ReuseAnalyzer) {
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    Executable fresh{mz};
+    Analyzer fa{Analyzer::Options()};
+    const CodeMap freshMap = fa.exploreCode(fresh);
+    const string expected = mapText(freshMap);
+    const Size callCount = fa.callGraph(freshMap).edgeCount(), xrefCount = fa.xrefIndex().size();
+
+    // results of one run do not leak into the next one, whatever it is
+    Analyzer a{Analyzer::Options()};
+    for (int run = 0; run < 3; ++run) {
+        Executable exe{mz}, tgt{mz}, other{0x1000, { 0xe8, 0x01, 0x00, 0xc3, 0xc3 }};
+        ASSERT_EQ(a.exploreCode(other).routineCount(), 2);
+        ASSERT_TRUE(a.compareCode(exe, tgt, freshMap));
+        const CodeMap map = a.exploreCode(exe);
+        ASSERT_EQ(mapText(map), expected);
+        ASSERT_EQ(a.callGraph(map).edgeCount(), callCount);
+        ASSERT_EQ(a.xrefIndex().size(), xrefCount);
+    }
+    a.reset();
+    ASSERT_EQ(analyzerQueue(a).routineCount(), 0);
+    ASSERT_TRUE(a.xrefIndex().empty());
+}
+
+TEST_F(AnalysisTest, VisitedMap) {
+    // random assignments checked against a plain byte map
+    const Size size = 0x10000;
+    VisitedMap vm{size};
+    vector<RoutineIdx> ref(size, NULL_ROUTINE);
+    mt19937 rng{1234};
+    for (int i = 0; i < 2000; ++i) {
+        const Offset off = rng() % size;
+        const Size len = min<Size>(1 + rng() % 64, size - off);
+        const RoutineIdx idx = rng() % 8;
+        vm.assign(off, len, idx);
+        std::fill(ref.begin() + off, ref.begin() + off + len, idx);
+    }
+    Size runs = 0;
+    for (Offset off = 0; off < size; ++off) {
+        ASSERT_EQ(vm.get(off), ref[off]);
+        if (off == 0 || ref[off] != ref[off - 1]) runs++;
+    }
+    ASSERT_EQ(vm.runCount(), runs);
+    ASSERT_EQ(vm.get(size - 1), VisitedMap{ref}.get(size - 1));
+    ASSERT_EQ(VisitedMap{ref}.runCount(), runs);
+    ASSERT_THROW(vm.get(size), ArgError);
+    // unvisited runs cover exactly the unclaimed offsets
+    Offset off = 0;
+    for (auto run = vm.next(0, NULL_ROUTINE); run.size() != 0; run = vm.next(run.end, NULL_ROUTINE)) {
+        ASSERT_GE(run.begin, off);
+        for (Offset o = off; o < run.begin; ++o) ASSERT_NE(ref[o], NULL_ROUTINE);
+        for (Offset o = run.begin; o < run.end; ++o) ASSERT_EQ(ref[o], NULL_ROUTINE);
+        off = run.end;
+    }
+    for (Offset o = off; o < size; ++o) ASSERT_NE(ref[o], NULL_ROUTINE);
+    // a fully claimed area collapses into a single run
+    vm.assign(0, size, 1);
+    ASSERT_EQ(vm.runCount(), 1);
+    ASSERT_EQ(vm.next(0, NULL_ROUTINE).size(), 0);
+}
+
+TEST_F(AnalysisTest, ResidentExecutables) {
+    // only the load module is kept, so many executables can be resident at once
+    ASSERT_LT(sizeof(Executable), KB);
+    vector<Executable> exes;
+    for (int i = 0; i < 32; ++i) {
+        MzImage mz{"../bin/hello.exe", 0x1000};
+        exes.emplace_back(mz);
+    }
+    const Executable &first = exes.front();
+    for (const auto &exe : exes) {
+        ASSERT_EQ(exe.size(), first.size());
+        ASSERT_TRUE(std::equal(first.codePointer(first.loadAddr()), first.codePointer(first.loadAddr()) + first.size(), exe.codePointer(exe.loadAddr())));
+        ASSERT_EQ(exe.getInstruction(exe.entrypoint()).toString(), first.getInstruction(first.entrypoint()).toString());
+        ASSERT_EQ(exe.find({0x55, 0x8b, 0xec}), first.find({0x55, 0x8b, 0xec}));
+    }
+    // out of the load module
+    ASSERT_THROW(first.codePointer(Address{0}), AddressError);
+}
+
 TEST_F(AnalysisTest, EditDistance) {
     string s1 = "kitten", s2 = "sitting", s3 = "asdfvadfv";
     uint32_t maxDistance = numeric_limits<uint32_t>::max();
@@ -673,3 +1449,35 @@ TEST_F(AnalysisTest, DataCompare) {
     writeExeData(tgt, mismatchAddr, (*data)+1);
     ASSERT_FALSE(a.compareData(ref, tgt, map, map, dsegName));
 }
+
+// Not a correctness test, runs full comparisons of hello.exe against itself and reports the time taken,
+// both with the output silenced and with the verbose comparison output rendered into a discarded stream.
+// Run with --debug to see the numbers.
+TEST_F(AnalysisTest, CompareThroughput) {
+    const int PASSES = 10;
+    const Word loadSegment = 0x1000;
+    MzImage mz{"../bin/hello.exe", loadSegment};
+    CodeMap map{"hello.map", loadSegment};
+    ASSERT_FALSE(map.empty());
+    const LogPriority level = getOutputLevel();
+    ostringstream discard;
+    for (const LogPriority pri : { LOG_SILENT, LOG_VERBOSE }) {
+        streambuf *coutBuf = cout.rdbuf(discard.rdbuf());
+        setOutputLevel(pri);
+        chrono::microseconds elapsed{0};
+        bool match = true;
+        for (int pass = 0; pass < PASSES; ++pass) {
+            // only time the comparison itself, not setting up the executables
+            Executable ref{mz}, tgt{mz};
+            Analyzer a{Analyzer::Options()};
+            const auto start = chrono::steady_clock::now();
+            match = match && a.compareCode(ref, tgt, map);
+            elapsed += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+            discard.str({});
+        }
+        setOutputLevel(level);
+        cout.rdbuf(coutBuf);
+        TRACELN("Compared hello.exe " << PASSES << " times at output level " << pri << " in " << elapsed.count() << "us, " << elapsed.count() / PASSES << "us per comparison");
+        ASSERT_TRUE(match);
+    }
+}
@@ -7,6 +7,9 @@
 #include "dos/codemap.h"
 #include "dos/address.h"
 #include "dos/scanq.h"
+#include "dos/instruction.h"
+#include "dos/memory.h"
+#include "dos/error.h"
 
 using namespace std;
 
@@ -167,4 +170,25 @@ TEST_F(BufferOverflowTest, EdgeCaseValues) {
         auto result = map.findSegment(Offset(0xFFF));
         EXPECT_EQ(result.type, Segment::SEG_NONE);
     }
-}
\ No newline at end of file
+}
+
+TEST_F(BufferOverflowTest, TruncatedInstruction) {
+    // nop, then a mov ax, imm16 missing the high byte of the immediate at the end of the load module
+    const vector<Byte> data = { 0x90, 0xb8, 0x34 };
+    Executable exe{0x1000, data};
+    const Address begin = exe.loadAddr();
+    // the decoder can run into the zeroed guard zone past the end of the data
+    for (Size i = 0; i < MEM_GUARD; ++i) {
+        EXPECT_EQ(exe.codePointer(begin + data.size())[i], 0);
+    }
+    // only the load module is addressable
+    EXPECT_THROW(exe.codePointer(begin + Offset(data.size() + 1)), AddressError);
+    EXPECT_THROW(exe.codePointer(Address{0x0fff, 0xf}), AddressError);
+    EXPECT_EQ(exe.readWord(begin + Offset(1)), 0x34b8);
+    EXPECT_EQ(exe.getInstruction(begin).length, 1);
+    EXPECT_THROW(exe.getInstruction(begin + Offset(1)), CpuError);
+    // not cached, the error repeats
+    EXPECT_THROW(exe.getInstruction(begin + Offset(1)), CpuError);
+    EXPECT_THROW(exe.instructionCount(exe.extents()), CpuError);
+    EXPECT_EQ(exe.instructionCount(Block{begin, begin}), 1);
+}
@@ -1,5 +1,6 @@
 #include <vector>
 #include <limits>
+#include <chrono>
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "debug.h"
@@ -10,6 +11,10 @@
 #include "dos/util.h"
 #include "dos/interrupt.h"
 #include "dos/instruction.h"
+#include "dos/mz.h"
+#include "dos/executable.h"
+#include "dos/error.h"
+#include "dos/output.h"
 
 using namespace std;
 using ::testing::_;
@@ -516,6 +521,38 @@ TEST_F(CpuTest, InstructionMatch) {
     ASSERT_EQ(i3.match(i4), INS_MATCH_MISMATCH);
 }
 
+TEST_F(CpuTest, InstructionKey) {
+    const Address a{0x1000, 0x0};
+    const Byte code[] = {
+        0x8b, 0x46, 0xfe,       // mov ax, [bp-0x2]
+        0x8b, 0x86, 0xfe, 0xff, // mov ax, [bp-0x2] (word offset)
+        0x8b, 0x86, 0xfc, 0xff, // mov ax, [bp-0x4] (word offset)
+        0x89, 0x46, 0xfe,       // mov [bp-0x2], ax
+        0xc7, 0x46, 0xfe, 0x01, 0x00, // mov word [bp-0x2], 0x1
+        0xc7, 0x46, 0xfc, 0x02, 0x00, // mov word [bp-0x4], 0x2
+        0x74, 0x0b, // jz
+        0x75, 0x0b, // jnz
+    };
+    Instruction
+        i1{a, code}, i2{a, code + 3}, i3{a, code + 7}, i4{a, code + 11},
+        i5{a, code + 14}, i6{a, code + 19}, i7{a, code + 24}, i8{a, code + 26};
+    TRACELN(i1.toString() << ": key = " << hex << i1.key << ", value = " << i1.value);
+    // the byte and word encodings of the same offset are equivalent
+    ASSERT_EQ(i1.key, i2.key);
+    ASSERT_EQ(i1.value, i2.value);
+    ASSERT_EQ(i1.match(i2), INS_MATCH_FULL);
+    ASSERT_EQ(i1.signature(), i2.signature());
+    ASSERT_EQ(i1.match(i3), INS_MATCH_DIFFOP2);
+    ASSERT_EQ(i4.match(i1), INS_MATCH_MISMATCH);
+    ASSERT_EQ(i4.match(i5), INS_MATCH_MISMATCH);
+    ASSERT_EQ(i5.match(i6), INS_MATCH_DIFF);
+    ASSERT_EQ(i7.match(i8), INS_MATCH_MISMATCH);
+    ASSERT_EQ(i7.signature(), i8.signature());
+    // default-constructed instructions only match each other
+    ASSERT_EQ(Instruction().match(Instruction()), INS_MATCH_FULL);
+    ASSERT_EQ(Instruction().match(i1), INS_MATCH_MISMATCH);
+}
+
 TEST_F(CpuTest, BranchOffset) {
     const Word base = 0x6b00;
     const Address a{0x1000, base};
@@ -539,4 +576,60 @@ TEST_F(CpuTest, BranchOffset) {
     ASSERT_EQ(i4.relativeOffset(), -27324);
     ASSERT_EQ(i4.absoluteOffset(), base + 3 - 27324);
     ASSERT_EQ(i4.toString(true), "call 0x47 (0x6abc up)");
-}
\ No newline at end of file
+}
+
+TEST_F(CpuTest, InstructionLength) {
+    for (const string path : { "../bin/hello.exe", "../bin/hellofar.exe" }) {
+        MzImage mz{path, 0x1000};
+        Executable exe{mz};
+        const Address begin = exe.loadAddr();
+        Size valid = 0;
+        for (Offset off = 0; off < exe.size(); ++off) {
+            const Address a = begin + off;
+            const Size length = ::instructionLength(exe.codePointer(a));
+            Size expected = 0;
+            try {
+                expected = Instruction{a, exe.codePointer(a)}.length;
+                valid++;
+            }
+            catch (CpuError &e) {}
+            if (length != expected) TRACELN(path << ": length mismatch at " << a << ", expected " << expected << ", got " << length);
+            ASSERT_EQ(length, expected);
+        }
+        TRACELN(path << ": verified length at " << exe.size() << " offsets, " << valid << " valid instructions");
+    }
+}
+
+// Not a correctness test, decodes an instruction at every offset of an executable's load module repeatedly and reports the throughput.
+// Run with --debug to see the numbers.
+TEST_F(CpuTest, DecodeThroughput) {
+    const int PASSES = 20;
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    Executable exe{mz};
+    const Address begin = exe.loadAddr();
+    Size decoded = 0, failed = 0, totalLength = 0;
+    // keep the logging out of the measurement
+    const LogPriority level = getOutputLevel();
+    setOutputLevel(LOG_SILENT);
+    const auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; ++pass) {
+        for (Offset off = 0; off < exe.size(); ++off) {
+            const Address a = begin + off;
+            try {
+                const Instruction i{a, exe.codePointer(a)};
+                totalLength += i.length;
+                decoded++;
+            }
+            catch (CpuError &e) {
+                failed++;
+            }
+        }
+    }
+    const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    setOutputLevel(level);
+    const Size total = decoded + failed;
+    TRACELN("Decoded " << total << " locations (" << failed << " invalid) in " << elapsed << "us, " 
+        << (elapsed ? (total * 1000000ULL) / elapsed : 0) << " instructions/s");
+    ASSERT_EQ(total, PASSES * exe.size());
+    ASSERT_GT(totalLength, decoded);
+}
@@ -4,8 +4,11 @@
 #include "dos/dos.h"
 #include "dos/mz.h"
 #include "dos/util.h"
+#include "dos/error.h"
 
 #include <vector>
+#include <fstream>
+#include <iterator>
 #include <numeric>
 
 using namespace std;
@@ -26,3 +29,89 @@ TEST(Dos, HexDiff) {
     hexDump(buf1.data(), buf1.size());
     hexDiff(buf1.data(), buf2.data(), 0x17, 0xe3, 0x1234, 0xabcd);
 }
+
+TEST(Dos, MzLoad) {
+    const string path = "../bin/hello.exe";
+    ifstream exeFile{path, ios::binary};
+    ASSERT_TRUE(exeFile);
+    const vector<Byte> file{istreambuf_iterator<char>(exeFile), istreambuf_iterator<char>()};
+    MzImage mz{path};
+    const Byte *fileModule = file.data() + mz.loadModuleOffset();
+    // the load module differs from the file only at the relocations, which get loaded again at a different segment
+    const string before = mz.dump();
+    mz.load(0x1000);
+    const vector<Byte> first(mz.loadModuleData(), mz.loadModuleData() + mz.loadModuleSize());
+    mz.load(0x2345);
+    const Byte *second = mz.loadModuleData();
+    Size patched = 0;
+    for (Offset off = 0; off < mz.loadModuleSize(); ++off) {
+        // adding 0x2345 always changes the low byte of a relocated word, unlike 0x1000
+        if (second[off] == fileModule[off]) {
+            ASSERT_EQ(first[off], fileModule[off]);
+            continue;
+        }
+        const Word fileVal = fileModule[off] | (fileModule[off + 1] << 8);
+        ASSERT_EQ(first[off] | (first[off + 1] << 8), Word(fileVal + 0x1000));
+        ASSERT_EQ(second[off] | (second[off + 1] << 8), Word(fileVal + 0x2345));
+        patched++;
+        off++;
+    }
+    TRACELN("Relocations patched: " << patched);
+    ASSERT_GT(patched, 0);
+    // the file values reported for the relocations do not change with loading
+    ASSERT_EQ(mz.dump(), before);
+}
+
+TEST(Dos, MzHeaderOnly) {
+    // the header can be queried without the load module being present
+    const string path = "../bin/hello.exe";
+    const string truncPath = "hello_trunc.exe";
+    ifstream exeFile{path, ios::binary};
+    ASSERT_TRUE(exeFile);
+    const vector<Byte> file{istreambuf_iterator<char>(exeFile), istreambuf_iterator<char>()};
+    writeBinaryFile(truncPath, file.data(), 0x200);
+    {
+        MzImage mz{truncPath};
+        ASSERT_EQ(mz.loadModuleSize(), 6723);
+        ASSERT_EQ(mz.headerLength(), 512);
+        ASSERT_THROW(mz.load(0x1000), IoError);
+    }
+    deleteFile(truncPath);
+}
+
+TEST(Dos, MzRejectedUnmapped) {
+    // a file rejected after being mapped does not stay mapped
+    const string path = "../bin/hello.exe";
+    const string badPath = "hello_badsig.exe";
+    ifstream exeFile{path, ios::binary};
+    ASSERT_TRUE(exeFile);
+    vector<Byte> file{istreambuf_iterator<char>(exeFile), istreambuf_iterator<char>()};
+    file[0] = 'X';
+    writeBinaryFile(badPath, file.data(), file.size());
+    for (int i = 0; i < 10; ++i) ASSERT_THROW(MzImage{badPath}, IoError);
+    ifstream maps{"/proc/self/maps"};
+    string line;
+    while (getline(maps, line)) ASSERT_EQ(line.find(badPath), string::npos);
+    deleteFile(badPath);
+}
+
+TEST(Dos, MzDuplicateRelocation) {
+    // a location listed twice in the relocation table is still relocated once
+    const string path = "../bin/hello.exe";
+    const string dupPath = "hello_duprel.exe";
+    ifstream exeFile{path, ios::binary};
+    ASSERT_TRUE(exeFile);
+    vector<Byte> file{istreambuf_iterator<char>(exeFile), istreambuf_iterator<char>()};
+    const Offset relocTable = file[0x18] | (file[0x19] << 8);
+    ASSERT_GE(file[0x6] | (file[0x7] << 8), 2);
+    copy(file.begin() + relocTable, file.begin() + relocTable + MZ_RELOC_SIZE, file.begin() + relocTable + MZ_RELOC_SIZE);
+    writeBinaryFile(dupPath, file.data(), file.size());
+    {
+        MzImage mz{dupPath, 0x1000};
+        const Offset off = Address(file[relocTable + 2] | (file[relocTable + 3] << 8), file[relocTable] | (file[relocTable + 1] << 8)).toLinear();
+        const Byte *fileModule = file.data() + mz.loadModuleOffset();
+        const Word fileVal = fileModule[off] | (fileModule[off + 1] << 8);
+        ASSERT_EQ(mz.loadModuleData()[off] | (mz.loadModuleData()[off + 1] << 8), Word(fileVal + 0x1000));
+    }
+    deleteFile(dupPath);
+}
@@ -1,7 +1,10 @@
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include "debug.h"
 #include "gtest/gtest.h"
 #include "dos/memory.h"
+#include "dos/mz.h"
 #include "dos/util.h"
 #include "dos/error.h"
 
@@ -249,6 +252,28 @@ TEST_F(MemoryTest, BlockSplit) {
     ASSERT_EQ(splitSpan, b.size());
 }
 
+TEST_F(MemoryTest, AddressSet) {
+    AddressSet set;
+    ASSERT_TRUE(set.empty());
+    ASSERT_FALSE(set.contains(Address{0x1000, 0x10}));
+    ASSERT_TRUE(set.insert(Address{0x1000, 0x10}));
+    ASSERT_FALSE(set.insert(Address{0x1000, 0x10}));
+    // an alias of the same linear address is not stored again, the first one is kept
+    ASSERT_FALSE(set.insert(Address{0x1001, 0x0}));
+    ASSERT_TRUE(set.contains(Address{0x1001, 0x0}));
+    ASSERT_EQ(set.addresses().front().segment, 0x1000);
+    // enough insertions to grow the table a few times
+    for (Word off = 0x20; off < 0x4020; off += 2) ASSERT_TRUE(set.insert(Address{0x2000, off}));
+    ASSERT_EQ(set.size(), 0x2001);
+    for (Word off = 0x20; off < 0x4020; ++off) ASSERT_EQ(set.contains(Address{0x2000, off}), off % 2 == 0);
+    const auto addrs = set.addresses();
+    ASSERT_EQ(addrs.size(), set.size());
+    ASSERT_TRUE(std::is_sorted(addrs.begin(), addrs.end()));
+    set.clear();
+    ASSERT_TRUE(set.empty());
+    ASSERT_FALSE(set.contains(Address{0x1000, 0x10}));
+}
+
 TEST_F(MemoryTest, Init) {
     const Size memSize = mem.size();
     const Byte pattern[] = { 0xde, 0xad, 0xbe, 0xef };
@@ -328,3 +353,72 @@ TEST_F(MemoryTest, FindPattern) {
     ASSERT_TRUE(addr3.isValid());
     ASSERT_EQ(addr3.toLinear(), 0);
 }
+
+// straightforward reference for checking the search results
+static Size naiveFind(const Byte *data, const Size size, const ByteString &pattern) {
+    for (Size pos = 0; pos + pattern.size() <= size; ++pos) {
+        bool match = true;
+        for (Size i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != -1 && pattern[i] != data[pos + i]) { match = false; break; }
+        }
+        if (match) return pos;
+    }
+    return size;
+}
+
+TEST_F(MemoryTest, FindPatternEdgeCases) {
+    const Byte data[] = { 0xaa, 0xbb, 0xcc, 0xaa, 0xbb, 0xdd, 0xee };
+    const Size size = sizeof(data);
+    ASSERT_EQ(findPattern(data, size, {}), 0);
+    ASSERT_EQ(findPattern(data, size, { -1, -1 }), 0);
+    ASSERT_EQ(findPattern(data, size, { 0xaa, 0xbb, 0xdd }), 3);
+    ASSERT_EQ(findPattern(data, size, { 0xbb, -1, -1 }), 1);
+    ASSERT_EQ(findPattern(data, size, { -1, 0xbb, 0xdd, -1 }), 3);
+    ASSERT_EQ(findPattern(data, size, { 0xdd, 0xee }), 5);
+    ASSERT_EQ(findPattern(data, size, { 0xdd, 0xee, -1 }), size);
+    ASSERT_EQ(findPattern(data, size, { 0xaa, 0x1aa }), size);
+    ASSERT_EQ(findPattern(data, size, { 0xaa, 0xbb, 0xcc, 0xaa, 0xbb, 0xdd, 0xee, 0x00 }), size);
+}
+
+// Searches a 640 KiB image for patterns of 4 to 64 bytes with and without wildcards, compares the results against 
+// a naive search and reports the time taken. Run with --debug to see the numbers.
+TEST_F(MemoryTest, FindPatternBenchmark) {
+    const Size IMAGE_SIZE = 640 * KB;
+    const Size PLANT_OFFSET = IMAGE_SIZE - 4 * KB;
+    const int PASSES = 5;
+    // realistic byte distribution from a tiled executable, with a block of pseudorandom data near the end to take patterns from
+    MzImage mz{"../bin/hello.exe", 0x1000};
+    vector<Byte> image(IMAGE_SIZE);
+    for (Size off = 0; off < IMAGE_SIZE; off += mz.loadModuleSize()) {
+        std::copy(mz.loadModuleData(), mz.loadModuleData() + std::min(mz.loadModuleSize(), IMAGE_SIZE - off), image.begin() + off);
+    }
+    DWord seed = 0x12345678;
+    for (Size off = PLANT_OFFSET; off < IMAGE_SIZE; ++off) {
+        seed = seed * 1103515245 + 12345;
+        image[off] = static_cast<Byte>(seed >> 16);
+    }
+    for (const Size length : { 4, 8, 16, 32, 64 }) {
+        for (const bool wildcards : { false, true }) {
+            ByteString pattern(image.begin() + PLANT_OFFSET + length, image.begin() + PLANT_OFFSET + 2 * length);
+            if (wildcards) for (Size i = 1; i < length; i += 3) pattern[i] = -1;
+            const Size expected = naiveFind(image.data(), image.size(), pattern);
+            ASSERT_EQ(expected, PLANT_OFFSET + length);
+            Size found = 0;
+            chrono::microseconds fast{0}, naive{0};
+            for (int pass = 0; pass < PASSES; ++pass) {
+                auto start = chrono::steady_clock::now();
+                found = findPattern(image.data(), image.size(), pattern);
+                fast += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+                start = chrono::steady_clock::now();
+                naiveFind(image.data(), image.size(), pattern);
+                naive += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+            }
+            TRACELN("Pattern of " << length << " bytes" << (wildcards ? " with wildcards" : "") << ": " << fast.count() / PASSES 
+                << "us per search, naive search " << naive.count() / PASSES << "us");
+            ASSERT_EQ(found, expected);
+            // also a pattern taken from the executable code, found at its first occurrence
+            const ByteString codePattern(image.begin() + 0x100, image.begin() + 0x100 + length);
+            ASSERT_EQ(findPattern(image.data(), image.size(), codePattern), naiveFind(image.data(), image.size(), codePattern));
+        }
+    }
+}